@@ -2,8 +2,20 @@
 
 #include "arch/eflags.h"
 #include "arch/interrupt.h"
+#include "kconfig.h"
 #include "lib/string.h"
-#include "mem/alloc.h"
+#include "mem/mempool.h"
+#include "mem/slab.h"
+
+/**
+ * Object cache for character buffer blocks
+ */
+static kmem_cache_t* cblock_cache;
+/**
+ * Characters mostly arrive from interrupt handlers, which can neither sleep nor afford to drop
+ * input just because the page allocator is momentarily short
+ */
+static mempool_t     cblock_pool;
 
 static bool
 cblock_has_unread_chars (cblock_t* cb) {
@@ -21,8 +33,7 @@ insert_cblock_in_tail (charq_t* q) {
     return NULL;
   }
 
-  // TODO: calloc
-  cblock_t* cb = (cblock_t*)kmalloc(sizeof(cblock_t));
+  cblock_t* cb = (cblock_t*)mempool_alloc(&cblock_pool, GFP_ATOMIC);
   if (!cb) {
     return NULL;
   }
@@ -59,7 +70,7 @@ delete_cblock_from_head (charq_t* q) {
   q->current_cblock_size -= tmp->next_write_index - tmp->next_read_index;
   q->size--;
 
-  kfree((unsigned int)tmp);
+  mempool_free(&cblock_pool, tmp);
 }
 
 static void
@@ -78,6 +89,8 @@ delete_cblock_from_tail (charq_t* q) {
 
   q->current_cblock_size -= tmp->next_write_index - tmp->next_read_index;
   q->size--;
+
+  mempool_free(&cblock_pool, tmp);
 }
 
 retval_t
@@ -177,3 +190,9 @@ int
 charq_remaining (charq_t* q) {
   return (CHARQ_SIZE * CBLOCK_SIZE) - q->current_cblock_size;
 }
+
+void
+charq_init (void) {
+  cblock_cache = kmem_cache_create("cblock", sizeof(cblock_t), 0, NULL);
+  mempool_init(&cblock_pool, NUM_CBLOCK_RESERVE, cblock_cache);
+}
@@ -14,8 +14,9 @@
 #include "kconfig.h"
 #include "lib/ctype.h"
 #include "lib/string.h"
-#include "mem/alloc.h"
 #include "mem/page.h"
+#include "mem/vmalloc.h"
+#include "proc/sleep.h"
 
 static vconsole_t consoles[NUM_CONSOLES + 1];
 
@@ -281,6 +282,9 @@ vconsole_write (tty_t* tty) {
       }
     }
   }
+
+  // Writers blocked on a full queue can carry on
+  wakeup(&tty->write_wait);
 }
 
 void
@@ -307,7 +311,7 @@ console_init (void) {
       this_console.tty        = tty;
 
       if (video_using_vga()) {
-        this_console.back_buffer = (short int*)kmalloc(PAGE_SIZE);
+        this_console.back_buffer = (short int*)vmalloc(CONSOLE_SIZE * sizeof(short int));
       }
       if (video_using_vesa_framebuffer()) {
         this_console.back_buffer = vc_screen[num];
@@ -569,8 +569,7 @@ keyboard_bh_irq (sig_context_t* sc) {
 
   if (do_sysrq) {
     do_sysrq = 0;
-    // TODO:
-    // sysrq(sysrq_op);
+    sysrq(sysrq_op);
   }
 
   tty = &tty_table[0];
@@ -581,7 +580,7 @@ keyboard_bh_irq (sig_context_t* sc) {
     }
 
     if (tty->kbd_state.mode == KBD_MODE_RAW || tty->kbd_state.mode == KBD_MODE_MEDRAW) {
-      wakeup(func_as_ptr((void (*)(void))tty_read));
+      wakeup(&tty->read_wait);
       continue;
     }
 
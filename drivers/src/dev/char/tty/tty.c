@@ -18,13 +18,6 @@
 
 tty_t tty_table[NUM_TTYS];
 
-static void
-wait_vtime_wrapper (unsigned int arg) {
-  unsigned int* fn = (unsigned int*)arg;
-
-  wakeup(fn);
-}
-
 /**
  * Performs output processing on the write queue
  */
@@ -282,7 +275,7 @@ tty_cook_input (tty_t* tty) {
     // TODO: Wakeup any process sleeping on select syscall
     // wakeup(&do_select);
   }
-  wakeup(SLEEP_FN(&tty_read));
+  wakeup(&tty->read_wait);
 }
 
 int
@@ -358,8 +351,6 @@ tty_read (inode_t* i, fd_t* fd_table, char* buffer, size_t count) {
         }
       }
     } else {
-      timer_task_request_t ttr;
-
       // "Pure Timeout Mode"
       // If we're not in canonical mode, we return chars as soon as possible.
       // But we might have timeouts or min char limits to deal with...
@@ -372,18 +363,20 @@ tty_read (inode_t* i, fd_t* fd_table, char* buffer, size_t count) {
 
           // Wait for input or timeout
           while (kstat.ticks - initial_ticks < timeout && !tty->cooked_q.size) {
-            // Setup a timer task to resume the process later
-            // TODO: Needed before NONBLOCK check?
-            ttr.fn  = wait_vtime_wrapper;
-            ttr.arg = (unsigned int)&tty->cooked_q;
-            timer_task_add(&ttr, timeout);
-
             // If the file descriptor is non-blocking, we can't wait
             if (fd_table->flags & O_NONBLOCK) {
               return -EAGAIN;
             }
 
-            if (sleep(SLEEP_FN(&tty_read), PROC_INTERRUPTIBLE)) {
+            int ret = sleep_on_timeout(
+              &tty->read_wait,
+              PROC_INTERRUPTIBLE,
+              timeout - (kstat.ticks - initial_ticks)
+            );
+            if (ret == -ETIMEDOUT) {
+              break;
+            }
+            if (ret) {
               return -EINTR;
             }
           }
@@ -408,19 +401,15 @@ tty_read (inode_t* i, fd_t* fd_table, char* buffer, size_t count) {
               buffer[n++] = ch;
             }
 
-            // If we've read at least VMIN characters (enough to satisfy the blocking read),
-            // cancel any pending timeouts and return - we're done.
+            // If we've read at least VMIN characters (enough to satisfy the blocking read), we're
+            // done.
             if ((size_t)n >= min(tty->termios.c_cc[VMIN], count)) {
-              timer_task_remove(&ttr);
               break;
             }
 
             // At this point, we've not read enough to fulfill VMIN.
-            // We set a timer and sleep until we've more chars to read (or the timeout expires).
+            // We sleep until we've more chars to read (or the timeout expires).
             unsigned int timeout = tty->termios.c_cc[VTIME] * (HZ / 10);
-            ttr.fn               = wait_vtime_wrapper;
-            ttr.arg              = (unsigned int)&tty->cooked_q;
-            timer_task_add(&ttr, timeout);
 
             // Again, handle non-blocking mode
             if (fd_table->flags & O_NONBLOCK) {
@@ -428,13 +417,14 @@ tty_read (inode_t* i, fd_t* fd_table, char* buffer, size_t count) {
               n = -EAGAIN;
               break;
             }
-            if (sleep(SLEEP_FN(&tty_read), PROC_INTERRUPTIBLE)) {
+            int ret = sleep_on_timeout(&tty->read_wait, PROC_INTERRUPTIBLE, timeout);
+            if (ret > 0) {
               n = -EINTR;
               break;
             }
 
             // Check again after sleeping
-            if (!tty->cooked_q.size) {
+            if (ret == -ETIMEDOUT || !tty->cooked_q.size) {
               break;
             }
             continue;
@@ -467,7 +457,7 @@ tty_read (inode_t* i, fd_t* fd_table, char* buffer, size_t count) {
       n = -EAGAIN;
       break;
     }
-    if (sleep(SLEEP_FN(&tty_read), PROC_INTERRUPTIBLE)) {
+    if (sleep_on(&tty->read_wait, PROC_INTERRUPTIBLE)) {
       n = -EINTR;
       break;
     }
@@ -532,7 +522,7 @@ tty_write (inode_t* i, fd_t* fd_table, const char* buffer, size_t count) {
     // If there's more data in the write queue after calling `output`, we got interrupted by another
     // write syscall
     if (tty->write_q.size > 0) {
-      if (sleep(SLEEP_FN(&tty_write), PROC_INTERRUPTIBLE)) {
+      if (sleep_on(&tty->write_wait, PROC_INTERRUPTIBLE)) {
         n = -EINTR;
         break;
       }
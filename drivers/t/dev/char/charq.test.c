@@ -83,6 +83,8 @@ remaining_test (void) {
 
 void
 run_charq_tests (void) {
+  charq_init();
+
   insert_and_get_char_test();
   charq_capacity_test();
   unput_char_test();
@@ -29,15 +29,34 @@ eflags_set (uint32_t eflags) {
   mock_eflags        = FAKE_EFLAGS_VAL;
 }
 
+void
+preempt_check_resched (void) {}
+
 int
-sleep (void *addr, proc_inttype state) {
+sleep_on (wait_queue_head_t *wq, proc_inttype state) {
   slept    = true;
-  slept_on = addr;
+  slept_on = wq;
+  return 0;
+}
+
+int
+sleep_on_exclusive (wait_queue_head_t *wq, proc_inttype state) {
+  return sleep_on(wq, state);
+}
+
+int
+sleep_on_timeout (wait_queue_head_t *wq, proc_inttype state, unsigned int ticks) {
+  return sleep_on(wq, state);
+}
+
+void
+wakeup (wait_queue_head_t *wq) {
+  woken_up = wq;
 }
 
 void
-wakeup (void *addr) {
-  woken_up = addr;
+wakeup_all (wait_queue_head_t *wq) {
+  woken_up = wq;
 }
 
 // Reset all mocks between tests
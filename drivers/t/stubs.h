@@ -5,8 +5,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "mem/mempool.h"
+#include "mem/slab.h"
+
 unsigned int
-kmalloc (size_t size) {
+kmalloc (size_t size, gfp_t gfp) {
   return (unsigned int)malloc(size);
 }
 
@@ -15,4 +18,38 @@ kfree (unsigned int ptr) {
   free((void*)ptr);
 }
 
+kmem_cache_t*
+kmem_cache_create (const char* name, size_t size, size_t align, void (*ctor)(void*)) {
+  kmem_cache_t* cache = calloc(1, sizeof(kmem_cache_t));
+  cache->object_size  = size;
+  return cache;
+}
+
+void*
+kmem_cache_alloc (kmem_cache_t* cache, gfp_t gfp) {
+  return malloc(cache->object_size);
+}
+
+void
+kmem_cache_free (kmem_cache_t* cache, void* obj) {
+  free(obj);
+}
+
+retval_t
+mempool_init (mempool_t* pool, unsigned int min_nr, kmem_cache_t* cache) {
+  pool->cache  = cache;
+  pool->min_nr = min_nr;
+  return RET_OK;
+}
+
+void*
+mempool_alloc (mempool_t* pool, gfp_t gfp) {
+  return kmem_cache_alloc(pool->cache, gfp);
+}
+
+void
+mempool_free (mempool_t* pool, void* obj) {
+  kmem_cache_free(pool->cache, obj);
+}
+
 #endif /* STUBS_H */
@@ -1,10 +1,25 @@
 #ifndef ARCH_CPU_H
 #define ARCH_CPU_H
 
+#include "arch/eflags.h"
 #include "arch/x86.h"
 #include "lib/compiler.h"
 #include "lib/types.h"
 
+/**
+ * CPUID leaf 1 EDX: Page Size Extensions (4 MB pages)
+ */
+#define CPUID_FEAT_EDX_PSE (1 << 3)
+/**
+ * CPUID leaf 1 EDX: Page Global Enable
+ */
+#define CPUID_FEAT_EDX_PGE (1 << 13)
+
+/**
+ * CPUID leaf 4: deterministic cache parameters, one subleaf per cache
+ */
+#define CPUID_LEAF_CACHE   4
+
 static inline noreturn void
 cpu_idle (void) {
   while (true) {
@@ -12,4 +27,85 @@ cpu_idle (void) {
   }
 }
 
+/**
+ * Determines whether the CPU supports the CPUID instruction.
+ */
+static inline bool
+cpu_has_cpuid (void) {
+  uint32_t eflags = eflags_get();
+  eflags_set(eflags ^ EFLAGS_ID);
+  bool toggled = (eflags_get() ^ eflags) & EFLAGS_ID;
+  eflags_set(eflags);
+
+  return toggled;
+}
+
+/**
+ * Determines whether the CPU supports 4 MB pages.
+ */
+static inline bool
+cpu_has_pse (void) {
+  if (!cpu_has_cpuid()) {
+    return false;
+  }
+
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, &eax, &ebx, &ecx, &edx);
+
+  return edx & CPUID_FEAT_EDX_PSE;
+}
+
+/**
+ * Determines whether the CPU supports global pages.
+ */
+static inline bool
+cpu_has_pge (void) {
+  if (!cpu_has_cpuid()) {
+    return false;
+  }
+
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, &eax, &ebx, &ecx, &edx);
+
+  return edx & CPUID_FEAT_EDX_PGE;
+}
+
+/**
+ * Determines the size of one way of the L2 cache. Physical addresses that are congruent modulo the
+ * way size compete for the same cache sets.
+ *
+ * @return unsigned int The way size in bytes, or 0 if the CPU doesn't report its cache geometry.
+ */
+static inline unsigned int
+cpu_l2_way_size (void) {
+  if (!cpu_has_cpuid()) {
+    return 0;
+  }
+
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(0, &eax, &ebx, &ecx, &edx);
+  if (eax < CPUID_LEAF_CACHE) {
+    return 0;
+  }
+
+  for (uint32_t n = 0;; n++) {
+    cpuid_count(CPUID_LEAF_CACHE, n, &eax, &ebx, &ecx, &edx);
+
+    // No more caches
+    unsigned int type = eax & 0x1F;
+    if (!type) {
+      return 0;
+    }
+
+    // Level 2, data or unified
+    if (((eax >> 5) & 0x7) == 2 && type != 2) {
+      unsigned int line_size  = (ebx & 0xFFF) + 1;
+      unsigned int partitions = ((ebx >> 12) & 0x3FF) + 1;
+      unsigned int sets       = ecx + 1;
+
+      return line_size * partitions * sets;
+    }
+  }
+}
+
 #endif /* ARCH_CPU_H */
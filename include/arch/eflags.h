@@ -8,6 +8,11 @@
  */
 #define EFLAGS_INT_ENABLED (1 << 9)
 
+/**
+ * CPUID available flag. The CPU supports CPUID if this flag can be toggled.
+ */
+#define EFLAGS_ID          (1 << 21)
+
 /**
  * The only flags that are modifiable by user processes.
  */
@@ -3,12 +3,23 @@
 
 #include "arch/eflags.h"
 #include "lib/types.h"
+#include "proc/preempt.h"
 
 #define INTERRUPTS_OFF()             \
   unsigned int flags = eflags_get(); \
   int_disable()
 
-#define INTERRUPTS_ON() eflags_set(flags);
+/**
+ * Restores the interrupt flag saved by INTERRUPTS_OFF. Re-enabling interrupts ends a section the
+ * current process couldn't be preempted in, so a reschedule that became due during it happens here.
+ */
+#define INTERRUPTS_ON()               \
+  do {                                \
+    eflags_set(flags);                \
+    if (flags & EFLAGS_INT_ENABLED) { \
+      preempt_check_resched();        \
+    }                                 \
+  } while (0)
 
 /**
  * Disables interrupts.
@@ -20,6 +31,12 @@ void int_disable(void);
  */
 void int_enable(void);
 
+/**
+ * Enables interrupts and halts until the next one arrives. Called with interrupts disabled, this
+ * closes the window in which an interrupt could be handled between checking for work and halting.
+ */
+void int_enable_halt(void);
+
 /**
  * Are interrupts enabled?
  */
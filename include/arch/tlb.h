@@ -0,0 +1,95 @@
+#ifndef ARCH_TLB_H
+#define ARCH_TLB_H
+
+#include "arch/x86.h"
+#include "lib/types.h"
+#include "mem/page.h"
+
+/**
+ * Ranges spanning more pages than this are flushed wholesale rather than one INVLPG at a time
+ */
+#define TLB_FLUSH_MAX_PAGES 32
+
+/**
+ * Number of pages a gather holds on to before flushing and releasing them
+ */
+#define TLB_GATHER_PAGES    32
+
+/**
+ * PAGE_GLOBAL if the CPU supports global pages, 0 otherwise. Or'd into kernel mappings so they
+ * survive address space switches.
+ */
+extern unsigned int tlb_global;
+
+/**
+ * Collects the pages being unmapped from a range so the TLB can be flushed once for all of them. The
+ * frames are only released after the flush, so no stale translation can reach a reused frame.
+ */
+typedef struct {
+  /**
+   * The range of addresses unmapped so far, [start, end)
+   */
+  unsigned int start;
+  unsigned int end;
+  /**
+   * Frames waiting for the flush before they can be released
+   */
+  page_t      *pages[TLB_GATHER_PAGES];
+  unsigned int nr_pages;
+} tlb_gather_t;
+
+/**
+ * Invalidates the TLB entry for the page containing `addr`, global or not.
+ *
+ * @param addr
+ */
+void tlb_flush_page(unsigned int addr);
+
+/**
+ * Flushes all non-global TLB entries, i.e. the current user mappings.
+ */
+void tlb_flush_all(void);
+
+/**
+ * Flushes the whole TLB, global entries included.
+ */
+void tlb_flush_global(void);
+
+/**
+ * Invalidates the TLB entries for the pages in [start, end).
+ *
+ * @param start
+ * @param end
+ */
+void tlb_flush_range(unsigned int start, unsigned int end);
+
+/**
+ * Starts a new gather.
+ *
+ * @param tlb
+ */
+void tlb_gather_init(tlb_gather_t *tlb);
+
+/**
+ * Records that the page at `addr` has been unmapped.
+ *
+ * @param tlb
+ * @param addr The virtual address whose page table entry was cleared.
+ * @param page The frame that was mapped there, released once the TLB is flushed. May be NULL.
+ */
+void tlb_gather_page(tlb_gather_t *tlb, unsigned int addr, page_t *page);
+
+/**
+ * Flushes the gathered range and releases the gathered frames.
+ *
+ * @param tlb
+ */
+void tlb_gather_finish(tlb_gather_t *tlb);
+
+/**
+ * Enables global pages if the CPU supports them. Must be called before the kernel mappings are
+ * created.
+ */
+void tlb_init(void);
+
+#endif /* ARCH_TLB_H */
@@ -0,0 +1,41 @@
+#ifndef ARCH_TSS_H
+#define ARCH_TSS_H
+
+#include "arch/x86.h"
+#include "lib/types.h"
+
+/**
+ * An I/O bitmap offset past the end of the TSS, which denies user mode access to every port
+ */
+#define TSS_NO_IO_BITMAP sizeof(i386tss_t)
+
+/**
+ * The one TSS. Context switches are done in software, so all the CPU takes from it is the kernel
+ * stack to switch to on interrupts from user mode, and the I/O permissions of the current process.
+ */
+extern i386tss_t tss;
+
+/**
+ * Sets up the TSS and loads it into the task register. Called once the GDT is in place.
+ */
+void tss_init(void);
+
+/**
+ * Sets the kernel stack that interrupts from user mode switch to.
+ *
+ * @param esp0 The top of the stack.
+ */
+static inline void
+tss_set_stack (unsigned int esp0) {
+  tss.esp0 = esp0;
+}
+
+/**
+ * Installs the I/O bitmap of the process being switched to.
+ *
+ * @param bitmap The bitmap, or NULL to deny access to every port.
+ * @param size The number of bytes of the bitmap to copy. Ports past them are denied.
+ */
+void tss_set_io_bitmap(const unsigned char *bitmap, unsigned int size);
+
+#endif /* ARCH_TSS_H */
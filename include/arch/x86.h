@@ -5,6 +5,19 @@
 
 #define IO_BITMAP_SIZE 8192
 
+/**
+ * CR4 bit 4: enable 4 MB pages (Page Size Extensions)
+ */
+#define CR4_PSE        0x00000010
+/**
+ * CR4 bit 5: enable 64-bit page table entries (Physical Address Extension)
+ */
+#define CR4_PAE        0x00000020
+/**
+ * CR4 bit 7: enable global pages (Page Global Enable)
+ */
+#define CR4_PGE        0x00000080
+
 /* Intel 386 Task Switch State */
 typedef struct {
   unsigned int       prev_tss;
@@ -164,6 +177,114 @@ stosb (void *addr, int32_t data, int32_t c) {
                : "memory", "cc");
 }
 
+/**
+ * Executes the CPUID instruction for the given leaf.
+ *
+ * @param leaf The value of EAX on input
+ * @param eax
+ * @param ebx
+ * @param ecx
+ * @param edx
+ */
+static inline void
+cpuid (uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+  asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+/**
+ * Executes the CPUID instruction for the given leaf and subleaf.
+ *
+ * @param leaf The value of EAX on input
+ * @param subleaf The value of ECX on input
+ * @param eax
+ * @param ebx
+ * @param ecx
+ * @param edx
+ */
+static inline void
+cpuid_count (
+  uint32_t  leaf,
+  uint32_t  subleaf,
+  uint32_t *eax,
+  uint32_t *ebx,
+  uint32_t *ecx,
+  uint32_t *edx
+) {
+  asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(subleaf));
+}
+
+/**
+ * Reads the time stamp counter, which counts CPU cycles since reset.
+ */
+static inline uint64_t
+rdtsc (void) {
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint32_t
+cr4_get (void) {
+  uint32_t cr4;
+  asm volatile("mov %%cr4, %0" : "=r"(cr4));
+  return cr4;
+}
+
+static inline void
+cr4_set (uint32_t cr4) {
+  asm volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+/**
+ * Retrieves the linear address that caused the last page fault.
+ */
+static inline uint32_t
+cr2_get (void) {
+  uint32_t cr2;
+  asm volatile("mov %%cr2, %0" : "=r"(cr2));
+  return cr2;
+}
+
+/**
+ * Retrieves the physical address of the active page directory.
+ */
+static inline uint32_t
+cr3_get (void) {
+  uint32_t cr3;
+  asm volatile("mov %%cr3, %0" : "=r"(cr3));
+  return cr3;
+}
+
+/**
+ * Loads a new page directory, which also flushes all non-global TLB entries.
+ *
+ * @param cr3 The physical address of the page directory.
+ */
+static inline void
+cr3_set (uint32_t cr3) {
+  asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+}
+
+/**
+ * Loads the task register.
+ *
+ * @param selector The GDT selector of the TSS.
+ */
+static inline void
+ltr (uint16_t selector) {
+  asm volatile("ltr %0" : : "r"(selector));
+}
+
+/**
+ * Invalidates the TLB entry for the page containing `addr`.
+ *
+ * @param addr
+ */
+static inline void
+invlpg (uint32_t addr) {
+  asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
 static inline void
 halt (void) {
   asm volatile("hlt");
@@ -5,4 +5,14 @@
 
 void dump_stack_trace(void);
 
+/**
+ * Looks up the kernel function containing the given address in the ELF symbol table handed over by
+ * the bootloader.
+ *
+ * @param addr
+ * @param offset Set to the offset of `addr` into the function, unless NULL.
+ * @return const char* The name of the function, or NULL if there is none.
+ */
+const char *elf_lookup_symbol(unsigned int addr, unsigned int *offset);
+
 #endif /* DEBUG_STACKTRACE_H */
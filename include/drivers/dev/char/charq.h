@@ -88,4 +88,10 @@ void charq_flush(charq_t *q);
  */
 int charq_remaining(charq_t *q);
 
+/**
+ * Initializes the object cache from which `cblock_t`s are allocated. Must be called after the
+ * memory manager has been initialized.
+ */
+void charq_init(void);
+
 #endif /* DRIVERS_DEV_CHAR_CHARQ_H */
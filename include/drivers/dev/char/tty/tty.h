@@ -6,6 +6,7 @@
 #include "fs/fd.h"
 #include "fs/inode.h"
 #include "lib/types.h"
+#include "proc/wait.h"
 
 #define NUM_TTYS     16     /* Number of TTYs supported by the kernel */
 
@@ -161,6 +162,12 @@ struct tty {
    */
   charq_t write_q;
 
+  /**
+   * Processes waiting for input to read, and for room in the write queue, respectively
+   */
+  wait_queue_head_t read_wait;
+  wait_queue_head_t write_wait;
+
   /**
    * I/O processing configurations and flags for this TTY
    */
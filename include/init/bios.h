@@ -29,10 +29,31 @@ typedef struct {
   int          type;
 } bios_mmap_t;
 
+/**
+ * Receives a range of page frames [from, to)
+ */
+typedef void (*bios_mmap_range_fn)(unsigned int from, unsigned int to, void *ctx);
+
 extern bios_mmap_t bios_mmap[NUM_BIOS_MMAP_ENTRIES];
 extern bios_mmap_t kernel_mmap[NUM_BIOS_MMAP_ENTRIES];
 
 void bios_mmap_init(multiboot_mmap_entry_t* mmap, unsigned int mmap_len);
 bool bios_mmap_has_addr(unsigned int addr);
 
+/**
+ * Invokes `fn` for every range of available page frames within [first, end). Page frame numbers are
+ * used rather than addresses since, with PAE, memory may lie above 4 GB.
+ *
+ * @param first
+ * @param end
+ * @param fn
+ * @param ctx Passed to `fn` as-is.
+ */
+void bios_mmap_foreach_available(
+  unsigned int       first,
+  unsigned int       end,
+  bios_mmap_range_fn fn,
+  void              *ctx
+);
+
 #endif /* INIT_BIOS_H */
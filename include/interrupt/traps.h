@@ -3,7 +3,12 @@
 
 #include "interrupt/signal.h"
 
-#define NUM_EXCEPTIONS 32
+#define NUM_EXCEPTIONS  32
+
+/**
+ * The page fault exception number
+ */
+#define TRAP_PAGE_FAULT 14
 
 typedef struct {
   char* name;
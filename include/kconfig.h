@@ -12,20 +12,92 @@
 #define PAGE_HASH_PER_10K  10
 
 /**
- * Maximum number of pages in hash table
+ * Maximum number of pages in the initial hash table. The table grows on demand from there.
  */
 #define MAX_PAGES_HASH     16
 
+/**
+ * The average page cache hash chain length at which the hash table is doubled
+ */
+#define PAGE_CACHE_LOAD    2
+
+/**
+ * Kernel address space withheld from the direct map for vmalloc, in bytes (128 MB)
+ */
+#define VMALLOC_RESERVE    0x08000000
+
+/**
+ * The number of page frames initialized during boot (64 MB). The rest are initialized in the
+ * background once the scheduler is running.
+ */
+#define PAGE_INIT_EAGER    16384
+
+/**
+ * Highmem page descriptors may take up at most 1/HIGHMEM_MAP_RATIO of the direct map
+ */
+#define HIGHMEM_MAP_RATIO  4
+
+/**
+ * Maximum number of page colors the free lists are split into. Set to 1 to disable page coloring.
+ */
+#define PAGE_MAX_COLORS    64
+
+/**
+ * Maximum number of pages held in compressed swap
+ */
+#define NUM_SWAP_SLOTS     8192
+
+/**
+ * Default number of pages the same-page merging scanner looks at per pass, and the number of ticks
+ * it sleeps between passes
+ */
+#define KSM_PAGES_TO_SCAN  100
+#define KSM_SLEEP_TICKS    20
+
+/**
+ * Maximum number of free pages kept pre-zeroed by the idle process
+ */
+#define NUM_ZEROED_PAGES   64
+
+/**
+ * The number of pages the idle process zeroes before checking for other work
+ */
+#define ZERO_PAGES_BATCH   4
+
+/**
+ * The number of call sites the allocation profiler can tell apart, and the number of them listed in
+ * a report. Allocations from any further call sites are lumped together.
+ */
+#define ALLOCPROF_SITES    256
+#define ALLOCPROF_REPORT   16
+
 /**
  * Maximum number of concurrent processes.
  */
 #define NUM_PROCS          64
 
+/**
+ * The time slice of SCHED_RR processes, in ticks
+ */
+#define SCHED_RR_QUANTUM   10
+
+/**
+ * Real-time processes may use up at most SCHED_RT_RUNTIME ticks out of every SCHED_RT_PERIOD ticks
+ * while other processes are waiting to run, so a runaway one can't lock up the system
+ */
+#define SCHED_RT_PERIOD    100
+#define SCHED_RT_RUNTIME   95
+
 /**
  * Maximum number of active timer tasks.
  */
 #define NUM_TIMER_TASKS    NUM_PROCS
 
+/**
+ * The number of character buffer blocks held in reserve for the tty interrupt handlers
+ */
+#define NUM_CBLOCK_RESERVE 16
+
 /**
  * The number of buffers reclaimed at once
  */
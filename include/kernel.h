@@ -23,4 +23,11 @@ extern elf32_shdr *strtab;
  */
 void noreturn kernel_stop(void);
 
+/**
+ * The body of the idle process. Pre-zeroes free pages while there are any left to zero, otherwise
+ * halts the CPU until the next interrupt, yielding to any process that has become runnable in the
+ * meantime.
+ */
+void noreturn kernel_idle(void);
+
 #endif /* KERNEL_H */
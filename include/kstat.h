@@ -1,6 +1,8 @@
 #ifndef KSTAT_H
 #define KSTAT_H
 
+#include "mem/buddy.h"
+
 /**
  * Represents configurable kernel parameters.
  */
@@ -15,6 +17,12 @@ typedef struct {
    * memory above 1 MB. Size of usable RAM above 1 MB
    */
   int extmemsize;
+  /**
+   * The number of pages the same-page merging scanner looks at per pass (0 stops it), and the number
+   * of ticks it sleeps between passes
+   */
+  int ksm_pages_to_scan;
+  int ksm_sleep_ticks;
 } kparam_t;
 
 /**
@@ -25,19 +33,100 @@ typedef struct {
   unsigned int physical_pages;
   int          physical_reserved;
   int          kernel_reserved;
+  /**
+   * The number of bytes of boot-only code and data released after boot
+   */
+  unsigned int init_reclaimed;
   /**
    * The number of free pages in the free page list
    */
   int          num_free_pages;
+  /**
+   * The number of pages above the direct map, and how many of them are free. Free highmem pages
+   * aren't included in `num_free_pages`, since the kernel can't use them for its own structures.
+   */
+  int          highmem_pages;
+  int          num_free_highmem;
+  /**
+   * Free page watermarks. kswapd is woken once free pages drop to `low_free_pages` and reclaims
+   * until they're back up to `high_free_pages`. `min_free_pages` is the floor the other two are
+   * derived from.
+   */
   int          min_free_pages;
+  int          low_free_pages;
+  int          high_free_pages;
   int          total_mem_pages;
-  // Pages last reclaimed from the buffer
+  /**
+   * The number of page frames that have yet to be initialized, and the TSC cycles spent
+   * initializing page frames during boot and in the background
+   */
+  int          page_init_pending;
+  uint64_t     page_init_cycles;
+  uint64_t     page_init_deferred_cycles;
+  // Pages reclaimed by the last kswapd pass
   int          pages_reclaimed;
 
   /**
    * The amount of memory used for caching file pages
    */
   int page_cache_consumption;
+  /**
+   * The number of pages in the page cache and how often lookups found, or didn't find, the page they
+   * were looking for
+   */
+  int page_cache_pages;
+  int page_cache_hits;
+  int page_cache_misses;
+
+  /**
+   * The number of free pages in the pre-zeroed pool, and how often `page_get_zeroed` could be served
+   * from it
+   */
+  int zeroed_pages;
+  int zeroed_hits;
+  int zeroed_misses;
+
+  /**
+   * The number of single-page allocations that had to settle for a page of another color than the
+   * one asked for
+   */
+  int page_color_misses;
+
+  /**
+   * The number of pages owned by slab caches
+   */
+  int slab_pages;
+  /**
+   * The number of pages mapped into the vmalloc area
+   */
+  int vmalloc_pages;
+
+  /**
+   * Compressed swap: the number of pages swapped out, and the bytes they take up once compressed
+   * (their ratio to `swap_pages * PAGE_SIZE` being the compression ratio). The pages held by the pool
+   * that stores them are counted by `zpool_pages`.
+   */
+  int swap_pages;
+  int swap_compressed_bytes;
+  /**
+   * The number of faults that swapped a page back in, and the number of pages that were left
+   * resident because they didn't compress well enough
+   */
+  int swap_faults;
+  int swap_rejects;
+
+  /**
+   * Same-page merging: the number of frames shared between identical pages, the number of frames
+   * saved by sharing them, and the number of complete sweeps of the user address space
+   */
+  int ksm_pages_shared;
+  int ksm_pages_saved;
+  int ksm_full_scans;
+
+  /**
+   * The number of free blocks on each of the buddy allocator's free lists, indexed by level
+   */
+  int buddy_free_blocks[BUDDY_MAX_LEVEL];
 
   unsigned int ticks;       /* ticks (1/HZths of sec) since boot */
   unsigned int system_time; /* current system time (since the Epoch) */
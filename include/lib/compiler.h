@@ -26,7 +26,7 @@
  * Note, see gcc expr: https://gcc.gnu.org/onlinedocs/gcc/Statement-Exprs.html
  */
 #define containerof(ptr, type, member)                 \
-  ({                                                   \
+  __extension__({                                      \
     const typeof(((type *)0)->member) *__mptr = (ptr); \
     (type *)((char *)__mptr - offsetof(type, member)); \
   })
@@ -45,6 +45,13 @@
 
 #define noreturn       __attribute__((noreturn))
 
+/**
+ * Places code and data that are only needed while booting in the init sections. Their pages are
+ * handed back to the page allocator once `kmain` is done, so nothing may reference them afterwards.
+ */
+#define __init         __attribute__((__section__(".init.text")))
+#define __initdata     __attribute__((__section__(".init.data")))
+
 
 /**
  * Flag the function as overridable such that we can implement our own version later in the linking process.
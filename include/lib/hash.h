@@ -0,0 +1,25 @@
+#ifndef KLIB_HASH_H
+#define KLIB_HASH_H
+
+#include "lib/types.h"
+
+/**
+ * 2^32 divided by the golden ratio. Multiplying by it scatters consecutive keys across the whole
+ * 32-bit range, so the top bits of the product make a good bucket index.
+ *
+ * See: Knuth, The Art of Computer Programming Vol. 3, 6.4
+ */
+#define GOLDEN_RATIO_32 0x61C88647
+
+/**
+ * Hashes a 32-bit value down to `bits` bits using multiplicative (Fibonacci) hashing.
+ *
+ * @param val
+ * @param bits The number of bits in the result, between 1 and 32.
+ */
+static inline uint32_t
+hash_32 (uint32_t val, unsigned int bits) {
+  return (val * GOLDEN_RATIO_32) >> (32 - bits);
+}
+
+#endif /* KLIB_HASH_H */
@@ -2,6 +2,7 @@
 #define KLIB_LIST_H
 
 #include "lib/compiler.h"
+#include "lib/types.h"
 
 /**
  * Implements a circular doubly-linked list. Based on the list implementation used throughout the
@@ -105,6 +106,16 @@ list_append (list_head_t *entry, list_head_t *prev) {
   list_insert(entry, prev, prev->next);
 }
 
+/**
+ * Determines whether the list `head` has no nodes other than itself.
+ *
+ * @param head
+ */
+static inline bool
+list_is_empty (const list_head_t *head) {
+  return head->next == head;
+}
+
 /**
  * Removes a list node `entry`.
  *
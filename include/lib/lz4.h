@@ -0,0 +1,46 @@
+#ifndef KLIB_LZ4_H
+#define KLIB_LZ4_H
+
+#include "lib/types.h"
+
+/**
+ * log2 of the number of entries in the compressor's match finder hash table
+ */
+#define LZ4_HASH_BITS     12
+
+/**
+ * Size of the scratch memory `lz4_compress` needs. Kept out of the compressor's stack frame, since
+ * kernel stacks are a single page.
+ */
+#define LZ4_WORKMEM_SIZE  ((1 << LZ4_HASH_BITS) * sizeof(uint16_t))
+
+/**
+ * Largest input `lz4_compress` accepts. Positions in the hash table are 16 bits wide.
+ */
+#define LZ4_MAX_INPUT     0xFFFF
+
+/**
+ * Compresses a buffer into an LZ4 block (no frame header).
+ *
+ * @param src
+ * @param src_len At most LZ4_MAX_INPUT bytes.
+ * @param dst
+ * @param dst_cap The size of dst.
+ * @param wrkmem Scratch memory of at least LZ4_WORKMEM_SIZE bytes.
+ * @return size_t The size of the compressed block, or 0 if it doesn't fit in dst_cap bytes.
+ */
+size_t lz4_compress(const void* src, size_t src_len, void* dst, size_t dst_cap, void* wrkmem);
+
+/**
+ * Decompresses an LZ4 block.
+ *
+ * @param src
+ * @param src_len The exact size of the compressed block.
+ * @param dst
+ * @param dst_cap The size of dst.
+ * @return int The size of the decompressed data, or -1 if the block is malformed or its contents
+ * don't fit in dst_cap bytes.
+ */
+int lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_cap);
+
+#endif /* KLIB_LZ4_H */
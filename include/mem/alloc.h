@@ -2,8 +2,9 @@
 #define ALLOC_H
 
 #include "lib/types.h"
+#include "mem/gfp.h"
 
-unsigned int kmalloc(size_t size);
+unsigned int kmalloc(size_t size, gfp_t gfp);
 void         kfree(unsigned int);
 
 #endif /* ALLOC_H */
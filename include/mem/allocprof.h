@@ -0,0 +1,102 @@
+#ifndef MEM_ALLOCPROF_H
+#define MEM_ALLOCPROF_H
+
+#include "lib/types.h"
+#include "mem/gfp.h"
+#include "mem/page.h"
+
+/**
+ * The call site of the current function, i.e. the address its caller resumes at. Allocators take this
+ * as the site their memory is attributed to.
+ */
+#define ALLOCPROF_CALLER() ((unsigned int)__builtin_return_address(0))
+
+/**
+ * The memory attributed to a single call site. Sizes are the bytes actually taken from the
+ * allocators, so they include the rounding up to the next block size.
+ */
+typedef struct {
+  /**
+   * The return address of the call to the allocator, or 0 for the entry that collects the sites
+   * that didn't fit into the table
+   */
+  unsigned int site;
+  unsigned int allocs;
+  unsigned int frees;
+  unsigned int live_bytes;
+  unsigned int peak_bytes;
+  /**
+   * The number of allocations as of the last report, from which the allocation rate is derived
+   */
+  unsigned int reported_allocs;
+} allocprof_site_t;
+
+#ifdef CONFIG_ALLOC_PROFILE
+
+/**
+ * Attributes a page (or block of pages) handed out by the page allocator to the given call site.
+ *
+ * @param page The page, or NULL if the allocation failed.
+ * @param gfp The allocation's flags. Nothing is recorded for GFP_NOPROFILE allocations.
+ * @param site
+ */
+void allocprof_page_alloc(page_t *page, gfp_t gfp, unsigned int site);
+
+/**
+ * Releases the page's attribution once its last reference is gone.
+ */
+void allocprof_page_free(page_t *page);
+
+/**
+ * Attributes a block handed out by the buddy allocator to the given call site.
+ *
+ * @param addr The block's address as returned by `buddy_malloc`, or 0 if the allocation failed.
+ * @param site
+ */
+void allocprof_buddy_alloc(unsigned int addr, unsigned int site);
+
+/**
+ * Releases the attribution of a block that is about to be returned to the buddy allocator.
+ */
+void allocprof_buddy_free(unsigned int addr);
+
+/**
+ * Retrieves the entry that memory carrying the given tag is attributed to.
+ *
+ * @param tag A tag stored with a page or block.
+ * @return const allocprof_site_t* The entry, or NULL if the tag doesn't refer to one.
+ */
+const allocprof_site_t *allocprof_site(unsigned short tag);
+
+/**
+ * Prints the call sites holding the most memory, symbolized through the kernel's symbol table,
+ * along with their allocation rate since the previous report.
+ *
+ * The pages backing the buddy allocator and the slab caches are attributed to those allocators, so
+ * comparing them with what's attributed to the allocators' own callers shows how much memory is lost
+ * to fragmentation.
+ *
+ * Printed when allocations run out of memory, and on demand with Alt+SysRq+M.
+ */
+void allocprof_report(void);
+
+#else
+
+static inline void
+allocprof_page_alloc (page_t *page, gfp_t gfp, unsigned int site) {}
+
+static inline void
+allocprof_page_free (page_t *page) {}
+
+static inline void
+allocprof_buddy_alloc (unsigned int addr, unsigned int site) {}
+
+static inline void
+allocprof_buddy_free (unsigned int addr) {}
+
+static inline void
+allocprof_report (void) {}
+
+#endif /* CONFIG_ALLOC_PROFILE */
+
+#endif /* MEM_ALLOCPROF_H */
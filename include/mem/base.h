@@ -13,11 +13,18 @@
 #  define KERNEL_BSS_SIZE ((int)image_end - (int)data_end)
 
 // https://wiki.osdev.org/Using_Linker_Script_Values#:~:text=A%20common%20problem%20is%20getting,a%20symbol%2C%20not%20a%20variable.
+extern volatile char setup_end[];
 extern volatile char text_end[];
+extern volatile char init_start[];
+extern volatile char init_end[];
 extern volatile char data_end[];
 extern volatile char image_end[];
 
+#  ifdef CONFIG_PAE
+typedef uint64_t phys_addr_t;
+#  else
 typedef uint32_t phys_addr_t;
+#  endif
 
 #endif /* ASM_SOURCE */
 
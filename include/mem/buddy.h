@@ -2,6 +2,7 @@
 #define MEM_BUDDY_H
 
 #include "lib/types.h"
+#include "mem/gfp.h"
 
 #define BUDDY_MAX_LEVEL         7  // 128b
 #define BUDDY_SMALLEST_EXPONENT 5  // 32b
@@ -14,6 +15,18 @@ struct buddy_head {
    * (i.e. the exponent of 2 that we're on e.g. 32, 64, ..., 512)
    */
   unsigned char level;
+  /**
+   * Set while the block sits on a free list. Lets a freed block check whether its buddy can be merged
+   * by looking at the buddy's header instead of searching the free list.
+   */
+  bool          free;
+#ifdef CONFIG_ALLOC_PROFILE
+  /**
+   * The allocation profiler's tag for the call site that allocated the block. Fits into padding, so
+   * the header doesn't grow.
+   */
+  unsigned short alloc_tag;
+#endif
   buddy_head_t* next;
   buddy_head_t* prev;
 };
@@ -27,6 +40,6 @@ static const unsigned int blocksizes[] = {32, 64, 128, 256, 512, 1024, 2048, 409
  */
 void         buddy_init(void);
 void         buddy_free(unsigned int addr);
-unsigned int buddy_malloc(size_t size);
+unsigned int buddy_malloc(size_t size, gfp_t gfp);
 
 #endif /* MEM_BUDDY_H */
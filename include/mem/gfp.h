@@ -0,0 +1,55 @@
+#ifndef MEM_GFP_H
+#define MEM_GFP_H
+
+/**
+ * Allocation context flags. These tell the allocators what the caller can tolerate while memory is
+ * being found for it.
+ */
+typedef unsigned int gfp_t;
+
+/**
+ * The caller may sleep until memory becomes available
+ */
+#define GFP_WAIT      0x01
+/**
+ * The allocation may wake kswapd to start background reclaim
+ */
+#define GFP_KSWAPD    0x02
+/**
+ * The allocation may dip into the pages below the min watermark, which are otherwise held back
+ */
+#define GFP_HIGH      0x04
+/**
+ * The caller can make do with a highmem page, i.e. one it has to `kmap` to access
+ */
+#define GFP_HIGHMEM   0x08
+/**
+ * The allocation isn't attributed to its caller by the allocation profiler. Used by allocators that
+ * are built on top of each other, which attribute the memory to their own callers instead.
+ */
+#define GFP_NOPROFILE 0x10
+
+/**
+ * Normal allocations from process context
+ */
+#define GFP_KERNEL  (GFP_WAIT | GFP_KSWAPD)
+/**
+ * Allocations that must not sleep, e.g. from interrupt handlers or with interrupts disabled. They
+ * get access to the reserve below the min watermark since they can't wait for reclaim.
+ */
+#define GFP_ATOMIC  (GFP_KSWAPD | GFP_HIGH)
+/**
+ * Opportunistic allocations that must not sleep, but can readily cope with failure
+ */
+#define GFP_NOWAIT  (GFP_KSWAPD)
+/**
+ * Allocations that must neither sleep nor trigger reclaim, e.g. from within reclaim itself
+ */
+#define GFP_NORECLAIM 0
+/**
+ * Pages mapped into user space or the vmalloc area, which the kernel doesn't need to reach through
+ * the direct map
+ */
+#define GFP_HIGHUSER  (GFP_KERNEL | GFP_HIGHMEM)
+
+#endif /* MEM_GFP_H */
@@ -0,0 +1,41 @@
+#ifndef MEM_HIGHMEM_H
+#define MEM_HIGHMEM_H
+
+#include "lib/types.h"
+#include "mem/page.h"
+#include "mem/vmalloc.h"
+
+/**
+ * Start of the kmap window, which takes up the last page table's worth of the address space
+ */
+#define PKMAP_BASE  VMALLOC_END
+/**
+ * The number of highmem pages that can be mapped at once
+ */
+#define PKMAP_PAGES PAGES_PER_TABLE
+
+/**
+ * Maps a page into the kernel's address space. Pages in the direct map are returned as-is; highmem
+ * pages are mapped into the kmap window until the matching `kunmap`. Must not be called from an
+ * interrupt handler.
+ *
+ * @param page
+ * @return void* The page's virtual address.
+ */
+void *kmap(page_t *page);
+
+/**
+ * Releases a mapping obtained via `kmap`. The mapping is only torn down once its slot is needed for
+ * another page, so mapping the same page again is cheap.
+ *
+ * @param page
+ */
+void kunmap(page_t *page);
+
+/**
+ * Sets up the kmap window. Must be called once the kernel page directory is active, and before any
+ * highmem is handed out.
+ */
+void highmem_init(void);
+
+#endif /* MEM_HIGHMEM_H */
@@ -0,0 +1,10 @@
+#ifndef MEM_KSM_H
+#define MEM_KSM_H
+
+/**
+ * Starts the same-page merging scanner, which shares identical anonymous user pages copy-on-write.
+ * Must be called after the process table and the timer have been initialized.
+ */
+void ksm_init(void);
+
+#endif /* MEM_KSM_H */
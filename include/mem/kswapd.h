@@ -0,0 +1,49 @@
+#ifndef MEM_KSWAPD_H
+#define MEM_KSWAPD_H
+
+#include "lib/list.h"
+#include "lib/types.h"
+
+typedef struct shrinker shrinker_t;
+
+/**
+ * A callback through which a subsystem gives memory back to the page allocator when free memory
+ * runs low.
+ */
+struct shrinker {
+  /**
+   * Releases up to `nr_pages` pages and returns the number of pages actually released
+   */
+  int (*shrink)(int nr_pages);
+  /**
+   * Link in the list of registered shrinkers
+   */
+  list_head_t list;
+};
+
+/**
+ * Registers a shrinker to be called by kswapd whenever free memory drops below the low watermark.
+ *
+ * @param shrinker
+ */
+void shrinker_register(shrinker_t *shrinker);
+
+/**
+ * Unregisters a previously registered shrinker.
+ *
+ * @param shrinker
+ */
+void shrinker_unregister(shrinker_t *shrinker);
+
+/**
+ * Wakes kswapd so it can reclaim memory in the background. Cheap enough to call from any allocation
+ * path; does nothing if kswapd is already running or hasn't been started.
+ */
+void kswapd_wakeup(void);
+
+/**
+ * Starts the kswapd kernel process. Must be called after the process table has been initialized.
+ */
+void kswapd_init(void);
+
+#endif /* MEM_KSWAPD_H */
@@ -16,4 +16,11 @@ unsigned int mem_init_temporary(unsigned int magic, unsigned int mbi_ptr);
  */
 void mem_init(void);
 
+/**
+ * Releases the pages holding boot-only code and data (the `.setup` section and everything marked
+ * `__init` or `__initdata`) to the page allocator. Must be called once booting is complete; nothing
+ * in those sections may run or be referenced afterwards.
+ */
+void mem_free_init(void);
+
 #endif /* MEM_LAYOUT_H */
@@ -0,0 +1,95 @@
+#ifndef MEM_MEMBLOCK_H
+#define MEM_MEMBLOCK_H
+
+#include "lib/types.h"
+
+/**
+ * Maximum number of disjoint regions tracked per region type
+ */
+#define MEMBLOCK_MAX_REGIONS 64
+
+/**
+ * A range of physical memory [base, end)
+ */
+typedef struct {
+  unsigned int base;
+  unsigned int end;
+} memblock_region_t;
+
+/**
+ * A sorted set of disjoint, non-adjacent regions
+ */
+typedef struct {
+  unsigned int      count;
+  memblock_region_t regions[MEMBLOCK_MAX_REGIONS];
+} memblock_type_t;
+
+/**
+ * Callback invoked for each free range of physical memory [base, end).
+ */
+typedef void (*memblock_range_fn)(unsigned int base, unsigned int end, void *ctx);
+
+/**
+ * Usable physical memory, as reported by the BIOS memory map
+ */
+extern memblock_type_t memblock_memory;
+
+/**
+ * Physical memory that is in use by the kernel image or has been handed out by `memblock_alloc`
+ */
+extern memblock_type_t memblock_reserved;
+
+/**
+ * Seeds the boot memory allocator from the kernel memory map and reserves the memory occupied by the
+ * kernel image, boot stack and temporary page tables. Only memory below `limit` is considered
+ * usable.
+ *
+ * @param limit The end of the physical memory that is permanently mapped.
+ */
+void memblock_init(unsigned int limit);
+
+/**
+ * Adds a range of usable physical memory.
+ *
+ * @return RET_FAIL if the region table is full
+ */
+retval_t memblock_add(unsigned int base, unsigned int size);
+
+/**
+ * Marks a range of physical memory as in use.
+ *
+ * @return RET_FAIL if the region table is full
+ */
+retval_t memblock_reserve(unsigned int base, unsigned int size);
+
+/**
+ * Releases a previously reserved range of physical memory.
+ *
+ * @return RET_FAIL if the region table is full
+ */
+retval_t memblock_free(unsigned int base, unsigned int size);
+
+/**
+ * Allocates and reserves `size` bytes of physical memory aligned to `align`, which must be a power
+ * of two. Allocations are placed as high as possible so low memory stays available to devices that
+ * need it.
+ *
+ * @return unsigned int The physical address of the allocation, or 0 if no free range is large
+ * enough.
+ */
+unsigned int memblock_alloc(unsigned int size, unsigned int align);
+
+/**
+ * Whether any usable memory lies within [base, base + size).
+ */
+bool memblock_is_memory(unsigned int base, unsigned int size);
+
+/**
+ * Invokes `fn` for every range of usable memory that isn't reserved, in ascending order.
+ *
+ * @param fn
+ * @param ctx Passed to `fn` as-is.
+ */
+void memblock_foreach_free(memblock_range_fn fn, void *ctx);
+
+#endif /* MEM_MEMBLOCK_H */
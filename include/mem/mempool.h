@@ -0,0 +1,72 @@
+#ifndef MEM_MEMPOOL_H
+#define MEM_MEMPOOL_H
+
+#include "lib/types.h"
+#include "mem/gfp.h"
+#include "mem/slab.h"
+#include "proc/wait.h"
+
+/**
+ * A reserve of pre-allocated objects backing a slab cache. Allocations that must not fail (e.g. the
+ * ones made from interrupt context to make forward progress) fall back to the reserve once the
+ * cache itself can't grow, and freed objects go to refill the reserve before the cache.
+ */
+typedef struct {
+  /**
+   * The cache objects are normally allocated from and returned to
+   */
+  kmem_cache_t     *cache;
+  /**
+   * Number of objects the reserve is kept topped up to
+   */
+  unsigned int      min_nr;
+  /**
+   * Number of objects currently held in the reserve
+   */
+  unsigned int      curr_nr;
+  /**
+   * The reserved objects, used as a stack
+   */
+  void            **elements;
+  /**
+   * Processes waiting for an object to be freed back into the pool
+   */
+  wait_queue_head_t wait;
+} mempool_t;
+
+/**
+ * Initializes a pool and pre-allocates its reserve. Must be called from process context.
+ *
+ * @param pool
+ * @param min_nr The number of objects to keep in reserve.
+ * @param cache The cache backing the pool.
+ * @return RET_FAIL if the reserve could not be filled
+ */
+retval_t mempool_init(mempool_t *pool, unsigned int min_nr, kmem_cache_t *cache);
+
+/**
+ * Returns all reserved objects to the backing cache.
+ *
+ * @param pool
+ */
+void mempool_exit(mempool_t *pool);
+
+/**
+ * Allocates an object, falling back to the reserve if the cache can't supply one.
+ *
+ * @param pool
+ * @param gfp The allocation context. With GFP_WAIT, sleeps until an object is freed back into the
+ * pool rather than failing.
+ * @return void* The object, or NULL if both the cache and the reserve are exhausted.
+ */
+void *mempool_alloc(mempool_t *pool, gfp_t gfp);
+
+/**
+ * Frees an object allocated with `mempool_alloc`, refilling the reserve first.
+ *
+ * @param pool
+ * @param obj
+ */
+void mempool_free(mempool_t *pool, void *obj);
+
+#endif /* MEM_MEMPOOL_H */
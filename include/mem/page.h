@@ -2,6 +2,9 @@
 #define MEM_PAGE_H
 
 #include "lib/types.h"
+#include "mem/gfp.h"
+#include "mem/segments.h"
+#include "proc/wait.h"
 
 #define PAGE_SIZE           4096
 #define PAGE_SHIFT          0x0C
@@ -11,14 +14,60 @@
  * Aligns an address to the next page boundary.
  */
 #define PAGE_ALIGN(addr)    (((addr) + (PAGE_SIZE - 1)) & PAGE_MASK)
+#ifdef CONFIG_PAE
+/**
+ * With PAE, entries are 64 bits wide, so a table only holds 512 of them and a directory entry maps
+ * 2 MB. The four page directories are allocated back to back, which lets them be indexed as a
+ * single directory of 2048 entries; the page directory pointer table above them is only needed by
+ * the CPU.
+ */
+#  define PAGES_PER_TABLE 512
+#  define PGDIR_SHIFT     21
+#  define PGDIR_PAGES     4
+/**
+ * The number of bits in a page frame number, enough for 64 GB
+ */
+#  define PAGE_NUM_BITS   24
+#else
+/**
+ * The number of page table entries in a page table, and thus the number of 4 KB pages covered by a
+ * single 4 MB page.
+ */
+#  define PAGES_PER_TABLE 1024
+/**
+ * Shift from a page directory index to the address of the 4 MB page it maps.
+ */
+#  define PGDIR_SHIFT     22
+/**
+ * The number of pages taken up by the page directory
+ */
+#  define PGDIR_PAGES     1
+/**
+ * The number of bits in a page frame number, enough for 4 GB
+ */
+#  define PAGE_NUM_BITS   20
+#endif
+
+/**
+ * The number of entries in the page directory
+ */
+#define PGDIR_ENTRIES       (PGDIR_PAGES * PAGES_PER_TABLE)
 /**
  * Computes the page directory address.
  */
-#define GET_PGDIR(addr)     ((unsigned int)((addr) >> 22) & 0x3FF)
+#define GET_PGDIR(addr)     ((unsigned int)((addr) >> PGDIR_SHIFT) & (PGDIR_ENTRIES - 1))
 /**
  * Computes the page table address.
  */
-#define GET_PGTBL(address)  ((unsigned int)((address) >> 12) & 0x3FF)
+#define GET_PGTBL(address)  ((unsigned int)((address) >> PAGE_SHIFT) & (PAGES_PER_TABLE - 1))
+/**
+ * The number of bytes mapped by a single page directory entry
+ */
+#define PGDIR_SIZE          (1 << PGDIR_SHIFT)
+/**
+ * The number of page frames that can be addressed
+ */
+#define MAX_PHYS_PAGES      (1U << PAGE_NUM_BITS)
 
 /* Page flags */
 
@@ -34,10 +83,31 @@
  * User
  */
 #define PAGE_USER           0x004
+/**
+ * Accessed: set by the CPU whenever the page is read or written
+ */
+#define PAGE_ACCESSED       0x020
+/**
+ * Dirty: set by the CPU whenever the page is written
+ */
+#define PAGE_DIRTY          0x040
+/**
+ * Page Size: the page directory entry maps a 4 MB page rather than a page table (requires PSE)
+ */
+#define PAGE_LARGE          0x080
+/**
+ * Global: the TLB entry survives CR3 reloads (requires PGE)
+ */
+#define PAGE_GLOBAL         0x100
 /**
  * No Page Allocated (OS managed)
  */
 #define PAGE_NOALLOC        0x200
+/**
+ * Swapped: the page's contents are held in compressed swap (OS managed). The slot it's stored in
+ * takes the place of the frame address.
+ */
+#define PAGE_SWAPPED        0x400
 
 /**
  * Protection violation
@@ -60,6 +130,18 @@
  * page belongs to buddy
  */
 #define PAGE_BUDDY          0x010
+/**
+ * page belongs to a slab cache
+ */
+#define PAGE_SLAB           0x020
+/**
+ * page is free and heads a free block of 2^order pages
+ */
+#define PAGE_FREE           0x040
+/**
+ * page is free and sits in the pre-zeroed pool
+ */
+#define PAGE_ZEROED         0x080
 /**
  * kernel, BIOS address, ...
  */
@@ -84,59 +166,310 @@
 
 #define DEFAULT_NUM_PAGES   4096
 
-#define NUM_PAGES           (free_page_list_size / sizeof(page_t))
+/**
+ * The largest order of physically contiguous block the page allocator hands out, i.e. 2^10 pages
+ * (4 MB)
+ */
+#define PAGE_MAX_ORDER      10
 
-typedef struct page page_t;
+/**
+ * The page frame database is split into sections of this many pages (4 MB), each of which is only
+ * allocated if it covers usable memory. A section spans exactly one block of the largest order, so a
+ * block's buddy always lives in the same section.
+ */
+#define SECTION_SHIFT       PAGE_MAX_ORDER
+#define PAGES_PER_SECTION   (1 << SECTION_SHIFT)
+/**
+ * Enough sections to cover all of the memory that can be addressed, highmem included
+ */
+#define MEMMAP_MAX_SECTIONS (MAX_PHYS_PAGES / PAGES_PER_SECTION)
 
+/**
+ * A page directory or page table entry
+ */
+#ifdef CONFIG_PAE
+typedef uint64_t pte_t;
+#else
+typedef unsigned int pte_t;
+#endif
+
+typedef struct page             page_t;
+typedef struct page_cache_entry page_cache_entry_t;
+
+/**
+ * A physical page frame. Only the fields needed to allocate, free and reference count a page live
+ * here, so that walking the free lists touches as few cache lines as possible.
+ */
 struct page {
-  int            page_num;
-  int            usage_count;
-  int            flags;
-  int            inode;
-  unsigned int   file_offset;
+  unsigned int        page_num : PAGE_NUM_BITS;
+  /**
+   * For free pages and multi-page allocations, the order of the block this page heads
+   */
+  unsigned int        order    : 4;
+  unsigned short      flags;
+  /**
+   * The number of references to the page. A single frame may back any number of mappings once it's
+   * shared copy-on-write, so this can't be any narrower.
+   */
+  unsigned int        usage_count;
+  /**
+   * The page's virtual address. Highmem pages only have one while they're mapped with `kmap`.
+   */
+  char               *data;
+  page_t             *prev_free;
+  page_t             *next_free;
+  /**
+   * The page cache metadata of the page, or NULL if the page isn't cached
+   */
+  page_cache_entry_t *cache;
+#ifdef CONFIG_ALLOC_PROFILE
+  /**
+   * The allocation profiler's tag for the call site that allocated the page, or 0
+   */
+  unsigned short      alloc_tag;
+#endif
+};
+
+/**
+ * Identifies the file contents held by a cached page. These are only allocated for pages in the
+ * page cache, which is why they're kept apart from `page_t`.
+ */
+struct page_cache_entry {
+  page_t              *page;
+  int                  inode;
+  unsigned int         file_offset;
   /**
    * Device on which the page resides
    */
-  unsigned short dev;
-  char          *data;
-  page_t        *prev_hash;
-  page_t        *next_hash;
-  page_t        *prev_free;
-  page_t        *next_free;
+  deviceno_t           dev;
+  page_cache_entry_t  *next_hash;
+  /**
+   * Points at whatever points at this entry, i.e. the bucket head or the previous entry's
+   * `next_hash`, so an entry can be unlinked without walking or rehashing its chain
+   */
+  page_cache_entry_t **pprev_hash;
 };
 
-extern unsigned int *kpage_dir;
+/**
+ * The kernel page directory, shared by every process
+ */
+extern pte_t       *kpage_dir;
+#ifdef CONFIG_PAE
+/**
+ * The page directory pointer table, whose entries point at the pages of `kpage_dir`
+ */
+extern uint64_t     kpage_pdpt[PGDIR_PAGES];
+#endif
 
-extern unsigned int free_page_list_size;
-extern page_t      *free_page_list;
+/**
+ * The sections of the page frame database, indexed by page number >> SECTION_SHIFT. Sections that
+ * don't cover any usable memory are NULL.
+ */
+extern page_t      *memmap_sections[MEMMAP_MAX_SECTIONS];
+extern unsigned int memmap_num_pages;
 
-extern unsigned int page_cache_size;
-extern page_t     **page_cache;
+/**
+ * The range of page frames above the direct map, [highmem_start, highmem_end). These pages have no
+ * permanent kernel mapping, so they're only handed out to allocations that ask for `GFP_HIGHMEM`.
+ */
+extern unsigned int highmem_start;
+extern unsigned int highmem_end;
+
+extern unsigned int         page_cache_size;
+extern page_cache_entry_t **page_cache;
+
+/**
+ * Processes waiting in `page_get_free` for pages to be freed or reclaimed
+ */
+extern wait_queue_head_t page_wait;
+
+/**
+ * Retrieves the value CR3 is loaded with to activate the kernel page directory. `kpage_dir` must
+ * already hold its virtual address.
+ */
+static inline unsigned int
+kpage_dir_cr3 (void) {
+#ifdef CONFIG_PAE
+  return V2P((unsigned int)kpage_pdpt);
+#else
+  return V2P((unsigned int)kpage_dir);
+#endif
+}
 
 static inline void
 page_activate_kpage_dir (void) {
-  asm volatile("mov %0, %%cr3" ::"a"(kpage_dir));
+  asm volatile("mov %0, %%cr3" ::"a"(kpage_dir_cr3()));
+}
+
+/**
+ * Retrieves the descriptor of the given page frame.
+ *
+ * @return page_t* The page, or NULL if the page number is out of range or falls in a section without
+ * usable memory.
+ */
+static inline page_t *
+page_from_num (unsigned int page_num) {
+  if (page_num >= memmap_num_pages) {
+    return NULL;
+  }
+
+  page_t *section = memmap_sections[page_num >> SECTION_SHIFT];
+  return section ? &section[page_num & (PAGES_PER_SECTION - 1)] : NULL;
 }
 
 static inline bool
 page_is_valid (int page_num) {
-  return (page_num >= 0 && page_num < (int)NUM_PAGES);
+  return page_num >= 0 && page_from_num(page_num);
+}
+
+static inline bool
+page_is_highmem (page_t *page) {
+  return page->page_num >= highmem_start && page->page_num < highmem_end;
+}
+
+/**
+ * Retrieves the physical address of a page frame, which may lie above 4 GB with PAE.
+ */
+static inline phys_addr_t
+page_to_phys (page_t *page) {
+  return (phys_addr_t)page->page_num << PAGE_SHIFT;
 }
 
 /**
- * Initializes the pages and populates the free-list.
+ * The number of page colors, always a power of two. Pages of the same color map to the same sets of
+ * the L2 cache. Must be set before `page_init`; 1 disables coloring.
+ */
+extern unsigned int page_colors;
+
+/**
+ * Retrieves the color matching a virtual address, so that virtually contiguous memory can be backed
+ * by frames that don't conflict in the cache.
+ */
+static inline unsigned int
+page_color (unsigned int addr) {
+  return (addr >> PAGE_SHIFT) & (page_colors - 1);
+}
+
+/**
+ * Initializes the pages and populates the free-list. Only the first PAGE_INIT_EAGER pages are set
+ * up right away; the rest are left to `page_init_deferred`.
  * @param num_pages
  */
 void page_init(unsigned int num_pages);
 
+/**
+ * Initializes the next section of page frames left over by `page_init` and hands its free pages to
+ * the free lists. Called by pageinitd in the background, and by allocations that run short before
+ * it's done.
+ *
+ * @return bool false if every page frame has already been initialized.
+ */
+bool page_init_deferred(void);
+
 /**
  * Grab a free page from the free list
+ *
+ * @param gfp The allocation context. Only `GFP_WAIT` allocations may sleep waiting for reclaim,
+ * and only `GFP_HIGH` allocations may use the pages below the min watermark.
+ */
+page_t *page_get_free(gfp_t gfp);
+
+/**
+ * Grab a free page of the given color, falling back to another color if none is available. Pages
+ * handed out by `page_get_free` cycle through the colors instead.
+ *
+ * @param gfp The allocation context.
+ * @param color The preferred color, e.g. from `page_color`.
+ */
+page_t *page_get_free_color(gfp_t gfp, unsigned int color);
+
+/**
+ * Grab a free page filled with zeros. Served from the pool of pages pre-zeroed by the idle process
+ * when possible, and zeroed on the spot otherwise.
  */
-page_t *page_get_free(void);
+page_t *page_get_zeroed(gfp_t gfp);
 
 /**
- * Release a page back into the free list
+ * Moves up to `nr_pages` free pages into the pre-zeroed pool, zeroing them with interrupts enabled.
+ * Meant to be called from the idle process.
+ *
+ * @param nr_pages
+ * @return int The number of pages zeroed, or 0 if the pool is full or there's nothing to zero.
+ */
+int page_zero_idle(int nr_pages);
+
+/**
+ * Release a page back into the free list. If the page heads a multi-page block, the whole block is
+ * released.
  */
 void page_release(page_t *page);
 
+/**
+ * Looks up the page caching the given file offset and takes a reference to it. A cached page that
+ * has been released is taken back off the free list.
+ *
+ * @param dev
+ * @param inode
+ * @param file_offset The page-aligned offset within the file.
+ * @return page_t* The page, or NULL if the offset isn't cached.
+ */
+page_t *page_cache_lookup(deviceno_t dev, int inode, unsigned int file_offset);
+
+/**
+ * Looks up a run of consecutive pages of a file, stopping at the first one that isn't cached. Each
+ * page found is referenced as with `page_cache_lookup`. Meant for readahead and writeback.
+ *
+ * @param dev
+ * @param inode
+ * @param file_offset The page-aligned offset of the first page.
+ * @param nr_pages The maximum number of pages to look up.
+ * @param pages Receives the pages found.
+ * @return unsigned int The number of pages found.
+ */
+unsigned int page_cache_lookup_range(
+  deviceno_t   dev,
+  int          inode,
+  unsigned int file_offset,
+  unsigned int nr_pages,
+  page_t     **pages
+);
+
+/**
+ * Adds a page to the page cache, growing the cache's hash table if it has become too crowded.
+ *
+ * @return RET_FAIL if the offset is already cached or no memory is available for the metadata.
+ */
+retval_t page_cache_insert(page_t *page, deviceno_t dev, int inode, unsigned int file_offset);
+
+/**
+ * Removes a page from the page cache, if it's cached.
+ *
+ * @param page
+ */
+void page_cache_remove(page_t *page);
+
+/**
+ * Sets up the cache from which page cache metadata is allocated. Must be called after the slab
+ * allocator is ready.
+ */
+void page_cache_init(void);
+
+/**
+ * Grabs a block of 2^order physically contiguous pages, splitting a larger free block if needed.
+ *
+ * @param order The order of the block, up to PAGE_MAX_ORDER.
+ * @param gfp The allocation context. Blocks larger than a page are never waited for.
+ * @return page_t* The first page of the block, or NULL if no block of the given order is available.
+ */
+page_t *alloc_pages(unsigned int order, gfp_t gfp);
+
+/**
+ * Releases a block of 2^order pages obtained via `alloc_pages`, coalescing it with its free buddies.
+ *
+ * @param page The first page of the block.
+ * @param order The order with which the block was allocated. The order recorded at allocation is
+ * what's actually released; a mismatch is only logged.
+ */
+void free_pages(page_t *page, unsigned int order);
+
 #endif /* MEM_PAGE_H */
@@ -0,0 +1,10 @@
+#ifndef MEM_PAGEINITD_H
+#define MEM_PAGEINITD_H
+
+/**
+ * Starts the pageinitd kernel process, which initializes the page frames left over by `page_init`
+ * in the background. Must be called after the process table has been initialized.
+ */
+void pageinitd_init(void);
+
+#endif /* MEM_PAGEINITD_H */
@@ -0,0 +1,58 @@
+#ifndef MEM_PAGING_H
+#define MEM_PAGING_H
+
+#include "lib/types.h"
+#include "mem/page.h"
+
+/**
+ * Retrieves the page descriptor of the frame mapped by a present page table entry.
+ */
+#define PTE_PAGE(pte) (page_from_num((pte) >> PAGE_SHIFT))
+
+/**
+ * Retrieves the active page directory.
+ */
+pte_t *paging_pgdir_current(void);
+
+/**
+ * Looks up the page table entry that maps `addr` in the given page directory.
+ *
+ * @param pgdir The page directory.
+ * @param addr The virtual address.
+ * @param create Whether to allocate the page table if it doesn't exist yet.
+ * @return pte_t* The entry, or NULL if there's no page table (or `addr` is mapped by a 4 MB page).
+ */
+pte_t *paging_get_pte(pte_t *pgdir, unsigned int addr, bool create);
+
+/**
+ * Reserves the page at `addr` without allocating a frame for it. The first access faults, at which
+ * point a zero-filled frame is mapped in.
+ *
+ * @param pgdir The page directory.
+ * @param addr The virtual address.
+ * @param flags Any of PAGE_RW and PAGE_USER.
+ * @return RET_FAIL if the page is mapped or swapped out, or no page table could be allocated
+ */
+retval_t paging_reserve(pte_t *pgdir, unsigned int addr, unsigned int flags);
+
+/**
+ * Shares the frame mapped by `src` with `dst` copy-on-write. Both mappings become read-only; the
+ * first write to either one resolves the fault by copying the frame, or by simply making it writable
+ * again once it's no longer shared.
+ *
+ * @param src The present entry that currently maps the frame.
+ * @param dst The entry to map the frame into.
+ * @param addr The virtual address mapped by `src`, so its TLB entry can be invalidated.
+ */
+void paging_share_cow(pte_t *src, pte_t *dst, unsigned int addr);
+
+/**
+ * Attempts to resolve a page fault in the active address space.
+ *
+ * @param addr The faulting address (CR2).
+ * @param err The page fault error code.
+ * @return RET_OK if the fault was resolved and the faulting instruction can be restarted
+ */
+retval_t paging_handle_fault(unsigned int addr, unsigned int err);
+
+#endif /* MEM_PAGING_H */
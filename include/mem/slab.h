@@ -0,0 +1,159 @@
+#ifndef MEM_SLAB_H
+#define MEM_SLAB_H
+
+#include "lib/list.h"
+#include "lib/types.h"
+#include "mem/page.h"
+
+/**
+ * Maximum length of a cache name, including the null terminator
+ */
+#define KMEM_CACHE_NAME_LEN  16
+
+/**
+ * Default object alignment
+ */
+#define KMEM_CACHE_MIN_ALIGN sizeof(void *)
+
+typedef struct kmem_cache kmem_cache_t;
+typedef struct slab       slab_t;
+
+/**
+ * A single page carved up into same-size objects. The descriptor lives at the start of the page it
+ * describes, so any object address can be mapped back to its slab by masking off the page offset.
+ */
+struct slab {
+  /**
+   * The cache this slab belongs to
+   */
+  kmem_cache_t *cache;
+  /**
+   * The page frame backing this slab
+   */
+  page_t       *page;
+  /**
+   * Link in one of the cache's partial, full, or empty slab lists
+   */
+  list_head_t   list;
+  /**
+   * Head of the singly-linked list of free objects in this slab
+   */
+  void         *free;
+  /**
+   * Number of objects currently handed out from this slab
+   */
+  unsigned int  in_use;
+};
+
+/**
+ * An object cache. Holds slabs of fixed-size objects so they can be allocated and freed in O(1)
+ * without a per-object header.
+ */
+struct kmem_cache {
+  char         name[KMEM_CACHE_NAME_LEN];
+  /**
+   * The size of the objects as requested by the cache creator
+   */
+  size_t       object_size;
+  /**
+   * The size of each object slot, including alignment padding and the free pointer if it can't be
+   * stored inside the object
+   */
+  size_t       size;
+  /**
+   * Offset within a slot at which the free-list pointer is stored
+   */
+  size_t       free_offset;
+  /**
+   * Offset of the first object from the start of the slab's page
+   */
+  size_t       offset;
+  /**
+   * The number of objects that fit in a single slab
+   */
+  unsigned int objects_per_slab;
+  /**
+   * Optional constructor, run once for every object when its slab is created.
+   * Freed objects must be returned to their constructed state.
+   */
+  void (*ctor)(void *);
+
+  /**
+   * Slabs with both allocated and free objects
+   */
+  list_head_t slabs_partial;
+  /**
+   * Slabs with no free objects
+   */
+  list_head_t slabs_full;
+  /**
+   * Slabs with no allocated objects
+   */
+  list_head_t slabs_empty;
+
+  /**
+   * Total number of slabs (pages) owned by this cache
+   */
+  unsigned int num_slabs;
+  /**
+   * Number of objects currently allocated from this cache
+   */
+  unsigned int num_active;
+
+  /**
+   * Link in the global list of caches
+   */
+  list_head_t list;
+};
+
+/**
+ * Creates a new object cache.
+ *
+ * @param name A human-readable name for the cache. Used for debugging.
+ * @param size The size of each object.
+ * @param align Required object alignment, or 0 for the default.
+ * @param ctor An optional constructor.
+ * @return kmem_cache_t* The new cache, or NULL if the objects can't fit in a slab or no memory is
+ * available.
+ */
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align, void (*ctor)(void *));
+
+/**
+ * Destroys a cache and returns all of its pages to the page allocator.
+ *
+ * @param cache
+ * @return RET_FAIL if the cache still has objects allocated
+ */
+retval_t kmem_cache_destroy(kmem_cache_t *cache);
+
+/**
+ * Allocates an object from the given cache.
+ *
+ * @param cache
+ * @param gfp The allocation context, used if a new slab has to be allocated.
+ * @return void* The object, or NULL if a new slab could not be allocated.
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache, gfp_t gfp);
+
+/**
+ * Returns an object to the cache from which it was allocated.
+ *
+ * @param cache
+ * @param obj
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+/**
+ * Releases all empty slabs held by the cache.
+ *
+ * @param cache
+ * @return int The number of pages released.
+ */
+int kmem_cache_shrink(kmem_cache_t *cache);
+
+/**
+ * Initializes the slab allocator. Must be called after the page allocator is ready.
+ */
+void slab_init(void);
+
+#endif /* MEM_SLAB_H */
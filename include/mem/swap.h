@@ -0,0 +1,23 @@
+#ifndef MEM_SWAP_H
+#define MEM_SWAP_H
+
+#include "lib/types.h"
+#include "mem/paging.h"
+
+/**
+ * Brings a swapped-out page back in, decompressing it into a new frame and mapping it in place of
+ * the swap entry.
+ *
+ * @param pte The page table entry holding the swap entry.
+ * @param addr The virtual address mapped by `pte`.
+ * @return RET_FAIL if no frame could be allocated or the stored page is corrupt
+ */
+retval_t swap_in(pte_t *pte, unsigned int addr);
+
+/**
+ * Sets up compressed swap and registers its shrinker with kswapd. Must be called after vmalloc is
+ * ready.
+ */
+void swap_init(void);
+
+#endif /* MEM_SWAP_H */
@@ -0,0 +1,70 @@
+#ifndef MEM_VMALLOC_H
+#define MEM_VMALLOC_H
+
+#include "lib/list.h"
+#include "lib/types.h"
+#include "mem/page.h"
+
+/**
+ * Unmapped gap between the end of the direct map and the vmalloc area, so overruns off the end of
+ * physical memory fault instead of landing in a vmalloc mapping
+ */
+#define VMALLOC_OFFSET (8 * 1024 * 1024)
+
+/**
+ * End of the vmalloc area. The last 4 MB of the address space are left to the kmap window.
+ */
+#define VMALLOC_END    0xFFC00000
+
+/**
+ * A virtually contiguous range of kernel address space backed by individually allocated frames.
+ */
+typedef struct {
+  /**
+   * Link in the address-ordered list of areas
+   */
+  list_head_t  list;
+  /**
+   * Start of the area
+   */
+  unsigned int addr;
+  /**
+   * Size of the area in bytes, including the trailing guard page
+   */
+  unsigned int size;
+  /**
+   * The frames mapped into the area, in address order
+   */
+  page_t     **pages;
+  unsigned int nr_pages;
+} vm_area_t;
+
+/**
+ * Start of the vmalloc area. Depends on the amount of physical memory, so it's set by `vmalloc_init`.
+ */
+extern unsigned int vmalloc_start;
+
+/**
+ * Allocates `size` bytes of virtually contiguous kernel memory. The backing frames need not be
+ * physically contiguous, so this succeeds on fragmented memory where a large `kmalloc` would not.
+ * Must be called from process context. The memory is not zeroed.
+ *
+ * @param size
+ * @return void* The memory, or NULL if either address space or frames ran out.
+ */
+void *vmalloc(size_t size);
+
+/**
+ * Releases memory allocated with `vmalloc`.
+ *
+ * @param addr
+ */
+void vfree(void *addr);
+
+/**
+ * Sets up the vmalloc area just past the direct map. Must be called after the slab allocator is
+ * ready.
+ */
+void vmalloc_init(void);
+
+#endif /* MEM_VMALLOC_H */
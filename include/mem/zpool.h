@@ -0,0 +1,49 @@
+#ifndef MEM_ZPOOL_H
+#define MEM_ZPOOL_H
+
+#include "lib/types.h"
+#include "mem/gfp.h"
+#include "mem/page.h"
+
+/**
+ * Granularity of the pool's size classes. Objects are rounded up to a multiple of this.
+ */
+#define ZPOOL_CLASS_SIZE  64
+
+/**
+ * Largest object the pool stores. Anything bigger wouldn't leave room for a second object in its
+ * slab, so storing it would save nothing over keeping the page itself.
+ */
+#define ZPOOL_MAX_SIZE    ((PAGE_SIZE / 2) - ZPOOL_CLASS_SIZE)
+
+#define ZPOOL_NUM_CLASSES (ZPOOL_MAX_SIZE / ZPOOL_CLASS_SIZE)
+
+/**
+ * Allocates storage for a variable-size object, e.g. a compressed page. Objects of similar sizes are
+ * packed together into slabs, so the pool wastes less than `ZPOOL_CLASS_SIZE` bytes per object.
+ *
+ * @param size At most ZPOOL_MAX_SIZE bytes.
+ * @param gfp The allocation context.
+ * @return void* The object, or NULL if it's too large or no memory is available.
+ */
+void *zpool_alloc(size_t size, gfp_t gfp);
+
+/**
+ * Frees an object allocated with `zpool_alloc`.
+ *
+ * @param obj
+ * @param size The size the object was allocated with.
+ */
+void zpool_free(void *obj, size_t size);
+
+/**
+ * Retrieves the number of pages held by the pool.
+ */
+unsigned int zpool_pages(void);
+
+/**
+ * Creates the pool's size classes. Must be called after the slab allocator is ready.
+ */
+void zpool_init(void);
+
+#endif /* MEM_ZPOOL_H */
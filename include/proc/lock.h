@@ -2,6 +2,7 @@
 #define PROC_LOCK_H
 
 #include "lib/types.h"
+#include "proc/wait.h"
 
 #define AREA_BH          0x00000001
 #define AREA_CALLOUT     0x00000002
@@ -9,8 +10,12 @@
 #define AREA_SERIAL_READ 0x00000008
 
 typedef struct {
-  bool locked;
-  bool wanted;
+  bool              locked;
+  bool              wanted;
+  /**
+   * Processes waiting for the resource, woken up one at a time as it's unlocked
+   */
+  wait_queue_head_t wait;
 } resource_t;
 
 void     lock_resource(resource_t *resource);
@@ -0,0 +1,55 @@
+#ifndef PROC_PREEMPT_H
+#define PROC_PREEMPT_H
+
+#include "lib/types.h"
+
+/**
+ * Kernel preemption. Processes running kernel code give up the CPU as soon as a reschedule is
+ * needed, rather than when they next sleep or return to user mode, unless they're in a section that
+ * must not be switched away from:
+ *
+ * - while interrupts are disabled
+ * - between preempt_disable() and preempt_enable()
+ * - while bottom halves or the scheduler itself are running
+ *
+ * Reschedules are picked up on the way out of interrupts and exceptions, and whenever one of the
+ * above sections ends.
+ */
+
+/**
+ * Keeps the current process from being preempted until the matching preempt_enable(). Sections
+ * nest.
+ */
+void preempt_disable(void);
+
+/**
+ * Ends a preempt_disable() section, rescheduling if a reschedule became due during it.
+ */
+void preempt_enable(void);
+
+/**
+ * Ends a preempt_disable() section without checking for a reschedule, for callers that are about to
+ * reach a scheduling point anyway.
+ */
+void preempt_enable_no_resched(void);
+
+/**
+ * Whether the current process may be switched away from right now
+ */
+bool preemptible(void);
+
+/**
+ * Reschedules if a reschedule is due and the current process is preemptible. Called whenever
+ * interrupts are re-enabled.
+ */
+void preempt_check_resched(void);
+
+/**
+ * Preempts kernel code on the way out of an interrupt or exception. Called with interrupts enabled.
+ *
+ * @param eflags The interrupted code's flags. Code that ran with interrupts disabled is never
+ * preempted, even though an exception may return to it.
+ */
+void preempt_schedule_irq(unsigned int eflags);
+
+#endif /* PROC_PREEMPT_H */
@@ -3,7 +3,9 @@
 
 #include "drivers/dev/char/tty/tty.h"
 #include "interrupt/signal.h"
+#include "lib/list.h"
 #include "lib/types.h"
+#include "proc/wait.h"
 
 #define IO_BITMAP_SIZE         8192 /* 8192*8bit = all I/O address space */
 
@@ -17,6 +19,16 @@
  */
 #define PROC_INIT_PID          1
 
+/**
+ * Maximum length of a process name, including the null terminator
+ */
+#define PROC_NAME_LEN          16
+
+/**
+ * Default CPU time slice of a process, in ticks
+ */
+#define PROC_DEFAULT_PRIORITY  20
+
 /**
  * Flag indicating this process is an internal kernel process
  */
@@ -78,42 +90,33 @@ typedef struct {
 } vma_t;
 
 /**
- * Represents the Intel 386 Task Switch State (TSS)
+ * What's kept of a process's CPU state while it's switched away from. Its registers are saved on its
+ * kernel stack by `switch_to`.
  */
 typedef struct {
-  unsigned int       prev_tss;
-  unsigned int       esp0;
-  unsigned int       ss0;
-  unsigned int       esp1;
-  unsigned int       ss1;
-  unsigned int       esp2;
-  unsigned int       ss2;
-  unsigned int       cr3;
-  unsigned int       eip;
-  unsigned int       eflags;
-  unsigned int       eax;
-  unsigned int       ecx;
-  unsigned int       edx;
-  unsigned int       ebx;
-  unsigned int       esp;
-  unsigned int       ebp;
-  unsigned int       esi;
-  unsigned int       edi;
-  unsigned int       es;
-  unsigned int       cs;
-  unsigned int       ss;
-  unsigned int       ds;
-  unsigned int       fs;
-  unsigned int       gs;
-  unsigned int       ldt;
-  unsigned short int debug_trap;
-  unsigned short int io_bitmap_addr;
-  unsigned char      io_bitmap[IO_BITMAP_SIZE + 1];
-} i386_tss_t;
-
-typedef struct proc proc_t;
+  /**
+   * The top of the kernel stack, which interrupts from user mode switch to
+   */
+  unsigned int esp0;
+  /**
+   * The kernel stack pointer as of the last switch away from the process
+   */
+  unsigned int esp;
+  /**
+   * The physical address of the page directory
+   */
+  unsigned int cr3;
+} proc_thread_t;
+
+typedef struct proc        proc_t;
+typedef struct sched_array sched_array_t;
 
 struct proc {
+  /**
+   * Name of the process, used for debugging
+   */
+  char name[PROC_NAME_LEN];
+
   /**
    * Pointer to the parent process
    */
@@ -137,9 +140,20 @@ struct proc {
   /**
    * Process group id
    */
-  pid_t      pgid;
-  proc_state state;
-  i386_tss_t tss;
+  pid_t         pgid;
+  proc_state    state;
+  proc_thread_t thread;
+
+  /**
+   * The ports the process may access from user mode, one bit per port with a clear bit granting
+   * access. Allocated by the first sys_ioperm call; NULL for processes that never asked for any.
+   */
+  unsigned char *io_bitmap;
+  /**
+   * The number of bytes of the bitmap up to the highest port ever granted, i.e. how much of it is
+   * copied into the TSS on a switch to the process
+   */
+  unsigned int   io_bitmap_size;
 
   /**
    * Resident Set Size
@@ -160,10 +174,32 @@ struct proc {
   int priority;
 
   /**
-   * Address of the resource, if any, that this process is sleeping on.
-   * Used for lookups in sleep proc hash table
+   * The scheduling policy, and for the real-time policies, the fixed priority of the process from 1
+   * to SCHED_MAX_RT_PRIO
+   */
+  unsigned int policy;
+  unsigned int rt_priority;
+
+  /**
+   * The set of run queues the process is queued on while it's runnable, and the priority level of
+   * the queue
+   */
+  sched_array_t *run_array;
+  unsigned int   run_prio;
+
+  /**
+   * The depth of the sections the process can't be preempted in while running kernel code. See
+   * proc/preempt.h.
    */
-  void *sleep_addr;
+  unsigned int preempt_count;
+
+  /**
+   * The wait queue the process is sleeping on, if any, its link in the queue and the WAIT_* flags of
+   * the sleep
+   */
+  wait_queue_head_t *wait_queue;
+  list_head_t        wait_list;
+  unsigned int       wait_flags;
 
   /**
    * Bitmask of signals sent to this process but not yet handled
@@ -184,8 +220,9 @@ struct proc {
 
   proc_t *prev;
   proc_t *next;
-  proc_t *prev_sleeping;
-  proc_t *next_sleeping;
+  /**
+   * Links in the process's run queue, which is circular
+   */
   proc_t *prev_running;
   proc_t *next_running;
 
@@ -207,11 +244,6 @@ extern proc_t *proc_list;
  */
 extern unsigned int proc_list_size;
 
-/**
- * A linked list of currently running processes
- */
-extern proc_t *proc_running_list;
-
 /**
  * Returns a bool indicating whether the current process is in a running state
  */
@@ -228,6 +260,25 @@ proc_current_has_remaining_cpu_time_remaining (void) {
   return proc_current->remaining_cpu_time > 0;
 }
 
+/**
+ * Looks up a live process by pid.
+ *
+ * @param pid
+ * @return proc_t* The process, or NULL if there's none.
+ */
+proc_t *proc_get(pid_t pid);
+
+/**
+ * The ioperm syscall. Grants or revokes the calling process's access to a range of I/O ports from
+ * user mode. The process's I/O bitmap is allocated on first use.
+ *
+ * @param from The first port.
+ * @param num The number of ports.
+ * @param turn_on Whether to grant access rather than revoke it.
+ * @return int 0 on success, -EINVAL if the range exceeds the port space, or -ENOMEM.
+ */
+int sys_ioperm(unsigned int from, unsigned int num, int turn_on);
+
 /**
  * Indicates whether the given process group id belongs to one that is orphaned.
  * An orphaned process group is a process group in which the parent of every member is either itself
@@ -258,7 +309,17 @@ void proc_runnable(proc_t *p);
 void proc_not_runnable(proc_t *p, proc_state state);
 
 /**
- * Initialize process tables
+ * Creates a kernel process that runs `fn` in kernel mode on its own stack, sharing the kernel page
+ * directory. `fn` must never return.
+ *
+ * @param name The process name.
+ * @param fn The entrypoint of the process.
+ * @return proc_t* The new process, or NULL if no process slot or stack is available.
+ */
+proc_t *kproc_create(const char *name, void (*fn)(void));
+
+/**
+ * Initialize process tables. The calling context becomes the idle process.
  */
 void proc_init(void);
 
@@ -4,32 +4,114 @@
 #include "lib/types.h"
 #include "proc/proc.h"
 
+/**
+ * The number of priority levels, and thus run queues. Processes whose priority exceeds the number of
+ * levels share the highest one. Must not exceed the number of bits in the run queue bitmap.
+ */
+#define SCHED_NUM_PRIOS   32
+
+/**
+ * Scheduling policies. Time-share processes share the CPU in proportion to their priority. Real-time
+ * processes always run before them, highest priority first: SCHED_FIFO ones until they block or
+ * yield, and SCHED_RR ones for SCHED_RR_QUANTUM ticks at a time before giving way to their peers.
+ */
+#define SCHED_OTHER       0
+#define SCHED_FIFO        1
+#define SCHED_RR          2
+
+/**
+ * The highest real-time priority
+ */
+#define SCHED_MAX_RT_PRIO (SCHED_NUM_PRIOS - 1)
+
+/**
+ * A set of run queues, one per priority level. Level 0 is the highest priority, and a set bit in
+ * the bitmap marks a level whose queue isn't empty, so the highest priority runnable process is
+ * found with a single bit scan.
+ */
+struct sched_array {
+  /**
+   * The number of processes queued across all levels
+   */
+  unsigned int nr_running;
+  unsigned int bitmap;
+  /**
+   * The head of each level's circular queue
+   */
+  proc_t      *queues[SCHED_NUM_PRIOS];
+};
+
 extern bool needs_resched;
 
 /**
- * Performs a TSS task switch
+ * The number of callee-saved registers `switch_to` keeps on the stack of a process that's switched
+ * away from, below the address it resumes at
  */
-extern void do_switch(
-  unsigned int      *prev_esp_ptr,
-  unsigned int      *prev_eip_ptr,
-  unsigned int       idle_esp,
-  unsigned int       idle_eip,
-  unsigned int       idle_cr3,
-  unsigned short int tss
-);
+#define SWITCH_TO_REGS 4
 
 /**
- * Installs a new TSS descriptor into the GDT that points to `p->tss`,
- * so when the CPU loads this GDT entry (via `ltr`), it knows where to find the TSS for this
- * process.
+ * Switches kernel stacks: saves the current stack pointer to `prev_esp` and resumes the process whose
+ * stack pointer is `next_esp` where it was switched away from. Returns once the current process is
+ * switched back to.
  */
-void sched_set_tss(proc_t *p);
+extern void switch_to(unsigned int *prev_esp, unsigned int next_esp);
 
 /**
- * Decides which process should run next via Round Robin scheduling
+ * Decides which process should run next, i.e. the first process of the highest priority level with
+ * any processes that still have CPU time left. Processes are queued in FIFO order within a level.
+ *
+ * Processes that have used up their time slice are moved to the expired set of run queues, with their
+ * slice recharged. Once there's nothing left to run, the expired set becomes the active one, so both
+ * picking the next process and recharging every process take constant time.
  */
 void sched_run(void);
 
+/**
+ * Queues a process that just became runnable. Processes with CPU time left are queued to run in the
+ * current round, the others only in the next one. Must be called with interrupts disabled.
+ */
+void sched_enqueue(proc_t *p);
+
+/**
+ * Removes a process from its run queue. Must be called with interrupts disabled.
+ */
+void sched_dequeue(proc_t *p);
+
+/**
+ * Charges the current process for a timer tick, and asks for a reschedule once its time slice has
+ * been used up or real-time processes have used up their share of the CPU. Called from the timer
+ * interrupt.
+ */
+void sched_tick(void);
+
+/**
+ * Sets the scheduling policy and real-time priority of a process, requeuing it if it's runnable.
+ *
+ * @param p
+ * @param policy
+ * @param rt_priority 1 to SCHED_MAX_RT_PRIO for the real-time policies, 0 for SCHED_OTHER.
+ * @return int 0 on success, or -EINVAL if the policy or priority is invalid.
+ */
+int sched_setscheduler(proc_t *p, unsigned int policy, unsigned int rt_priority);
+
+/**
+ * The sched_setscheduler syscall. Unlike POSIX, the priority is passed by value.
+ *
+ * @param pid The process, or 0 for the calling process.
+ * @param policy
+ * @param rt_priority
+ * @return int 0 on success, -ESRCH if there's no such process or -EINVAL.
+ */
+int sys_sched_setscheduler(pid_t pid, int policy, int rt_priority);
+
+/**
+ * The sched_getscheduler syscall.
+ *
+ * @param pid The process, or 0 for the calling process.
+ * @return int The scheduling policy of the process, or -ESRCH if there's no such process.
+ */
+int sys_sched_getscheduler(pid_t pid);
+
 /**
  * Initialize scheduler resources
  */
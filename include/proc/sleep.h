@@ -4,28 +4,43 @@
 #include "proc/proc.h"
 // TODO: Use these consistently
 #include "lib/types.h"
+#include "proc/wait.h"
 
-#define SLEEP_FN(fn) func_as_ptr((void (*)(void))fn)
+/**
+ * Puts the current process to sleep on `wq` until it's woken up, or for interruptible sleeps, until
+ * a signal arrives. May be called with interrupts disabled, so that the condition being waited for
+ * can't come true between being checked and the process going to sleep.
+ *
+ * @param wq
+ * @param state
+ * @return int The signal that interrupted the sleep, or 0.
+ */
+int sleep_on(wait_queue_head_t *wq, proc_inttype state);
 
-static inline void *
-func_as_ptr (void (*fn)(void)) {
-  union {
-    void *p;
-    void (*f)(void);
-  } u = {.f = fn};
+/**
+ * Like `sleep_on`, but the process is woken up one at a time with the other exclusive waiters. A
+ * process that is woken up but returns a signal passes the wakeup on to the next one.
+ */
+int sleep_on_exclusive(wait_queue_head_t *wq, proc_inttype state);
 
-  return u.p;
-}
+/**
+ * Like `sleep_on`, but gives up after `ticks` timer ticks.
+ *
+ * @param wq
+ * @param state
+ * @param ticks
+ * @return int The signal that interrupted the sleep, -ETIMEDOUT if the timeout expired, or 0.
+ */
+int sleep_on_timeout(wait_queue_head_t *wq, proc_inttype state, unsigned int ticks);
 
 /**
- * Put the current process to sleep on addr
+ * Wakes up the processes sleeping on `wq`: all the non-exclusive ones, and the first exclusive one.
  */
-int sleep(void *addr, proc_inttype state);
+void wakeup(wait_queue_head_t *wq);
 
 /**
- * Wakeup any processes sleeping on addr
+ * Wakes up every process sleeping on `wq`, exclusive or not.
  */
-void wakeup(void *addr);
-void sleep_init(void);
+void wakeup_all(wait_queue_head_t *wq);
 
 #endif /* SLEEP_H */
@@ -0,0 +1,42 @@
+#ifndef PROC_WAIT_H
+#define PROC_WAIT_H
+
+#include "lib/list.h"
+#include "lib/types.h"
+
+/**
+ * Flags of a process sleeping on a wait queue
+ */
+
+/**
+ * The process is woken up one at a time with the other exclusive waiters
+ */
+#define WAIT_EXCLUSIVE 0x01
+/**
+ * The sleep's timeout expired before anybody woke the process up
+ */
+#define WAIT_TIMED_OUT 0x02
+
+/**
+ * A queue of processes sleeping until something happens to the object the queue is embedded in.
+ * Processes are linked in through their proc_t, so they're added and removed in constant time.
+ *
+ * Waiters that can all make progress once woken are queued at the front, and are all woken up.
+ * Exclusive waiters are queued at the back and woken up one at a time, so that e.g. a single freed
+ * page doesn't wake up every process waiting for one.
+ *
+ * A zeroed wait queue is a valid, empty one, so objects don't need to initialize theirs.
+ */
+typedef struct {
+  list_head_t waiters;
+} wait_queue_head_t;
+
+/**
+ * Whether anybody is sleeping on the queue
+ */
+static inline bool
+wait_queue_active (const wait_queue_head_t *wq) {
+  return wq->waiters.next && !list_is_empty(&wq->waiters);
+}
+
+#endif /* PROC_WAIT_H */
@@ -3,6 +3,15 @@
 
 #include "interrupt/signal.h"
 
+/**
+ * Syscall numbers, following the i386 Linux ABI
+ */
+#define SYS_IOPERM             101
+#define SYS_SCHED_SETSCHEDULER 156
+#define SYS_SCHED_GETSCHEDULER 157
+
+#define NUM_SYSCALLS           158
+
 /**
  * Sets up and invokes a syscall.
  */
@@ -18,7 +27,7 @@ extern void syscall(void);
  * @param arg_4
  * @param arg_5
  * @param sc
- * @return int
+ * @return int The syscall's return value, or -ENOSYS if there's no such syscall
  */
 int syscall_exec(
   unsigned int   num,
@@ -12,6 +12,12 @@ int_enable (void) {
   asm volatile("sti");
 }
 
+overridable void
+int_enable_halt (void) {
+  // STI only takes effect after the next instruction, so no interrupt can come in before the HLT
+  asm volatile("sti; hlt");
+}
+
 overridable bool
 int_enabled (void) {
   return eflags_get() & EFLAGS_INT_ENABLED;
@@ -0,0 +1,99 @@
+#include "arch/tlb.h"
+
+#include "arch/cpu.h"
+#include "lib/compiler.h"
+#include "mem/base.h"
+
+unsigned int tlb_global = 0;
+
+overridable void
+tlb_flush_page (unsigned int addr) {
+  invlpg(addr);
+}
+
+overridable void
+tlb_flush_all (void) {
+  cr3_set(cr3_get());
+}
+
+overridable void
+tlb_flush_global (void) {
+  uint32_t cr4 = cr4_get();
+
+  if (cr4 & CR4_PGE) {
+    // Toggling PGE is the only way to drop global entries short of INVLPG-ing each one
+    cr4_set(cr4 & ~CR4_PGE);
+    cr4_set(cr4);
+  } else {
+    tlb_flush_all();
+  }
+}
+
+void
+tlb_flush_range (unsigned int start, unsigned int end) {
+  start = start & PAGE_MASK;
+
+  if (end - start > (TLB_FLUSH_MAX_PAGES << PAGE_SHIFT)) {
+    // Refilling the TLB costs less than invalidating this many entries one by one. Kernel mappings
+    // are global, so a CR3 reload alone would leave them in place.
+    if (end > KERNEL_PAGE_OFFSET) {
+      tlb_flush_global();
+    } else {
+      tlb_flush_all();
+    }
+    return;
+  }
+
+  for (unsigned int addr = start; addr < end; addr += PAGE_SIZE) {
+    tlb_flush_page(addr);
+  }
+}
+
+void
+tlb_gather_init (tlb_gather_t *tlb) {
+  tlb->start    = 0;
+  tlb->end      = 0;
+  tlb->nr_pages = 0;
+}
+
+void
+tlb_gather_page (tlb_gather_t *tlb, unsigned int addr, page_t *page) {
+  if (tlb->start == tlb->end) {
+    tlb->start = addr;
+    tlb->end   = addr + PAGE_SIZE;
+  } else if (addr < tlb->start) {
+    tlb->start = addr;
+  } else if (addr + PAGE_SIZE > tlb->end) {
+    tlb->end = addr + PAGE_SIZE;
+  }
+
+  if (!page) {
+    return;
+  }
+
+  tlb->pages[tlb->nr_pages++] = page;
+  if (tlb->nr_pages == TLB_GATHER_PAGES) {
+    tlb_gather_finish(tlb);
+  }
+}
+
+void
+tlb_gather_finish (tlb_gather_t *tlb) {
+  if (tlb->start != tlb->end) {
+    tlb_flush_range(tlb->start, tlb->end);
+  }
+
+  for (unsigned int n = 0; n < tlb->nr_pages; n++) {
+    page_release(tlb->pages[n]);
+  }
+
+  tlb_gather_init(tlb);
+}
+
+void
+tlb_init (void) {
+  if (cpu_has_pge()) {
+    cr4_set(cr4_get() | CR4_PGE);
+    tlb_global = PAGE_GLOBAL;
+  }
+}
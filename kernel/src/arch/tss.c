@@ -0,0 +1,40 @@
+#include "arch/tss.h"
+
+#include "lib/compiler.h"
+#include "lib/string.h"
+#include "mem/segments.h"
+
+i386tss_t           tss;
+
+/**
+ * The number of bytes at the start of the TSS's I/O bitmap that were copied from a process. The rest
+ * of the bitmap denies access, so switching to a process with a smaller bitmap only has to reset
+ * the difference.
+ */
+static unsigned int tss_io_bitmap_size;
+
+void
+tss_init (void) {
+  tss.ss0            = KERNEL_DS;
+  // Including the trailing byte, which the CPU may read past the last port
+  kmemset(tss.io_bitmap, 0xFF, sizeof(tss.io_bitmap));
+  tss.io_bitmap_addr = TSS_NO_IO_BITMAP;
+
+  ltr(TSS);
+}
+
+void
+tss_set_io_bitmap (const unsigned char *bitmap, unsigned int size) {
+  if (!bitmap) {
+    tss.io_bitmap_addr = TSS_NO_IO_BITMAP;
+    return;
+  }
+
+  kmemcpy(tss.io_bitmap, bitmap, size);
+  if (size < tss_io_bitmap_size) {
+    kmemset(tss.io_bitmap + size, 0xFF, tss_io_bitmap_size - size);
+  }
+  tss_io_bitmap_size = size;
+
+  tss.io_bitmap_addr = offsetof(i386tss_t, io_bitmap);
+}
@@ -1,14 +1,42 @@
 #include "debug/stacktrace.h"
 
 #include "drivers/dev/char/tmpcon.h"
+#include "kernel.h"
 #include "lib/string.h"
 #include "lib/types.h"
+#include "mem/base.h"
 
 static inline uint32_t
 get_address (uint32_t vaddr, uint32_t off) {
   return ((uint32_t *)vaddr)[off];
 }
 
+const char *
+elf_lookup_symbol (unsigned int addr, unsigned int *offset) {
+  // The bootloader may not have handed us the kernel's section headers
+  if (!symtab || !strtab) {
+    return NULL;
+  }
+
+  elf32_shdr *vsymtab = (elf32_shdr *)P2V((unsigned int)symtab);
+  elf32_shdr *vstrtab = (elf32_shdr *)P2V((unsigned int)strtab);
+  elf32_sym  *sym     = (elf32_sym *)P2V(vsymtab->sh_addr);
+
+  for (unsigned int n = 0; n < vsymtab->sh_size / sizeof(elf32_sym); n++, sym++) {
+    if (ELF32_ST_TYPE(sym->st_info) != STT_FUNC) {
+      continue;
+    }
+    if (addr >= sym->st_value && addr < (sym->st_value + sym->st_size)) {
+      if (offset) {
+        *offset = addr - sym->st_value;
+      }
+      return (const char *)P2V(vstrtab->sh_addr) + sym->st_name;
+    }
+  }
+
+  return NULL;
+}
+
 void
 dump_stack_trace (void) {
   kprintf("%s\n", "Stack trace:");
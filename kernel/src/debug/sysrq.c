@@ -0,0 +1,41 @@
+#include "drivers/dev/char/sysrq.h"
+
+#include "debug/stacktrace.h"
+#include "drivers/dev/char/tmpcon.h"
+#include "kernel.h"
+#include "mem/allocprof.h"
+
+/**
+ * Prints the state of physical memory, along with who holds it if allocations are profiled. Memory
+ * pressure and fragmentation can then be looked into long before allocations start failing.
+ */
+static void
+sysrq_show_memory (void) {
+  kprintf(
+    "memory: %d of %d pages free, %d of %d highmem pages free, %d reclaimed by kswapd\n",
+    kstat.num_free_pages,
+    kstat.total_mem_pages,
+    kstat.num_free_highmem,
+    kstat.highmem_pages,
+    kstat.pages_reclaimed
+  );
+
+  allocprof_report();
+}
+
+void
+sysrq (int op) {
+  switch (op) {
+    case SYSRQ_STACK:
+      dump_stack_trace();
+      break;
+
+    case SYSRQ_MEMORY:
+      sysrq_show_memory();
+      break;
+
+    default:
+      // TODO: task list
+      break;
+  }
+}
@@ -1,19 +1,74 @@
 #include "init/bios.h"
 
 #include "drivers/dev/char/tmpcon.h"
+#include "kconfig.h"
 #include "kernel.h"
 #include "kstat.h"
+#include "lib/compiler.h"
 #include "lib/constants.h"
+#include "lib/math.h"
 #include "mem/page.h"
 #include "mem/segments.h"
 
 bios_mmap_t bios_mmap[NUM_BIOS_MMAP_ENTRIES];
 bios_mmap_t kernel_mmap[NUM_BIOS_MMAP_ENTRIES];
 
-static char *bios_mem_type[]
+static char *bios_mem_type[] __initdata
   = {NULL, "available", "reserved", "ACPI Reclaim", "ACPI NVS", "unusable", "disabled"};
 
-void
+/**
+ * Retrieves the range of page frames covered by a memory map entry, clipped to [first, end).
+ *
+ * @return bool false if the entry doesn't overlap the range.
+ */
+static bool
+bios_mmap_pages (
+  bios_mmap_t  *bmm,
+  unsigned int  first,
+  unsigned int  end,
+  unsigned int *from,
+  unsigned int *to
+) {
+  uint64_t from_addr = ((uint64_t)bmm->from_high << 32) | bmm->from;
+  uint64_t to_addr   = ((uint64_t)bmm->to_high << 32) | bmm->to;
+
+  // Only whole pages are usable
+  uint64_t from_page = (from_addr + PAGE_SIZE - 1) >> PAGE_SHIFT;
+  uint64_t to_page   = to_addr >> PAGE_SHIFT;
+
+  *from              = from_page > first ? (unsigned int)from_page : first;
+  *to                = to_page < end ? (unsigned int)to_page : end;
+
+  return *from < *to;
+}
+
+/**
+ * Sets aside the available memory above the direct map as highmem, as much of it as the page frame
+ * database can describe without crowding out the direct map.
+ */
+static __init void
+bios_highmem_init (void) {
+  highmem_start     = kstat.physical_pages;
+  highmem_end       = highmem_start;
+
+  for (unsigned int n = 0; n < NUM_BIOS_MMAP_ENTRIES; n++) {
+    unsigned int from, to;
+    if (kernel_mmap[n].type == MULTIBOOT_MEMORY_AVAILABLE
+        && bios_mmap_pages(&kernel_mmap[n], highmem_start, MAX_PHYS_PAGES, &from, &to)) {
+      highmem_end = max(highmem_end, to);
+    }
+  }
+
+  // Highmem is described by page descriptors that live in the direct map
+  unsigned int max_pages
+    = ((kstat.physical_pages / HIGHMEM_MAP_RATIO) << PAGE_SHIFT) / sizeof(page_t);
+  if (highmem_end - highmem_start > max_pages) {
+    highmem_end = highmem_start + max_pages;
+    klogf_warn("only up to %dMB of highmem will be used.\n", max_pages >> (20 - PAGE_SHIFT));
+  }
+}
+
+__init void
 bios_mmap_init (multiboot_mmap_entry_t *mmap, unsigned int mmap_len) {
   // We need to fill out a data structure using the multiboot info supplied to us by the bootloader.
   // Where does the multiboot memory stuff actually come from? Primarily the E820 memory map.
@@ -111,14 +166,35 @@ bios_mmap_init (multiboot_mmap_entry_t *mmap, unsigned int mmap_len) {
     kstat.physical_pages   = (kstat.param.extmemsize + 1024) >> 2;
   }
 
-  // Truncate physical memory to upper kernel address space size (1GB or 2GB), since
-  // currently all memory is permanently mapped there.
-  if (kstat.physical_pages > (GDT_BASE >> PAGE_SHIFT)) {
-    kstat.physical_pages = (GDT_BASE >> PAGE_SHIFT);
-    klogf_warn("only up to %dGB of physical memory will be used.\n", GDT_BASE >> 30);
+  // Truncate physical memory to upper kernel address space size (1GB or 2GB), minus the window
+  // left for vmalloc, since currently all memory is permanently mapped there.
+  if (kstat.physical_pages > ((GDT_BASE - VMALLOC_RESERVE) >> PAGE_SHIFT)) {
+    kstat.physical_pages = ((GDT_BASE - VMALLOC_RESERVE) >> PAGE_SHIFT);
+    klogf_warn(
+      "only up to %dMB of physical memory will be used.\n",
+      (GDT_BASE - VMALLOC_RESERVE) >> 20
+    );
   }
 
   kmemcpy(kernel_mmap, bios_mmap, NUM_BIOS_MMAP_ENTRIES * sizeof(bios_mmap_t));
+
+  bios_highmem_init();
+}
+
+void
+bios_mmap_foreach_available (
+  unsigned int       first,
+  unsigned int       end,
+  bios_mmap_range_fn fn,
+  void              *ctx
+) {
+  for (unsigned int n = 0; n < NUM_BIOS_MMAP_ENTRIES; n++) {
+    unsigned int from, to;
+    if (kernel_mmap[n].type == MULTIBOOT_MEMORY_AVAILABLE
+        && bios_mmap_pages(&kernel_mmap[n], first, end, &from, &to)) {
+      fn(from, to, ctx);
+    }
+  }
 }
 
 overridable bool
@@ -6,6 +6,7 @@
 #include "init/bios.h"
 #include "kernel.h"
 #include "kstat.h"
+#include "lib/compiler.h"
 #include "lib/math.h"
 #include "lib/string.h"
 #include "mem/base.h"
@@ -14,7 +15,7 @@
 elf32_shdr *symtab;
 elf32_shdr *strtab;
 
-static void
+static __init void
 multiboot_set_video_props_from_info (multiboot_info_t *mbi) {
   vbe_controller_t *vbe_ctrl = (vbe_controller_t *)mbi->vbe_control_info;
   vbe_mode_t       *vbe_mode = (vbe_mode_t *)mbi->vbe_mode_info;
@@ -43,7 +44,7 @@ multiboot_set_video_props_from_info (multiboot_info_t *mbi) {
  * Sets default video properties, typically in cases where multiboot was not used by the bootloader.
  * For default, we just use 80x25 VGA.
  */
-static void
+static __init void
 multiboot_set_video_props_default (void) {
   video.columns = VIDEO_CONS_DEFAULT_COLS;
   video.rows    = VIDEO_CONS_DEFAULT_ROWS;
@@ -51,7 +52,7 @@ multiboot_set_video_props_default (void) {
   video.memsize = 384 * 1024;
 }
 
-void
+__init void
 multiboot_init (unsigned int magic, unsigned int mbi_ptr) {
   multiboot_info_t mbi;
   kmemset(&video, 0, sizeof(video_props_t));
@@ -124,7 +125,7 @@ multiboot_init (unsigned int magic, unsigned int mbi_ptr) {
  * @param mbr_init The multiboot info pointer
  * @return The last address, as aforementioned.
  */
-unsigned int
+__init unsigned int
 get_last_boot_addr (unsigned int magic, unsigned int mbr_init) {
   multiboot_info_t *mbi;
 
@@ -6,6 +6,7 @@
 #include "drivers/dev/char/tmpcon.h"
 #include "interrupt/pic.h"
 #include "lib/string.h"
+#include "proc/preempt.h"
 
 interrupt_t *irq_table[NUM_IRQS];
 
@@ -60,6 +61,10 @@ void
 irq_bottom_half_exec (sig_context_t *sc) {
   interrupt_bh_t *bh;
 
+  // Bottom halves run with interrupts enabled, but must finish before anybody else gets the CPU.
+  // Reschedules they ask for are picked up on the way out of the interrupt.
+  preempt_disable();
+
   bh = bh_table;
   while (bh) {
     if (bh->flags & IRQ_BH_ACTIVE) {
@@ -68,6 +73,8 @@ irq_bottom_half_exec (sig_context_t *sc) {
     }
     bh = bh->next;
   }
+
+  preempt_enable_no_resched();
 }
 
 void
@@ -9,15 +9,26 @@
 #include "kconfig.h"
 #include "kernel.h"
 #include "kstat.h"
+#include "lib/compiler.h"
+#include "lib/string.h"
+#include "mem/mempool.h"
+#include "mem/slab.h"
+#include "proc/sched.h"
 #include "sync/simplelock.h"
 
 static void timer_irq(int num, sig_context_t* sc);
 static void timer_irq_bh(sig_context_t* sc);
 static void timer_task_bh(sig_context_t* sc);
 
-timer_task_t  tt_pool[NUM_TIMER_TASKS];
-timer_task_t* tt_pool_head;
-timer_task_t* tt_head;
+/**
+ * Object cache from which timer tasks are allocated
+ */
+static kmem_cache_t* tt_cache;
+/**
+ * Timer tasks are armed from interrupt context, so keep enough in reserve for every process
+ */
+static mempool_t     tt_pool;
+timer_task_t*        tt_head;
 
 static interrupt_bh_t timer_bh         = {0, &timer_irq_bh, NULL};
 static interrupt_bh_t tt_bh            = {0, &timer_task_bh, NULL};
@@ -30,6 +41,8 @@ timer_irq (int num, sig_context_t* sc) {
     kstat.uptime++;
   }
 
+  sched_tick();
+
   timer_bh.flags |= IRQ_BH_ACTIVE;
 }
 
@@ -58,19 +71,12 @@ timer_task_init (timer_task_t* tt, timer_task_request_t* req, unsigned int ticks
 
 static void
 timer_task_free (timer_task_t* old) {
-  old->next    = tt_pool_head;
-  tt_pool_head = old;
+  mempool_free(&tt_pool, old);
 }
 
 static timer_task_t*
 timer_task_get_free (void) {
-  timer_task_t* next_free = NULL;
-  if (tt_pool_head) {
-    next_free       = tt_pool_head;
-    tt_pool_head    = next_free->next;
-    next_free->next = NULL;
-  }
-  return next_free;
+  return (timer_task_t*)mempool_alloc(&tt_pool, GFP_ATOMIC);
 }
 
 static void
@@ -122,14 +128,14 @@ timer_task_bh (sig_context_t* sc) {
   }
 }
 
-void
+overridable void
 timer_task_add (timer_task_request_t* req, unsigned int ticks) {
   unsigned int flags = eflags_get();
   timer_task_remove(req);
 
   timer_task_t* tt;
   if (!(tt = timer_task_get_free())) {
-    klogf_warn("%s(): no more timer_task slots\n", __func__);
+    klogf_warn("%s(): unable to allocate a timer_task\n", __func__);
     goto done;
   }
 
@@ -140,7 +146,7 @@ done:
   eflags_set(flags);
 }
 
-void
+overridable void
 timer_task_remove (timer_task_request_t* req) {
   unsigned int flags = eflags_get();
 
@@ -179,15 +185,9 @@ timer_init (void) {
 
   pit_init(HZ);
 
-  kmemset(tt_pool, 0, sizeof(tt_pool));
-
-  tt_pool_head   = NULL;
-  unsigned int n = NUM_TIMER_TASKS;
-  while (--n) {
-    timer_task_t* tt = &tt_pool[n];
-    timer_task_free(tt);
-  }
-  tt_head = NULL;
+  tt_cache = kmem_cache_create("timer_task", sizeof(timer_task_t), 0, NULL);
+  mempool_init(&tt_pool, NUM_TIMER_TASKS, tt_cache);
+  tt_head  = NULL;
 
   if (!irq_register(TIMER_IRQ, &timer_irq_config)) {
     irq_enable(TIMER_IRQ);
@@ -1,12 +1,14 @@
 #include "interrupt/traps.h"
 
+#include "arch/x86.h"
 #include "debug/panic.h"
+#include "debug/stacktrace.h"
 #include "drivers/dev/char/tmpcon.h"
-#include "fs/elf.h"
 #include "interrupt/pit.h"
 #include "kernel.h"
 #include "mem/base.h"
 #include "mem/page.h"
+#include "mem/paging.h"
 #include "mem/segments.h"
 
 #define DUMP_REG_OR_FAIL(trap_num, sc)                 \
@@ -49,24 +51,6 @@ trap_t traps_table[NUM_EXCEPTIONS] = {
   {"Intel reserved",                        trap_reserved,                    0}
 };
 
-static const char*
-elf_lookup_symbol (unsigned int addr) {
-  elf32_shdr* vsymtab = (elf32_shdr*)P2V((unsigned int)symtab);
-  elf32_shdr* vstrtab = (elf32_shdr*)P2V((unsigned int)strtab);
-  elf32_sym*  sym     = (elf32_sym*)P2V(vsymtab->sh_addr);
-
-  for (unsigned int n = 0; n < vsymtab->sh_size / sizeof(elf32_sym); n++, sym++) {
-    if (ELF32_ST_TYPE(sym->st_info) != STT_FUNC) {
-      continue;
-    }
-    if (addr >= sym->st_value && addr < (sym->st_value + sym->st_size)) {
-      return (const char*)P2V(vstrtab->sh_addr) + sym->st_name;
-    }
-  }
-
-  return NULL;
-}
-
 static void
 print_trap_stacktrace (void) {
   kprintf("%s\n", "stacktrace:");
@@ -92,7 +76,7 @@ print_trap_stacktrace (void) {
 
   for (unsigned int n = 0; n < 256; n++) {
     unsigned int addr = *esp;
-    const char*  s    = elf_lookup_symbol(addr);
+    const char*  s    = elf_lookup_symbol(addr, NULL);
     if (s) {
       kprintf("<0x%08x> %s()\n", addr, s);
     }
@@ -102,11 +86,10 @@ print_trap_stacktrace (void) {
 
 static retval_t
 dump_trap_registers (unsigned int trap_num, sig_context_t* sc) {
-  bool is_page_fault = trap_num == 14;
+  bool is_page_fault = trap_num == TRAP_PAGE_FAULT;
 
   if (is_page_fault) {
-    unsigned int cr2;
-    asm volatile("movl %%cr2, %0" : "=r"(cr2));
+    unsigned int cr2 = cr2_get();
     kprintf(
       "%s at 0x%08x (%s) with errcode 0x%02x%s",
       traps_table[trap_num].name,
@@ -168,6 +151,13 @@ dump_trap_registers (unsigned int trap_num, sig_context_t* sc) {
 void
 trap_handle (unsigned int trap_num, sig_context_t sc) {
   traps_table[trap_num].handler(trap_num, &sc);
+
+  // The page fault handler only returns once the fault has been resolved, in which case we resume
+  // the faulting instruction
+  if (trap_num == TRAP_PAGE_FAULT) {
+    return;
+  }
+
   sc.err = -sc.err;
   while (1);
 }
@@ -188,7 +178,7 @@ trap_nmi_interrupt (unsigned int trap_num, sig_context_t* sc) {
 
   kprintf("NMI received: %d\n", error);
   switch (error) {
-    case 0x80: kprintf("%s\n", "Parity check occurred.") break;
+    case 0x80: kprintf("%s\n", "Parity check occurred."); break;
     default: kprintf("Unknown error: 0x%X\n", error); break;
   }
 
@@ -251,7 +241,15 @@ trap_general_protection (unsigned int trap_num, sig_context_t* sc) {
 }
 
 void
-trap_page_fault (unsigned int trap_num, sig_context_t* sc) {}
+trap_page_fault (unsigned int trap_num, sig_context_t* sc) {
+  // Not-present faults on reserved pages and writes to copy-on-write pages are resolved here
+  if (paging_handle_fault(cr2_get(), sc->err) == RET_OK) {
+    return;
+  }
+
+  DUMP_REG_OR_FAIL(trap_num, sc);
+  while (1);
+}
 
 void
 trap_reserved (unsigned int trap_num, sig_context_t* sc) {
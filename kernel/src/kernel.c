@@ -4,6 +4,9 @@
 #include "arch/interrupt.h"
 #include "drivers/dev/char/keyboard.h"
 #include "interrupt/irq.h"
+#include "kconfig.h"
+#include "mem/page.h"
+#include "proc/sched.h"
 
 void noreturn
 kernel_stop (void) {
@@ -18,3 +21,30 @@ kernel_stop (void) {
 
   cpu_idle();
 }
+
+void noreturn
+kernel_idle (void) {
+  while (true) {
+    // Interrupts that make another process runnable preempt the idle process on their way out, but
+    // a reschedule may also have become due while it had interrupts disabled
+    if (needs_resched) {
+      sched_run();
+    }
+
+    // Put spare cycles to use by pre-zeroing free pages a few at a time, and only halt once there's
+    // nothing left to zero
+    if (page_zero_idle(ZERO_PAGES_BATCH)) {
+      continue;
+    }
+
+    // An interrupt that came in since the check above may have made a reschedule due, and halting
+    // now would sit on it until the next one
+    int_disable();
+    if (needs_resched) {
+      int_enable();
+      continue;
+    }
+
+    int_enable_halt();
+  }
+}
@@ -3,6 +3,7 @@
 #include "arch/cpu.h"
 #include "arch/interrupt.h"
 #include "arch/x86.h"
+#include "drivers/dev/char/charq.h"
 #include "drivers/dev/char/console/sysconsole.h"
 #include "drivers/dev/char/ps2.h"
 #include "drivers/dev/char/tmpcon.h"
@@ -17,7 +18,10 @@
 #include "kernel.h"
 #include "kstat.h"
 #include "mem/base.h"
+#include "mem/ksm.h"
+#include "mem/kswapd.h"
 #include "mem/layout.h"
+#include "mem/pageinitd.h"
 #include "proc/proc.h"
 
 unsigned int real_last_addr;
@@ -92,6 +96,9 @@ kmain (unsigned int magic, unsigned int mbi, unsigned int last_addr) {
   mem_init();
   klog_info("Permanent page tables installed");
 
+  charq_init();
+  klog_info("Character queue cache initialized");
+
   video_init();
   klog_info("Video initialized");
 
@@ -104,8 +111,20 @@ kmain (unsigned int magic, unsigned int mbi, unsigned int last_addr) {
   proc_init();
   klog_info("Process table initialized");
 
+  kswapd_init();
+  klog_info("kswapd started");
+
+  ksm_init();
+  klog_info("ksmd started");
+
+  pageinitd_init();
+  klog_info("pageinitd started");
+
   int_enable();
   klog_info("Interrupts enabled");
 
-  cpu_idle();
+  mem_free_init();
+  klog_info("Boot-only memory released");
+
+  kernel_idle();
 }
@@ -3,27 +3,34 @@
 #include "lib/compiler.h"
 #include "lib/string.h"
 #include "lib/types.h"
+#include "mem/allocprof.h"
 #include "mem/base.h"
 #include "mem/buddy.h"
 #include "mem/page.h"
 
 overridable unsigned int
-kmalloc (size_t size) {
+kmalloc (size_t size, gfp_t gfp) {
   // If the requested size can be accommodated by a buddy allocator block, use that
   size_t max_size = blocksizes[BUDDY_MAX_LEVEL - 1];
   if (size + sizeof(buddy_head_t) <= max_size) {
-    size += sizeof(buddy_head_t);
-    return buddy_malloc(size);
+    size              += sizeof(buddy_head_t);
+    unsigned int addr  = buddy_malloc(size, gfp);
+    allocprof_buddy_alloc(addr, ALLOCPROF_CALLER());
+    return addr;
   }
 
-  // Otherwise, we'll need to just allocate a page
-
-  // TODO: Fix this
-  if (size > PAGE_SIZE) {
-    return 0;
+  // Otherwise, we'll need to allocate a physically contiguous run of pages
+  unsigned int order;
+  for (order = 0; ((size_t)PAGE_SIZE << order) < size; order++) {
+    if (order == PAGE_MAX_ORDER) {
+      return 0;
+    }
   }
+
+  // The pages are attributed to our caller rather than to us
   page_t* page;
-  if ((page = page_get_free())) {
+  if ((page = alloc_pages(order, gfp | GFP_NOPROFILE))) {
+    allocprof_page_alloc(page, gfp, ALLOCPROF_CALLER());
     unsigned int addr = page->page_num << PAGE_SHIFT;
     return P2V(addr);
   }
@@ -33,9 +40,10 @@ kmalloc (size_t size) {
 
 overridable void
 kfree (unsigned int addr) {
-  page_t* page = &free_page_list[V2P(addr) >> PAGE_SHIFT];
+  page_t* page = page_from_num(V2P(addr) >> PAGE_SHIFT);
 
   if (page->flags & PAGE_BUDDY) {
+    allocprof_buddy_free(addr);
     buddy_free(addr);
   } else {
     page_release(page);
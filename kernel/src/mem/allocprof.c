@@ -0,0 +1,215 @@
+#include "mem/allocprof.h"
+
+#ifdef CONFIG_ALLOC_PROFILE
+
+#  include "arch/interrupt.h"
+#  include "debug/stacktrace.h"
+#  include "drivers/dev/char/tmpcon.h"
+#  include "interrupt/timer.h"
+#  include "kconfig.h"
+#  include "kernel.h"
+#  include "mem/buddy.h"
+
+/**
+ * The call sites, hashed by address with linear probing. Sites are never removed, so a lookup stops
+ * at the first unused entry. The extra entry at the end collects the sites that didn't fit.
+ *
+ * Tags stored in pages and blocks are an entry's index plus one, leaving 0 for untracked memory.
+ */
+static allocprof_site_t allocprof_sites[ALLOCPROF_SITES + 1];
+
+/**
+ * When the last report was printed
+ */
+static unsigned int     allocprof_report_ticks;
+
+static inline unsigned int
+allocprof_hash (unsigned int site) {
+  // Fibonacci hashing, since return addresses share their low bits with their neighbours
+  return ((site * 0x9E3779B1) >> 16) & (ALLOCPROF_SITES - 1);
+}
+
+/**
+ * Looks up the entry of the given call site, adding it if there is none. Must be called with
+ * interrupts disabled.
+ *
+ * @return unsigned int The entry's index.
+ */
+static unsigned int
+allocprof_lookup (unsigned int site) {
+  unsigned int index = allocprof_hash(site);
+
+  for (unsigned int probes = 0; probes < ALLOCPROF_SITES; probes++) {
+    if (allocprof_sites[index].site == site) {
+      return index;
+    }
+    if (!allocprof_sites[index].site) {
+      allocprof_sites[index].site = site;
+      return index;
+    }
+    index = (index + 1) & (ALLOCPROF_SITES - 1);
+  }
+
+  return ALLOCPROF_SITES;
+}
+
+/**
+ * Attributes `bytes` to the call site. Must be called with interrupts disabled.
+ *
+ * @return unsigned short The tag to store with the memory.
+ */
+static unsigned short
+allocprof_account (unsigned int site, unsigned int bytes) {
+  unsigned int      index = allocprof_lookup(site);
+  allocprof_site_t *entry = &allocprof_sites[index];
+
+  entry->allocs++;
+  entry->live_bytes += bytes;
+  if (entry->live_bytes > entry->peak_bytes) {
+    entry->peak_bytes = entry->live_bytes;
+  }
+
+  return index + 1;
+}
+
+/**
+ * Releases `bytes` attributed by `tag`. Must be called with interrupts disabled.
+ */
+static void
+allocprof_unaccount (unsigned short tag, unsigned int bytes) {
+  if (!tag || tag > ALLOCPROF_SITES + 1) {
+    return;
+  }
+
+  allocprof_site_t *entry = &allocprof_sites[tag - 1];
+  entry->frees++;
+  entry->live_bytes -= bytes;
+}
+
+void
+allocprof_page_alloc (page_t *page, gfp_t gfp, unsigned int site) {
+  if (!page || (gfp & GFP_NOPROFILE)) {
+    return;
+  }
+
+  INTERRUPTS_OFF();
+  page->alloc_tag = allocprof_account(site, PAGE_SIZE << page->order);
+  INTERRUPTS_ON();
+}
+
+void
+allocprof_page_free (page_t *page) {
+  INTERRUPTS_OFF();
+  allocprof_unaccount(page->alloc_tag, PAGE_SIZE << page->order);
+  page->alloc_tag = 0;
+  INTERRUPTS_ON();
+}
+
+void
+allocprof_buddy_alloc (unsigned int addr, unsigned int site) {
+  if (!addr) {
+    return;
+  }
+
+  buddy_head_t *block = (buddy_head_t *)addr - 1;
+
+  INTERRUPTS_OFF();
+  block->alloc_tag = allocprof_account(site, blocksizes[block->level]);
+  INTERRUPTS_ON();
+}
+
+void
+allocprof_buddy_free (unsigned int addr) {
+  buddy_head_t *block = (buddy_head_t *)addr - 1;
+
+  INTERRUPTS_OFF();
+  allocprof_unaccount(block->alloc_tag, blocksizes[block->level]);
+  block->alloc_tag = 0;
+  INTERRUPTS_ON();
+}
+
+const allocprof_site_t *
+allocprof_site (unsigned short tag) {
+  if (!tag || tag > ALLOCPROF_SITES + 1) {
+    return NULL;
+  }
+
+  return &allocprof_sites[tag - 1];
+}
+
+void
+allocprof_report (void) {
+  // Copies, so the numbers are consistent even though printing them takes a while
+  allocprof_site_t top[ALLOCPROF_REPORT];
+  unsigned int     num_top    = 0;
+  unsigned int     live_bytes = 0;
+
+  INTERRUPTS_OFF();
+
+  for (unsigned int n = 0; n <= ALLOCPROF_SITES; n++) {
+    allocprof_site_t *entry  = &allocprof_sites[n];
+    live_bytes              += entry->live_bytes;
+
+    // Insert the entry into the list of the sites holding the most memory, largest first
+    unsigned int pos         = num_top;
+    for (; pos > 0 && top[pos - 1].live_bytes < entry->live_bytes; pos--) {
+      if (pos < ALLOCPROF_REPORT) {
+        top[pos] = top[pos - 1];
+      }
+    }
+    if (entry->allocs && pos < ALLOCPROF_REPORT) {
+      top[pos] = *entry;
+      if (num_top < ALLOCPROF_REPORT) {
+        num_top++;
+      }
+    }
+
+    entry->reported_allocs = entry->allocs;
+  }
+
+  unsigned int elapsed   = kstat.ticks - allocprof_report_ticks;
+  allocprof_report_ticks = kstat.ticks;
+
+  INTERRUPTS_ON();
+
+  kprintf(
+    "allocation profile: %u KB live, top %u call sites:\n%10s %10s %10s %10s %8s  %s\n",
+    live_bytes >> 10,
+    num_top,
+    "live",
+    "peak",
+    "allocs",
+    "frees",
+    "allocs/s",
+    "site"
+  );
+
+  for (unsigned int n = 0; n < num_top; n++) {
+    allocprof_site_t *entry  = &top[n];
+    unsigned int      rate   = 0;
+    unsigned int      offset = 0;
+    const char       *name   = entry->site ? elf_lookup_symbol(entry->site, &offset) : NULL;
+
+    if (elapsed) {
+      rate = (entry->allocs - entry->reported_allocs) * HZ / elapsed;
+    }
+
+    kprintf(
+      "%10u %10u %10u %10u %8u  ",
+      entry->live_bytes,
+      entry->peak_bytes,
+      entry->allocs,
+      entry->frees,
+      rate
+    );
+    if (!entry->site) {
+      kprintf("%s\n", "(other call sites)");
+    } else if (name) {
+      kprintf("%s+0x%x\n", name, offset);
+    } else {
+      kprintf("0x%08x\n", entry->site);
+    }
+  }
+}
+
+#endif /* CONFIG_ALLOC_PROFILE */
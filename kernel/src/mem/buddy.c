@@ -1,13 +1,18 @@
 #include "mem/buddy.h"
 
 #include "drivers/dev/char/tmpcon.h"
+#include "kernel.h"
+#include "kstat.h"
 #include "lib/compiler.h"
 #include "lib/string.h"
-#include "mem/alloc.h"
 #include "mem/base.h"
 #include "mem/page.h"
 
-static buddy_head_t *freelist[BUDDY_MAX_LEVEL + 1];
+/**
+ * Free lists for each level below a whole page. Whole pages are handed back to the page allocator
+ * rather than being kept on a free list.
+ */
+static buddy_head_t *freelist[BUDDY_MAX_LEVEL];
 
 /**
  * Retrieves the address of the block's buddy.
@@ -25,6 +30,29 @@ buddy_get (buddy_head_t *block) {
   return (buddy_head_t *)((unsigned int)block ^ mask);
 }
 
+/**
+ * Retrieves the page descriptor of the page that holds the given block.
+ */
+static inline page_t *
+buddy_page_of (buddy_head_t *block) {
+  return page_from_num(V2P((unsigned int)block) >> PAGE_SHIFT);
+}
+
+static void
+buddy_add_to_freelist (buddy_head_t *block, unsigned int level) {
+  block->level = level;
+  block->free  = true;
+  block->prev  = NULL;
+  block->next  = freelist[level];
+
+  if (block->next) {
+    block->next->prev = block;
+  }
+  freelist[level] = block;
+
+  kstat.buddy_free_blocks[level]++;
+}
+
 static void
 buddy_remove_from_freelist (buddy_head_t *block) {
   if (block->next) {
@@ -34,130 +62,99 @@ buddy_remove_from_freelist (buddy_head_t *block) {
 
   if (block->prev) {
     block->prev->next = block->next;
-  }
-
-  // TODO: ensure level
-  if (block == freelist[block->level]) {
+  } else {
     freelist[block->level] = block->next;
   }
+
+  block->free = false;
+  block->prev = block->next = NULL;
+
+  kstat.buddy_free_blocks[block->level]--;
 }
 
 /**
  * Given a block, deallocates that block by coalescing it into its buddy until merged into the
  * largest available block size.
+ *
+ * A buddy can be merged only if it's free and hasn't been split, which is exactly when its header
+ * carries the free tag and the same level as the block. Blocks are always aligned to their size, so
+ * the buddy's header lies within the same page and is either the start of a live block or of a free
+ * one; the check is therefore constant time regardless of how many blocks are free.
  */
 static void
 buddy_dealloc (buddy_head_t *block) {
-  int           level = block->level;
-  buddy_head_t *buddy = buddy_get(block);
+  unsigned int level = block->level;
 
-  // Find the block's buddy in the freelist
-  buddy_head_t *p     = freelist[level];
-  while (p) {
-    if (p == buddy) {
+  while (level < BUDDY_MAX_LEVEL) {
+    buddy_head_t *buddy = buddy_get(block);
+    if (!buddy->free || buddy->level != level) {
       break;
     }
-    p = p->next;
-  }
 
-  // Remove buddy from its free list
-  if (p == buddy) {
     buddy_remove_from_freelist(buddy);
 
-    // If the block can be merged to be larger...
-    if (level < BUDDY_MAX_LEVEL - 1) {
-      // If the buddy is the lower address
-      // (we address a block pair using the lower/start address, obviously)
-      if (block > buddy) {
-        buddy->level++;
-        buddy_dealloc(buddy);
-      } else {
-        // Otherwise, the block is the lower half so we start there
-        block->level++;
-        buddy_dealloc(block);
-      }
-    }
-
-    // If we're the highest supported level, we actually free the page
-    if (level == BUDDY_MAX_LEVEL - 1) {
-      unsigned int addr       = (unsigned int)block;
-      unsigned int phys_addr  = V2P(addr);
-      page_t      *page       = &free_page_list[phys_addr >> PAGE_SHIFT];
-      // Mark page as no longer belonging to a buddy
-      page->flags            &= ~PAGE_BUDDY;
-      kfree(addr);
+    // We address a merged pair using its lower/start address
+    if (buddy < block) {
+      block = buddy;
     }
+    block->level = ++level;
   }
-  // The buddy isn't free, so we can't merge.
-  // Instead, we just place the block back on the free list.
-  else {
-    buddy_head_t **p2 = &freelist[level];
-    // If no list already, make the block the head of the a list
-    if (!*p2) {
-      *p2         = block;
-      block->prev = block->next = NULL;
-    }
-    // Otherwise, prepend it to the list
-    else {
-      block->next = *p2;
-      block->prev = NULL;
-      (*p2)->prev = block;
-      *p2         = block;
-    }
+
+  // If we've coalesced back into a whole page, give it back to the page allocator
+  if (level == BUDDY_MAX_LEVEL) {
+    page_t *page  = buddy_page_of(block);
+    // Mark page as no longer belonging to a buddy
+    page->flags  &= ~PAGE_BUDDY;
+    page_release(page);
+    return;
   }
+
+  buddy_add_to_freelist(block, level);
 }
 
 static buddy_head_t *
-buddy_alloc (size_t size) {
+buddy_alloc (size_t size, gfp_t gfp) {
   buddy_head_t *block;
 
-  int level;
-  for (level = 0; blocksizes[level] < size; level++);
+  unsigned int level;
+  for (level = 0; level < BUDDY_MAX_LEVEL && blocksizes[level] < size; level++);
 
-  // If we're dealing with the max level, we need to allocate another page
-  if (level == BUDDY_MAX_LEVEL) {
-    unsigned int addr;
-    if ((addr = (unsigned int)kmalloc(PAGE_SIZE))) {
-      unsigned int phys_addr  = V2P(addr);
-      page_t      *page       = &free_page_list[phys_addr >> PAGE_SHIFT];
-      // Mark page as belonging to a buddy
-      page->flags            |= PAGE_BUDDY;
-      block                   = (buddy_head_t *)addr;
-    } else {
-      // TODO: log err
+  // Find the smallest free block that can accommodate the request
+  unsigned int order;
+  for (order = level; order < BUDDY_MAX_LEVEL && !freelist[order]; order++);
+
+  // If there are no free blocks large enough, we need to allocate another page
+  if (order == BUDDY_MAX_LEVEL) {
+    page_t *page;
+    if (!(page = page_get_free(gfp))) {
+      klogf_warn("%s(): unable to allocate a page for a block of size %d\n", __func__, size);
       return NULL;
     }
-
-    block->prev = block->next = NULL;
-    return block;
-  }
-
-  // If we have a block on the freelist, use it
-  if (freelist[level] != NULL) {
-    block = freelist[level];
+    unsigned int addr  = page->page_num << PAGE_SHIFT;
+    // Mark page as belonging to a buddy
+    page->flags       |= PAGE_BUDDY;
+    block              = (buddy_head_t *)P2V(addr);
+  } else {
+    block = freelist[order];
     buddy_remove_from_freelist(block);
   }
-  // Otherwise, we need to split something
-  else {
-    block = buddy_alloc(blocksizes[level + 1]);
-
-    // Assuming we allocated a block, put its buddy on the freelist
-    if (!block) {
-      block->level        = level;
-
-      buddy_head_t *buddy = buddy_get(block);
-      buddy->level        = level;
-      buddy->prev = buddy->next = NULL;
-      freelist[level]           = buddy;
-    }
+
+  // Split the block until it's the requested size, placing each upper half on its free list
+  while (order > level) {
+    order--;
+    buddy_add_to_freelist((buddy_head_t *)((unsigned int)block + blocksizes[order]), order);
   }
 
+  block->level = level;
+  block->free  = false;
+  block->prev = block->next = NULL;
+
   return block;
 }
 
 overridable unsigned int
-buddy_malloc (size_t size) {
-  buddy_head_t *block = buddy_alloc(size);
+buddy_malloc (size_t size, gfp_t gfp) {
+  buddy_head_t *block = buddy_alloc(size, gfp);
   // Increment the pointer by 1. This tells the compiler to increment the address by
   // sizeof(buddy_head_t), which puts us past the block metadata and in a region where user data can
   // go.
@@ -175,4 +172,5 @@ buddy_free (unsigned int addr) {
 void
 buddy_init (void) {
   kmemset(freelist, 0, sizeof(freelist));
+  kmemset(kstat.buddy_free_blocks, 0, sizeof(kstat.buddy_free_blocks));
 }
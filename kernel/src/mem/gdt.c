@@ -1,3 +1,4 @@
+#include "arch/tss.h"
 #include "arch/x86.h"
 #include "lib/constants.h"
 #include "mem/segments.h"
@@ -46,7 +47,8 @@ gdt_init (void) {
 #undef SEG_ARGS
 
   low_flags = SD_TSS_PRESENT;
-  gdt_set_entry(TSS, 0, sizeof(i386tss_t), low_flags, SD_OPSIZE32);
+  gdt_set_entry(TSS, (unsigned int)&tss, sizeof(tss) - 1, low_flags, SD_OPSIZE32);
 
   gdt_load((unsigned int)&gdtr);
+  tss_init();
 }
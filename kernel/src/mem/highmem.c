@@ -0,0 +1,97 @@
+#include "mem/highmem.h"
+
+#include "arch/interrupt.h"
+#include "arch/tlb.h"
+#include "debug/panic.h"
+#include "lib/compiler.h"
+#include "mem/base.h"
+
+/**
+ * The page mapped into each slot of the kmap window, and the number of users of each mapping. A
+ * slot keeps its mapping once its count drops to zero, until it's reused for another page.
+ */
+static page_t      *pkmap_pages[PKMAP_PAGES];
+static unsigned int pkmap_count[PKMAP_PAGES];
+
+/**
+ * The page table that maps the kmap window. Allocated statically, so that the window can be set up
+ * before the page allocator.
+ */
+static pte_t        pkmap_table[PKMAP_PAGES] aligned(PAGE_SIZE);
+
+/**
+ * Where the search for an unused slot resumes
+ */
+static unsigned int pkmap_next;
+
+static inline unsigned int
+pkmap_slot (void *addr) {
+  return ((unsigned int)addr - PKMAP_BASE) >> PAGE_SHIFT;
+}
+
+void *
+kmap (page_t *page) {
+  if (!page_is_highmem(page)) {
+    return page->data;
+  }
+
+  INTERRUPTS_OFF();
+
+  // Still mapped from an earlier call
+  if (page->data) {
+    pkmap_count[pkmap_slot(page->data)]++;
+    INTERRUPTS_ON();
+    return page->data;
+  }
+
+  unsigned int slot = pkmap_next;
+  unsigned int n;
+  for (n = 0; n < PKMAP_PAGES && pkmap_count[slot]; n++) {
+    slot = (slot + 1) & (PKMAP_PAGES - 1);
+  }
+
+  if (n == PKMAP_PAGES) {
+    kpanic("%s(): all %d kmap slots are in use\n", __func__, PKMAP_PAGES);
+  }
+  pkmap_next        = (slot + 1) & (PKMAP_PAGES - 1);
+
+  // Take the slot away from the page it was left mapped to
+  if (pkmap_pages[slot]) {
+    pkmap_pages[slot]->data = NULL;
+  }
+
+  unsigned int addr = PKMAP_BASE + (slot << PAGE_SHIFT);
+  pkmap_table[slot] = page_to_phys(page) | PAGE_PRESENT | PAGE_RW | tlb_global;
+  tlb_flush_page(addr);
+
+  pkmap_pages[slot] = page;
+  pkmap_count[slot] = 1;
+  page->data        = (char *)addr;
+
+  INTERRUPTS_ON();
+
+  return page->data;
+}
+
+void
+kunmap (page_t *page) {
+  if (!page_is_highmem(page) || !page->data) {
+    return;
+  }
+
+  INTERRUPTS_OFF();
+
+  unsigned int slot = pkmap_slot(page->data);
+  if (pkmap_count[slot]) {
+    pkmap_count[slot]--;
+  }
+
+  INTERRUPTS_ON();
+}
+
+__init void
+highmem_init (void) {
+  // The window has a page table of its own in the kernel page directory, which every process shares
+  unsigned int table               = (unsigned int)pkmap_table;
+  kpage_dir[GET_PGDIR(PKMAP_BASE)] = V2P(table) | PAGE_PRESENT | PAGE_RW;
+}
@@ -0,0 +1,394 @@
+#include "mem/ksm.h"
+
+#include "arch/interrupt.h"
+#include "arch/tlb.h"
+#include "drivers/dev/char/tmpcon.h"
+#include "kconfig.h"
+#include "kernel.h"
+#include "kstat.h"
+#include "lib/list.h"
+#include "lib/string.h"
+#include "mem/base.h"
+#include "mem/highmem.h"
+#include "mem/paging.h"
+#include "mem/slab.h"
+#include "proc/proc.h"
+#include "proc/sleep.h"
+
+typedef struct ksm_node ksm_node_t;
+
+/**
+ * A page in one of the content trees. Nodes are ordered by checksum first and by content second, so
+ * the trees stay reasonably balanced without rebalancing and most comparisons never touch the pages.
+ */
+struct ksm_node {
+  ksm_node_t  *left;
+  ksm_node_t  *right;
+  uint32_t     checksum;
+  /**
+   * The page; NULL for unstable nodes whose page has since been promoted to the stable tree
+   */
+  page_t      *page;
+  /**
+   * For unstable nodes, the user address the page was found at
+   */
+  unsigned int addr;
+  /**
+   * Link in the list of all nodes of the same tree
+   */
+  list_head_t  list;
+};
+
+/**
+ * The stable tree holds shared, write-protected frames. Each holds a reference of its own, so a
+ * frame in the tree can't change or be freed until it's pruned.
+ */
+static ksm_node_t          *stable_root;
+static list_head_t          stable_list   = list_head(stable_list);
+
+/**
+ * The unstable tree holds the candidates seen during the current sweep. Their contents may change at
+ * any time, so it's only ever used to find merge partners and is rebuilt from scratch every sweep.
+ */
+static ksm_node_t          *unstable_root;
+static list_head_t          unstable_list = list_head(unstable_list);
+
+static kmem_cache_t        *ksm_node_cache;
+
+/**
+ * Where the next pass resumes its sweep of the user address space
+ */
+static unsigned int         ksm_cursor;
+
+/**
+ * Where ksmd sleeps in between passes
+ */
+static wait_queue_head_t    ksmd_wait;
+
+/**
+ * Hashes a page's contents (FNV-1a over 32-bit words).
+ */
+static uint32_t
+ksm_checksum (const void *data) {
+  const uint32_t *words = data;
+  uint32_t        hash  = 0x811C9DC5;
+
+  for (unsigned int n = 0; n < PAGE_SIZE / sizeof(uint32_t); n++) {
+    hash = (hash ^ words[n]) * 0x01000193;
+  }
+
+  return hash;
+}
+
+static inline int
+ksm_node_cmp (ksm_node_t *node, uint32_t checksum, const void *data) {
+  if (checksum != node->checksum) {
+    return checksum < node->checksum ? -1 : 1;
+  }
+
+  if (!node->page) {
+    return 1;
+  }
+
+  int cmp = kmemcmp(data, kmap(node->page), PAGE_SIZE);
+  kunmap(node->page);
+
+  return cmp;
+}
+
+/**
+ * Looks up a page with the given contents.
+ *
+ * @param root
+ * @param checksum
+ * @param data The contents.
+ * @param link Set to the link at which a node for the contents would be inserted.
+ * @return ksm_node_t* The matching node, or NULL.
+ */
+static ksm_node_t *
+ksm_tree_search (ksm_node_t **root, uint32_t checksum, const void *data, ksm_node_t ***link) {
+  ksm_node_t **curr = root;
+
+  while (*curr) {
+    int cmp = ksm_node_cmp(*curr, checksum, data);
+    if (!cmp) {
+      return *curr;
+    }
+    curr = cmp < 0 ? &(*curr)->left : &(*curr)->right;
+  }
+
+  *link = curr;
+
+  return NULL;
+}
+
+static ksm_node_t *
+ksm_tree_insert (ksm_node_t **link, list_head_t *list, page_t *page, uint32_t checksum) {
+  ksm_node_t *node;
+  if (!(node = kmem_cache_alloc(ksm_node_cache, GFP_NOWAIT))) {
+    return NULL;
+  }
+
+  node->left     = NULL;
+  node->right    = NULL;
+  node->checksum = checksum;
+  node->page     = page;
+  node->addr     = 0;
+  list_append(&node->list, list);
+
+  *link          = node;
+
+  return node;
+}
+
+/**
+ * Removes a node from the stable tree. Stable contents are unique and never change, so the node can
+ * be found again by searching for its own contents.
+ */
+static void
+ksm_stable_erase (ksm_node_t *node) {
+  ksm_node_t **link = &stable_root;
+  void        *data = kmap(node->page);
+  while (*link != node) {
+    link = ksm_node_cmp(*link, node->checksum, data) < 0 ? &(*link)->left : &(*link)->right;
+  }
+  kunmap(node->page);
+
+  if (!node->left) {
+    *link = node->right;
+  } else if (!node->right) {
+    *link = node->left;
+  } else {
+    // Replace the node with its in-order successor
+    ksm_node_t **succ_link = &node->right;
+    while ((*succ_link)->left) {
+      succ_link = &(*succ_link)->left;
+    }
+
+    ksm_node_t *succ       = *succ_link;
+    *succ_link             = succ->right;
+    succ->left             = node->left;
+    succ->right            = node->right;
+    *link                  = succ;
+  }
+
+  list_remove(&node->list);
+  kmem_cache_free(ksm_node_cache, node);
+}
+
+/**
+ * Whether the frame is an ordinary anonymous page that only this mapping refers to
+ */
+static inline bool
+ksm_page_eligible (page_t *page) {
+  return page && page->usage_count == 1 && !page->cache
+      && !(page->flags & (PAGE_LOCKED | PAGE_BUDDY | PAGE_SLAB | PAGE_RESERVED | PAGE_COW));
+}
+
+/**
+ * Maps the stable frame in place of `page`, which holds the same contents, and releases `page`. Must
+ * be called with interrupts disabled, so that the page can't be written between being compared and
+ * being write-protected.
+ */
+static void
+ksm_merge (pte_t *pte, unsigned int addr, page_t *page, page_t *stable) {
+  stable->usage_count++;
+
+  *pte = page_to_phys(stable) | (*pte & ~PAGE_MASK & ~PAGE_RW);
+  tlb_flush_page(addr);
+
+  page_release(page);
+  kstat.ksm_pages_saved++;
+}
+
+/**
+ * Moves the page of an unstable node into the stable tree, provided it's still mapped where it was
+ * found and can still be shared. Must be called with interrupts disabled.
+ *
+ * @return page_t* The now stable page, or NULL.
+ */
+static page_t *
+ksm_promote (ksm_node_t *node, ksm_node_t **link, uint32_t checksum) {
+  page_t *page = node->page;
+  pte_t  *pte  = paging_get_pte(kpage_dir, node->addr, false);
+
+  if (!pte || (*pte & (PAGE_PRESENT | PAGE_RW)) != (PAGE_PRESENT | PAGE_RW)
+      || PTE_PAGE(*pte) != page || !ksm_page_eligible(page)) {
+    return NULL;
+  }
+
+  if (!ksm_tree_insert(link, &stable_list, page, checksum)) {
+    return NULL;
+  }
+
+  *pte               &= ~PAGE_RW;
+  tlb_flush_page(node->addr);
+
+  // The stable tree's own reference
+  page->usage_count++;
+  page->flags        |= PAGE_COW;
+  node->page          = NULL;
+
+  kstat.ksm_pages_shared++;
+
+  return page;
+}
+
+/**
+ * Looks for a page with the same contents as the one mapped by `pte` and shares the two if one is
+ * found; remembers the page as a candidate otherwise. Pages written since the last sweep are left
+ * alone, since they would most likely be unshared again right away.
+ */
+static void
+ksm_scan_page (pte_t *pte, unsigned int addr, tlb_gather_t *tlb) {
+  // Read-only mappings would be made writable by the copy-on-write fault
+  if ((*pte & (PAGE_PRESENT | PAGE_RW)) != (PAGE_PRESENT | PAGE_RW)) {
+    return;
+  }
+
+  if (*pte & PAGE_DIRTY) {
+    // Stale TLB entries would keep the CPU from setting the bit again
+    *pte &= ~PAGE_DIRTY;
+    tlb_gather_page(tlb, addr, NULL);
+    return;
+  }
+
+  page_t *page = PTE_PAGE(*pte);
+  if (!ksm_page_eligible(page)) {
+    return;
+  }
+
+  void        *data          = kmap(page);
+  uint32_t     checksum      = ksm_checksum(data);
+  ksm_node_t **stable_link   = NULL;
+  ksm_node_t **unstable_link = NULL;
+  ksm_node_t  *node;
+  page_t      *stable;
+
+  INTERRUPTS_OFF();
+
+  // The page may have changed hands while the checksum was computed
+  if (PTE_PAGE(*pte) != page || !ksm_page_eligible(page)) {
+    kunmap(page);
+    INTERRUPTS_ON();
+    return;
+  }
+
+  if ((node = ksm_tree_search(&stable_root, checksum, data, &stable_link))) {
+    ksm_merge(pte, addr, page, node->page);
+  } else if ((node = ksm_tree_search(&unstable_root, checksum, data, &unstable_link))) {
+    if (node->page != page && (stable = ksm_promote(node, stable_link, checksum))) {
+      ksm_merge(pte, addr, page, stable);
+    }
+  } else if ((node = ksm_tree_insert(unstable_link, &unstable_list, page, checksum))) {
+    node->addr = addr;
+  }
+
+  // The page may have been released by the merge, so drop the mapping before anybody can reuse it
+  kunmap(page);
+
+  INTERRUPTS_ON();
+}
+
+/**
+ * Releases the stable frames nobody maps anymore and starts a new unstable tree. Called at the end
+ * of every sweep.
+ */
+static void
+ksm_sweep_done (void) {
+  ksm_node_t *node;
+
+  INTERRUPTS_OFF();
+
+  while (!list_is_empty(&unstable_list)) {
+    node = list_first(&unstable_list, ksm_node_t, list);
+    list_remove(&node->list);
+    kmem_cache_free(ksm_node_cache, node);
+  }
+  unstable_root         = NULL;
+
+  kstat.ksm_pages_saved = 0;
+  for (list_head_t *curr = stable_list.next; curr != &stable_list;) {
+    node = list_entry(curr, ksm_node_t, list);
+    curr = curr->next;
+
+    if (node->page->usage_count > 1) {
+      kstat.ksm_pages_saved += node->page->usage_count - 2;
+      continue;
+    }
+
+    page_t *page  = node->page;
+    ksm_stable_erase(node);
+
+    page->flags  &= ~PAGE_COW;
+    page_release(page);
+    kstat.ksm_pages_shared--;
+  }
+
+  kstat.ksm_full_scans++;
+
+  INTERRUPTS_ON();
+}
+
+/**
+ * Scans up to `nr_pages` user pages, picking up where the last pass left off. A pass never crosses
+ * the end of a sweep.
+ */
+static void
+ksm_scan (unsigned int nr_pages) {
+  tlb_gather_t tlb;
+  tlb_gather_init(&tlb);
+
+  for (unsigned int scanned = 0; scanned < nr_pages;) {
+    unsigned int addr = ksm_cursor;
+    pte_t       *pte  = paging_get_pte(kpage_dir, addr, false);
+    // Skip the whole range if there's no page table for it
+    unsigned int next = pte ? addr + PAGE_SIZE : (addr & ~(PGDIR_SIZE - 1)) + PGDIR_SIZE;
+
+    if (pte) {
+      ksm_scan_page(pte, addr, &tlb);
+      scanned++;
+    }
+
+    if (next >= KERNEL_PAGE_OFFSET) {
+      ksm_cursor = 0;
+      tlb_gather_finish(&tlb);
+      ksm_sweep_done();
+      return;
+    }
+    ksm_cursor = next;
+  }
+
+  tlb_gather_finish(&tlb);
+}
+
+static void
+ksmd (void) {
+  while (true) {
+    if (kstat.param.ksm_pages_to_scan > 0) {
+      ksm_scan(kstat.param.ksm_pages_to_scan);
+    }
+
+    // Nobody wakes ksmd up; it sleeps until the timeout expires
+    sleep_on_timeout(
+      &ksmd_wait,
+      PROC_UNINTERRUPTIBLE,
+      kstat.param.ksm_sleep_ticks > 0 ? kstat.param.ksm_sleep_ticks : 1
+    );
+  }
+}
+
+void
+ksm_init (void) {
+  kstat.param.ksm_pages_to_scan = KSM_PAGES_TO_SCAN;
+  kstat.param.ksm_sleep_ticks   = KSM_SLEEP_TICKS;
+
+  if (!(ksm_node_cache = kmem_cache_create("ksm_node", sizeof(ksm_node_t), 0, NULL))) {
+    klogf_warn("%s(): unable to create the node cache\n", __func__);
+    return;
+  }
+
+  if (!kproc_create("ksmd", ksmd)) {
+    klogf_warn("%s(): unable to start ksmd\n", __func__);
+  }
+}
@@ -0,0 +1,123 @@
+#include "mem/kswapd.h"
+
+#include "arch/interrupt.h"
+#include "drivers/dev/char/tmpcon.h"
+#include "kernel.h"
+#include "kstat.h"
+#include "lib/compiler.h"
+#include "mem/page.h"
+#include "proc/proc.h"
+#include "proc/sleep.h"
+
+static void kswapd(void);
+
+/**
+ * The list of registered shrinkers
+ */
+static list_head_t shrinkers = list_head(shrinkers);
+
+/**
+ * The kswapd process, once started
+ */
+static proc_t *kswapd_proc;
+
+/**
+ * Where kswapd sleeps until memory runs low again
+ */
+static wait_queue_head_t kswapd_wait;
+
+/**
+ * Asks the registered shrinkers to release up to `nr_pages` pages, stopping as soon as enough have
+ * been released.
+ */
+static int
+shrinkers_run (int nr_pages) {
+  int         released = 0;
+  shrinker_t *shrinker;
+
+  list_foreach_entry(shrinker, &shrinkers, list) {
+    released += shrinker->shrink(nr_pages - released);
+    if (released >= nr_pages) {
+      break;
+    }
+  }
+
+  return released;
+}
+
+/**
+ * Reclaims memory until the number of free pages reaches the high watermark, or until there's
+ * nothing left to reclaim. Free pages that still hold page cache contents already count as free,
+ * so only the shrinkers can make any progress.
+ *
+ * @return int The number of pages actually gained.
+ */
+static int
+kswapd_reclaim (void) {
+  int reclaimed = 0;
+
+  while (kstat.num_free_pages < kstat.high_free_pages) {
+    int before = kstat.num_free_pages;
+
+    // What a shrinker releases only reaches the free lists once nothing else holds it, so count the
+    // change in free pages rather than what the shrinkers report
+    if (!shrinkers_run(kstat.high_free_pages - before)) {
+      break;
+    }
+
+    int gained = kstat.num_free_pages - before;
+    if (gained <= 0) {
+      break;
+    }
+
+    reclaimed += gained;
+  }
+
+  return reclaimed;
+}
+
+static void
+kswapd (void) {
+  while (true) {
+    kstat.pages_reclaimed = kswapd_reclaim();
+
+    // Let anyone waiting for free pages have another go, even if nothing was reclaimed, so that they
+    // can fail rather than wait forever. Waking them up may reschedule, and an allocator running in
+    // between would find kswapd still running and not wake it up before waiting itself, so nothing
+    // may run until kswapd is asleep.
+    INTERRUPTS_OFF();
+
+    wakeup_all(&page_wait);
+    sleep_on(&kswapd_wait, PROC_UNINTERRUPTIBLE);
+
+    INTERRUPTS_ON();
+  }
+}
+
+overridable void
+shrinker_register (shrinker_t *shrinker) {
+  INTERRUPTS_OFF();
+  list_append(&shrinker->list, &shrinkers);
+  INTERRUPTS_ON();
+}
+
+void
+shrinker_unregister (shrinker_t *shrinker) {
+  INTERRUPTS_OFF();
+  list_remove(&shrinker->list);
+  INTERRUPTS_ON();
+}
+
+void
+kswapd_wakeup (void) {
+  if (kswapd_proc && kswapd_proc->state == PROC_SLEEPING) {
+    wakeup(&kswapd_wait);
+  }
+}
+
+void
+kswapd_init (void) {
+  if (!(kswapd_proc = kproc_create("kswapd", kswapd))) {
+    klogf_warn("%s(): unable to start kswapd\n", __func__);
+  }
+}
@@ -1,48 +1,72 @@
 #include "mem/layout.h"
 
+#include "arch/cpu.h"
+#include "arch/tlb.h"
+#include "arch/x86.h"
 #include "debug/panic.h"
 #include "drivers/dev/char/tmpcon.h"
 #include "drivers/dev/char/video.h"
 #include "init/bios.h"
 #include "kconfig.h"
 #include "kernel.h"
+#include "lib/compiler.h"
 #include "lib/math.h"
 #include "lib/string.h"
 #include "mem/buddy.h"
+#include "mem/highmem.h"
+#include "mem/memblock.h"
 #include "mem/page.h"
 #include "mem/segments.h"
+#include "mem/slab.h"
+#include "mem/swap.h"
+#include "mem/vmalloc.h"
 #include "proc/proc.h"
 
-unsigned int *kpage_dir;
+pte_t *kpage_dir;
+#ifdef CONFIG_PAE
+uint64_t kpage_pdpt[PGDIR_PAGES] aligned(32);
+#endif
 
-unsigned int free_page_list_size = 0;
-page_t      *free_page_list;
+page_t      *memmap_sections[MEMMAP_MAX_SECTIONS];
+unsigned int memmap_num_pages = 0;
 
-unsigned int page_cache_size = 0;
-page_t     **page_cache;
+unsigned int highmem_start    = 0;
+unsigned int highmem_end      = 0;
+
+unsigned int         page_cache_size = 0;
+page_cache_entry_t **page_cache;
 
 unsigned int proc_list_size = 0;
 
-static inline unsigned int
+/**
+ * Allocates physical memory for a boot-time structure from the boot allocator.
+ *
+ * @return unsigned int The physical address of the zeroed allocation.
+ */
+static __init unsigned int
+mem_assign_physical (unsigned int size, char *id) {
+  unsigned int addr = memblock_alloc(PAGE_ALIGN(size), PAGE_SIZE);
+  if (!addr) {
+    kpanic("Not enough memory for %s\n", id);
+  }
+  kmemset((void *)addr, 0, PAGE_ALIGN(size));
+
+  return addr;
+}
+
+static __init unsigned int
 mem_assign (unsigned int size, void **ptr, char *id) {
   unsigned int aligned_size = PAGE_ALIGN(size);
-  if (!bios_mmap_has_addr(V2P(real_last_addr) + aligned_size)) {
+  unsigned int addr         = memblock_alloc(aligned_size, PAGE_SIZE);
+  if (!addr) {
     kpanic("Not enough memory for %s\n", id);
   }
-  *ptr            = (void *)real_last_addr;
-  real_last_addr += aligned_size;
+  *ptr = (void *)P2V(addr);
 
   return aligned_size;
 }
 
-static inline void
-mem_assign_cleared (unsigned int **ptr, unsigned int size) {
-  *ptr = (unsigned int *)real_last_addr;
-  kmemset(*ptr, 0, size);
-  real_last_addr += size;
-}
-
-unsigned int
+__init unsigned int
 mem_init_temporary (unsigned int magic, unsigned int mbi_ptr) {
   unsigned int num_pages = DEFAULT_NUM_PAGES;
   if (magic == MULTIBOOT_BOOTLOADER_MAGIC) {
@@ -53,64 +77,140 @@ mem_init_temporary (unsigned int magic, unsigned int mbi_ptr) {
     }
   }
 
-  unsigned int addr = PAGE_ALIGN(KERNEL_PAGE_OFFSET + (num_pages * 1024) - num_pages);
-  kpage_dir         = (unsigned int *)addr;
-  kmemset(kpage_dir, 0, PAGE_SIZE);
+  unsigned int num_entries = num_pages / 4;
+  unsigned int table_size  = num_entries * sizeof(pte_t);
+
+  // The page directory and its page tables sit at the top of memory, preceded by the page directory
+  // pointer table with PAE
+  unsigned int addr = (KERNEL_PAGE_OFFSET + (num_pages * 1024) - table_size) & PAGE_MASK;
+  addr             -= PGDIR_PAGES * PAGE_SIZE;
+#ifdef CONFIG_PAE
+  uint64_t *pdpt = (uint64_t *)(addr - PAGE_SIZE);
+  kmemset(pdpt, 0, PAGE_SIZE);
+#endif
+  kpage_dir = (pte_t *)addr;
+  kmemset(kpage_dir, 0, PGDIR_PAGES * PAGE_SIZE);
 
-  addr                     += PAGE_SIZE;
-  unsigned int *page_table  = (unsigned int *)addr;
-  kmemset(page_table, 0, num_pages);
+  addr              += PGDIR_PAGES * PAGE_SIZE;
+  pte_t *page_table  = (pte_t *)addr;
+  kmemset(page_table, 0, table_size);
 
-  for (unsigned int idx = 0; idx < num_pages / sizeof(unsigned int); idx++) {
-    page_table[idx] = (idx << PAGE_SHIFT) | PAGE_PRESENT | PAGE_RW;
+  // If the CPU supports it, map whole 4 MB chunks with a single page directory entry each. This must
+  // be enabled before paging is turned on.
+  unsigned int num_large    = 0;
+  if (cpu_has_pse()) {
+    cr4_set(cr4_get() | CR4_PSE);
+    num_large = num_entries / PAGES_PER_TABLE;
+  }
+
+  for (unsigned int kpage_dir_idx = 0; kpage_dir_idx < num_large; kpage_dir_idx++) {
+    unsigned int page_value = (kpage_dir_idx << PGDIR_SHIFT) | PAGE_PRESENT | PAGE_RW | PAGE_LARGE;
+    kpage_dir[kpage_dir_idx]                                 = page_value;
+    kpage_dir[kpage_dir_idx + GET_PGDIR(KERNEL_PAGE_OFFSET)] = page_value;
+  }
 
-    if (!(idx % 1024)) {
-      unsigned int kpage_dir_idx = idx / 1024;
+  // Whatever doesn't fill a 4 MB page (or everything, without PSE) is mapped with page tables
+  unsigned int base = num_large * PAGES_PER_TABLE;
+  for (unsigned int idx = base; idx < num_entries; idx++) {
+    page_table[idx - base] = (idx << PAGE_SHIFT) | PAGE_PRESENT | PAGE_RW;
 
-      unsigned int page_value
-        = (unsigned int)(addr + (PAGE_SIZE * kpage_dir_idx) + GDT_BASE) | PAGE_PRESENT | PAGE_RW;
+    if (!(idx % PAGES_PER_TABLE)) {
+      unsigned int kpage_dir_idx   = idx / PAGES_PER_TABLE;
+
+      unsigned int page_table_addr = addr + (PAGE_SIZE * (kpage_dir_idx - num_large));
+      unsigned int page_value      = (page_table_addr + GDT_BASE) | PAGE_PRESENT | PAGE_RW;
       kpage_dir[kpage_dir_idx]                                 = page_value;
       kpage_dir[kpage_dir_idx + GET_PGDIR(KERNEL_PAGE_OFFSET)] = page_value;
     }
   }
 
+#ifdef CONFIG_PAE
+  // Page directory pointer table entries only take the present bit
+  for (unsigned int n = 0; n < PGDIR_PAGES; n++) {
+    pdpt[n] = ((unsigned int)kpage_dir + (n * PAGE_SIZE) + GDT_BASE) | PAGE_PRESENT;
+  }
+  cr4_set(cr4_get() | CR4_PAE);
+
+  return (unsigned int)pdpt - KERNEL_PAGE_OFFSET;
+#else
   return (unsigned int)kpage_dir - KERNEL_PAGE_OFFSET;
+#endif
+}
+
+/**
+ * Allocates the page descriptors for a range of highmem, unless its sections already have them.
+ */
+static __init void
+mem_assign_highmem (unsigned int from, unsigned int to, void *ctx) {
+  for (unsigned int n = from >> SECTION_SHIFT; (n << SECTION_SHIFT) < to; n++) {
+    if (!memmap_sections[n]) {
+      mem_assign(PAGES_PER_SECTION * sizeof(page_t), (void **)&memmap_sections[n], "memmap");
+    }
+  }
 }
 
 // Identity maps kernel addresses. See https://stackoverflow.com/a/36872282
-void
+__init void
 mem_init (void) {
+  // PSE was enabled by `mem_init_temporary` if the CPU supports it, in which case the direct map is
+  // built out of 4 MB pages and page tables are only needed for the ragged tail
+  unsigned int num_large = (cr4_get() & CR4_PSE) ? kstat.physical_pages / PAGES_PER_TABLE : 0;
+  unsigned int base      = num_large * PAGES_PER_TABLE;
+  unsigned int num_small = kstat.physical_pages - base;
   unsigned int physical_page_tables
-    = (kstat.physical_pages / 1024) + ((kstat.physical_pages % 1024) ? 1 : 0);
+    = (num_small / PAGES_PER_TABLE) + ((num_small % PAGES_PER_TABLE) ? 1 : 0);
+
+  // Carve the boot allocator's view of memory out of the BIOS memory map. Paging is still running on
+  // the temporary page directory, which identity maps all of memory, so the permanent page
+  // directory and its tables can be set up through their physical addresses.
+  unsigned int limit      = kstat.physical_pages << PAGE_SHIFT;
+  unsigned int boot_pgdir = cr3_get() & PAGE_MASK;
+  memblock_init(limit);
 
-  real_last_addr = PAGE_ALIGN(real_last_addr);
-  mem_assign_cleared(&kpage_dir, PAGE_SIZE);
+  // With PAE, the four page directories are allocated back to back so they can be indexed as one
+  kpage_dir         = (pte_t *)mem_assign_physical(PGDIR_PAGES * PAGE_SIZE, "kpage_dir");
+  pte_t *page_table = (pte_t *)mem_assign_physical(
+    physical_page_tables * PAGE_SIZE,
+    "page tables"
+  );
 
-  unsigned int *page_table = (unsigned int *)real_last_addr;
-  mem_assign_cleared(&page_table, physical_page_tables * PAGE_SIZE);
+  // The direct map is the same in every address space, so its TLB entries are global and survive
+  // context switches
+  tlb_init();
+
+  for (unsigned int n = 0; n < num_large; n++) {
+    kpage_dir[GET_PGDIR(KERNEL_PAGE_OFFSET) + n]
+      = (n << PGDIR_SHIFT) | PAGE_PRESENT | PAGE_RW | PAGE_LARGE | tlb_global;
+  }
 
-  for (unsigned int n = 0; n < kstat.physical_pages; n++) {
-    page_table[n] = (n << PAGE_SHIFT) | PAGE_PRESENT | PAGE_RW;
-    if (!(n % 1024)) {
-      kpage_dir[GET_PGDIR(KERNEL_PAGE_OFFSET) + (n / 1024)]
-        = (unsigned int)&page_table[n] | PAGE_PRESENT | PAGE_RW;
+  for (unsigned int n = base; n < kstat.physical_pages; n++) {
+    page_table[n - base] = (n << PAGE_SHIFT) | PAGE_PRESENT | PAGE_RW | tlb_global;
+    if (!(n % PAGES_PER_TABLE)) {
+      kpage_dir[GET_PGDIR(KERNEL_PAGE_OFFSET) + (n / PAGES_PER_TABLE)]
+        = (unsigned int)&page_table[n - base] | PAGE_PRESENT | PAGE_RW;
     }
   }
 
+#ifdef CONFIG_PAE
+  for (unsigned int n = 0; n < PGDIR_PAGES; n++) {
+    kpage_pdpt[n] = ((unsigned int)kpage_dir + (n * PAGE_SIZE)) | PAGE_PRESENT;
+  }
+#endif
+
+  unsigned int pgdir_addr = (unsigned int)kpage_dir;
+  kpage_dir               = (pte_t *)P2V(pgdir_addr);
+
   page_activate_kpage_dir();
   // We can now use virtual addresses
   global_vga_con->buffer = (uint16_t *)P2V(VGA_ADDR);
 
-  kpage_dir              = (unsigned int *)P2V((unsigned int)kpage_dir);
-  real_last_addr         = P2V(real_last_addr);
-
-  proc_list_size         = mem_assign(sizeof(proc_t) * NUM_PROCS, (void **)&proc_list, "proc_list");
+  // The temporary page directory is no longer in use
+  if (boot_pgdir < limit) {
+    memblock_free(boot_pgdir, limit - boot_pgdir);
+  }
 
-  video_scrollback_history_buffer = (short int *)real_last_addr;
-  real_last_addr
-    += (video.columns * video.lines * VIDEO_MAX_SCROLLBACK_SCREENS * 2 * sizeof(short int));
+  proc_list_size = mem_assign(sizeof(proc_t) * NUM_PROCS, (void **)&proc_list, "proc_list");
 
-  // The last thing must be the page table structure itself...
   unsigned int n  = (kstat.physical_pages * PAGE_HASH_PER_10K) / 10000;
   // 1 page for the hash table as minimum
   n               = max(n, 1);
@@ -118,9 +218,76 @@ mem_init (void) {
 
   page_cache_size = mem_assign(n * PAGE_SIZE, (void **)&page_cache, "page_cache");
 
-  free_page_list_size
-    = mem_assign(kstat.physical_pages * sizeof(page_t), (void **)&free_page_list, "free_page_list");
+  // Page descriptors are only allocated for the sections that hold usable memory, so large holes in
+  // the memory map don't cost anything
+  memmap_num_pages = max(kstat.physical_pages, highmem_end);
+  for (unsigned int n = 0; n * PAGES_PER_SECTION < kstat.physical_pages; n++) {
+    unsigned int section_base = n << (SECTION_SHIFT + PAGE_SHIFT);
+    unsigned int section_size = PAGES_PER_SECTION << PAGE_SHIFT;
+    if (memblock_is_memory(section_base, section_size)) {
+      mem_assign(PAGES_PER_SECTION * sizeof(page_t), (void **)&memmap_sections[n], "memmap");
+    }
+  }
+  // Highmem lies beyond the boot allocator's view of memory, so it's taken from the memory map
+  bios_mmap_foreach_available(highmem_start, highmem_end, &mem_assign_highmem, NULL);
+
+  // Color the free lists by the L2 cache's way size, so that hot structures don't keep ending up in
+  // the same cache sets
+  unsigned int way_size = cpu_l2_way_size();
+  page_colors           = way_size > PAGE_SIZE ? way_size / PAGE_SIZE : 1;
+
+  highmem_init();
 
+  uint64_t start         = rdtsc();
   page_init(kstat.physical_pages);
+  kstat.page_init_cycles = rdtsc() - start;
+
   buddy_init();
+  slab_init();
+  page_cache_init();
+  vmalloc_init();
+
+  // Doesn't need to be physically contiguous, so there's no point carving it out at boot
+  unsigned int scrollback_size
+    = video.columns * video.lines * VIDEO_MAX_SCROLLBACK_SCREENS * 2 * sizeof(short int);
+  if (!(video_scrollback_history_buffer = vmalloc(scrollback_size))) {
+    kpanic("Not enough memory for %s\n", "video_scrollback_history_buffer");
+  }
+
+  swap_init();
+}
+
+/**
+ * Hands the pages in the physical range [base, end) back to the page allocator.
+ *
+ * @return unsigned int The number of bytes released.
+ */
+static unsigned int
+mem_free_range (unsigned int base, unsigned int end) {
+  unsigned int freed = 0;
+
+  for (unsigned int addr = PAGE_ALIGN(base); addr + PAGE_SIZE <= end; addr += PAGE_SIZE) {
+    page_t *page      = page_from_num(addr >> PAGE_SHIFT);
+    page->flags       = 0;
+    page->order       = 0;
+    page->data        = (char *)P2V(addr);
+    page->usage_count = 1;
+    page_release(page);
+
+    kstat.kernel_reserved--;
+    kstat.total_mem_pages++;
+    freed += PAGE_SIZE;
+  }
+
+  return freed;
+}
+
+void
+mem_free_init (void) {
+  // `.setup` is linked at its physical address, the init sections in the higher half
+  unsigned int start    = (unsigned int)init_start;
+  unsigned int end      = (unsigned int)init_end;
+
+  kstat.init_reclaimed  = mem_free_range(KERNEL_PHYSICAL_BASE, (unsigned int)setup_end);
+  kstat.init_reclaimed += mem_free_range(V2P(start), V2P(end));
 }
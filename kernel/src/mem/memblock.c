@@ -0,0 +1,255 @@
+#include "mem/memblock.h"
+
+#include "arch/x86.h"
+#include "init/bios.h"
+#include "kernel.h"
+#include "lib/compiler.h"
+#include "lib/string.h"
+#include "mem/base.h"
+#include "mem/page.h"
+
+/**
+ * The page the kernel stack grows down from during boot
+ */
+#define BOOT_STACK_PAGE 0x0000F000
+
+memblock_type_t memblock_memory;
+memblock_type_t memblock_reserved;
+
+/**
+ * Parameters and result of the search performed by `memblock_alloc`
+ */
+typedef struct {
+  unsigned int size;
+  unsigned int align;
+  unsigned int addr;
+} memblock_alloc_ctx_t;
+
+static void
+region_insert (memblock_type_t *type, unsigned int idx) {
+  kmemmove(
+    &type->regions[idx + 1],
+    &type->regions[idx],
+    (type->count - idx) * sizeof(memblock_region_t)
+  );
+  type->count++;
+}
+
+static void
+region_delete (memblock_type_t *type, unsigned int idx, unsigned int n) {
+  kmemmove(
+    &type->regions[idx],
+    &type->regions[idx + n],
+    (type->count - idx - n) * sizeof(memblock_region_t)
+  );
+  type->count -= n;
+}
+
+/**
+ * Adds [base, end) to the set, merging it with every region it overlaps or touches.
+ */
+static retval_t
+region_add (memblock_type_t *type, unsigned int base, unsigned int end) {
+  if (base >= end) {
+    return RET_OK;
+  }
+
+  // Find the first region that could be merged with the new one
+  unsigned int first = 0;
+  while (first < type->count && type->regions[first].end < base) {
+    first++;
+  }
+
+  // ...and extend the new region over every region it touches
+  unsigned int last = first;
+  while (last < type->count && type->regions[last].base <= end) {
+    if (type->regions[last].base < base) {
+      base = type->regions[last].base;
+    }
+    if (type->regions[last].end > end) {
+      end = type->regions[last].end;
+    }
+    last++;
+  }
+
+  if (last == first) {
+    if (type->count == MEMBLOCK_MAX_REGIONS) {
+      return RET_FAIL;
+    }
+    region_insert(type, first);
+  } else if (last > first + 1) {
+    region_delete(type, first + 1, last - first - 1);
+  }
+
+  type->regions[first].base = base;
+  type->regions[first].end  = end;
+
+  return RET_OK;
+}
+
+/**
+ * Removes [base, end) from the set, trimming or splitting the regions it overlaps.
+ */
+static retval_t
+region_remove (memblock_type_t *type, unsigned int base, unsigned int end) {
+  for (unsigned int n = 0; n < type->count; n++) {
+    memblock_region_t *r = &type->regions[n];
+    if (r->end <= base || r->base >= end) {
+      continue;
+    }
+
+    // The removed range lies strictly inside the region, so split it in two
+    if (r->base < base && r->end > end) {
+      if (type->count == MEMBLOCK_MAX_REGIONS) {
+        return RET_FAIL;
+      }
+      region_insert(type, n + 1);
+      type->regions[n + 1].base = end;
+      type->regions[n + 1].end  = type->regions[n].end;
+      type->regions[n].end      = base;
+      break;
+    }
+
+    if (r->base < base) {
+      r->end = base;
+    } else if (r->end > end) {
+      r->base = end;
+    } else {
+      region_delete(type, n, 1);
+      n--;
+    }
+  }
+
+  return RET_OK;
+}
+
+/**
+ * Records the highest suitably aligned address at which the allocation fits in [base, end).
+ */
+static void
+alloc_candidate (unsigned int base, unsigned int end, void *ctx) {
+  memblock_alloc_ctx_t *alloc = ctx;
+
+  if (end - base < alloc->size) {
+    return;
+  }
+
+  unsigned int addr = (end - alloc->size) & ~(alloc->align - 1);
+  // Address 0 doubles as the failure value, so it's never handed out
+  if (addr >= base && addr > alloc->addr) {
+    alloc->addr = addr;
+  }
+}
+
+retval_t
+memblock_add (unsigned int base, unsigned int size) {
+  return region_add(&memblock_memory, base, base + size);
+}
+
+retval_t
+memblock_reserve (unsigned int base, unsigned int size) {
+  return region_add(&memblock_reserved, base, base + size);
+}
+
+retval_t
+memblock_free (unsigned int base, unsigned int size) {
+  return region_remove(&memblock_reserved, base, base + size);
+}
+
+unsigned int
+memblock_alloc (unsigned int size, unsigned int align) {
+  memblock_alloc_ctx_t alloc = {.size = size, .align = align ? align : 1, .addr = 0};
+
+  memblock_foreach_free(&alloc_candidate, &alloc);
+
+  if (alloc.addr && memblock_reserve(alloc.addr, size) == RET_FAIL) {
+    return 0;
+  }
+
+  return alloc.addr;
+}
+
+bool
+memblock_is_memory (unsigned int base, unsigned int size) {
+  for (unsigned int n = 0; n < memblock_memory.count; n++) {
+    if (memblock_memory.regions[n].base < base + size && memblock_memory.regions[n].end > base) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void
+memblock_foreach_free (memblock_range_fn fn, void *ctx) {
+  unsigned int res = 0;
+
+  for (unsigned int n = 0; n < memblock_memory.count; n++) {
+    unsigned int base = memblock_memory.regions[n].base;
+    unsigned int end  = memblock_memory.regions[n].end;
+
+    // Skip reservations that end before this region
+    while (res < memblock_reserved.count && memblock_reserved.regions[res].end <= base) {
+      res++;
+    }
+
+    // Walk the gaps between the reservations that overlap this region
+    for (unsigned int r = res; r < memblock_reserved.count; r++) {
+      memblock_region_t *reserved = &memblock_reserved.regions[r];
+      if (reserved->base >= end) {
+        break;
+      }
+
+      if (reserved->base > base) {
+        fn(base, reserved->base, ctx);
+      }
+      if (reserved->end > base) {
+        base = reserved->end;
+      }
+    }
+
+    if (base < end) {
+      fn(base, end, ctx);
+    }
+  }
+}
+
+__init void
+memblock_init (unsigned int limit) {
+  kmemset(&memblock_memory, 0, sizeof(memblock_memory));
+  kmemset(&memblock_reserved, 0, sizeof(memblock_reserved));
+
+  // Start with every available range below 4GB...
+  bios_mmap_t *bmm = &kernel_mmap[0];
+  for (unsigned int n = 0; n < NUM_BIOS_MMAP_ENTRIES; n++, bmm++) {
+    if (bmm->to && bmm->type == MULTIBOOT_MEMORY_AVAILABLE && !bmm->from_high && !bmm->to_high) {
+      unsigned int base = PAGE_ALIGN(bmm->from);
+      unsigned int end  = bmm->to & PAGE_MASK;
+      if (base < end) {
+        memblock_add(base, end - base);
+      }
+    }
+  }
+
+  // ...then carve out anything the map also reports as reserved, since entries may overlap
+  bmm = &kernel_mmap[0];
+  for (unsigned int n = 0; n < NUM_BIOS_MMAP_ENTRIES; n++, bmm++) {
+    if (bmm->to && bmm->type == MULTIBOOT_MEMORY_RESERVED && !bmm->from_high && !bmm->to_high) {
+      region_remove(&memblock_memory, bmm->from & PAGE_MASK, PAGE_ALIGN(bmm->to));
+    }
+  }
+
+  // Memory that isn't permanently mapped is of no use to us
+  region_remove(&memblock_memory, limit, ~0U);
+
+  // The kernel image, along with everything the bootloader placed right after it
+  memblock_reserve(KERNEL_PHYSICAL_BASE, PAGE_ALIGN(real_last_addr) - KERNEL_PHYSICAL_BASE);
+  memblock_reserve(BOOT_STACK_PAGE, PAGE_SIZE);
+
+  // The temporary page directory and its page tables sit at the top of memory and are in use until
+  // the permanent page directory is activated
+  unsigned int boot_pgdir = cr3_get() & PAGE_MASK;
+  if (boot_pgdir < limit) {
+    memblock_reserve(boot_pgdir, limit - boot_pgdir);
+  }
+}
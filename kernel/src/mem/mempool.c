@@ -0,0 +1,97 @@
+#include "mem/mempool.h"
+
+#include "arch/interrupt.h"
+#include "lib/string.h"
+#include "mem/alloc.h"
+#include "proc/sleep.h"
+
+retval_t
+mempool_init (mempool_t *pool, unsigned int min_nr, kmem_cache_t *cache) {
+  kmemset(pool, 0, sizeof(mempool_t));
+  pool->cache  = cache;
+  pool->min_nr = min_nr;
+
+  if (!(pool->elements = (void **)kmalloc(min_nr * sizeof(void *), GFP_KERNEL))) {
+    return RET_FAIL;
+  }
+
+  while (pool->curr_nr < min_nr) {
+    void *obj = kmem_cache_alloc(cache, GFP_KERNEL);
+    if (!obj) {
+      mempool_exit(pool);
+      return RET_FAIL;
+    }
+    pool->elements[pool->curr_nr++] = obj;
+  }
+
+  return RET_OK;
+}
+
+void
+mempool_exit (mempool_t *pool) {
+  while (pool->curr_nr) {
+    kmem_cache_free(pool->cache, pool->elements[--pool->curr_nr]);
+  }
+
+  kfree((unsigned int)pool->elements);
+  pool->elements = NULL;
+}
+
+/**
+ * Pops an object off the reserve, if there is one.
+ */
+static void *
+mempool_take (mempool_t *pool) {
+  void *obj = NULL;
+
+  INTERRUPTS_OFF();
+  if (pool->curr_nr) {
+    obj = pool->elements[--pool->curr_nr];
+  }
+  INTERRUPTS_ON();
+
+  return obj;
+}
+
+void *
+mempool_alloc (mempool_t *pool, gfp_t gfp) {
+  for (;;) {
+    // Never block in the cache; if it can't grow right now, the reserve is what we're here for
+    void *obj = kmem_cache_alloc(pool->cache, gfp & ~GFP_WAIT);
+    if (obj || (obj = mempool_take(pool))) {
+      return obj;
+    }
+
+    if (!(gfp & GFP_WAIT)) {
+      return NULL;
+    }
+
+    // Objects in flight are bound to come back to the pool eventually. Each one wakes up a single
+    // waiter, and interrupts stay off so it can't come back before we're queued.
+    INTERRUPTS_OFF();
+    if (!pool->curr_nr) {
+      sleep_on_exclusive(&pool->wait, PROC_UNINTERRUPTIBLE);
+    }
+    INTERRUPTS_ON();
+  }
+}
+
+void
+mempool_free (mempool_t *pool, void *obj) {
+  if (!obj) {
+    return;
+  }
+
+  INTERRUPTS_OFF();
+  if (pool->curr_nr < pool->min_nr) {
+    pool->elements[pool->curr_nr++] = obj;
+    obj                             = NULL;
+  }
+  INTERRUPTS_ON();
+
+  if (obj) {
+    kmem_cache_free(pool->cache, obj);
+  } else {
+    wakeup(&pool->wait);
+  }
+}
@@ -2,170 +2,487 @@
 
 #include "arch/interrupt.h"
 #include "debug/panic.h"
+#include "drivers/dev/char/tmpcon.h"
 #include "init/bios.h"
 #include "kconfig.h"
 #include "kernel.h"
 #include "kstat.h"
 #include "lib/compiler.h"
+#include "lib/hash.h"
+#include "lib/math.h"
 #include "lib/string.h"
+#include "mem/allocprof.h"
 #include "mem/base.h"
+#include "mem/highmem.h"
+#include "mem/kswapd.h"
+#include "mem/memblock.h"
+#include "mem/slab.h"
 #include "proc/sleep.h"
 
-#define NUM_CACHED_PAGES (page_cache_size / sizeof(unsigned int))
-#define PAGE_CACHE_HASH(inode, offset) \
-  (((unsigned int)(inode) ^ (unsigned int)(offset)) % (NUM_CACHED_PAGES))
+/**
+ * Free single pages, one list per color. Uncached pages are kept at the head of each list and cached
+ * ones at the tail, so that cached pages are reclaimed in LRU order.
+ */
+page_t      *free_page_lists[PAGE_MAX_COLORS];
+
+unsigned int page_colors = 1;
+
+wait_queue_head_t page_wait;
+
+/**
+ * log2(page_colors)
+ */
+static unsigned int page_color_bits;
+
+/**
+ * The color handed out next to allocations without a preference
+ */
+static unsigned int page_next_color;
+
+/**
+ * The cache from which the metadata of cached pages is allocated
+ */
+static kmem_cache_t *page_cache_entries;
+
+/**
+ * The page cache hash table has 2^page_cache_bits buckets
+ */
+static unsigned int  page_cache_bits;
+
+/**
+ * The block backing the hash table once it has outgrown the table allocated at boot
+ */
+static page_t       *page_cache_block;
+
+/**
+ * Free lists of blocks of 2^order physically contiguous pages, indexed by order. Single free pages
+ * are kept on `free_page_lists` instead; `free_area[0]` is unused.
+ */
+static page_t *free_area[PAGE_MAX_ORDER + 1];
+
+/**
+ * Free pages that have already been zeroed by the idle process. They count as free pages, but aren't
+ * considered for coalescing until they're allocated and released again.
+ */
+static page_t *zeroed_list_head;
+
+/**
+ * Free highmem pages. Highmem is only ever handed out a page at a time, so its pages are neither
+ * colored nor coalesced.
+ */
+static page_t *free_highmem_list;
 
-page_t *free_page_list_head;
-
-static inline void
-flag_as_kreserved (page_t *page) {
-  page->flags = PAGE_RESERVED;
-  kstat.kernel_reserved++;
+static void
+free_area_insert (page_t **head, page_t *pg) {
+  if (!*head) {
+    pg->prev_free = pg->next_free = pg;
+    *head                         = pg;
+  } else {
+    pg->next_free                 = *head;
+    pg->prev_free                 = (*head)->prev_free;
+    (*head)->prev_free->next_free = pg;
+    (*head)->prev_free            = pg;
+  }
 }
 
-static inline void
-flag_as_reserved (page_t *page) {
-  page->flags = PAGE_RESERVED;
-  kstat.physical_reserved++;
+static void
+free_area_remove (page_t **head, page_t *pg) {
+  if (pg->next_free == pg) {
+    *head = NULL;
+    return;
+  }
+
+  pg->prev_free->next_free = pg->next_free;
+  pg->next_free->prev_free = pg->prev_free;
+
+  if (pg == *head) {
+    *head = pg->next_free;
+  }
 }
 
-static inline unsigned int
-page_mem_assign (unsigned int size, void **ptr, char *id) {
-  unsigned int aligned_size = PAGE_ALIGN(size);
-  if (!bios_mmap_has_addr(V2P(real_last_addr) + aligned_size)) {
-    kpanic("Not enough memory for %s\n", id);
+static inline page_t **
+free_page_list (page_t *page) {
+  if (page_is_highmem(page)) {
+    return &free_highmem_list;
   }
-  *ptr            = (void *)real_last_addr;
-  real_last_addr += aligned_size;
 
-  return aligned_size;
+  return &free_page_lists[page->page_num & (page_colors - 1)];
+}
+
+/**
+ * Retrieves the free page counter the page counts towards. Free highmem is counted separately,
+ * since it can't satisfy most allocations.
+ */
+static inline int *
+free_page_count (page_t *page) {
+  return page_is_highmem(page) ? &kstat.num_free_highmem : &kstat.num_free_pages;
 }
 
 static void
 insert_into_free_list (page_t *pg) {
-  if (!free_page_list_head) {
-    pg->prev_free = pg->next_free = pg;
-    free_page_list_head           = pg;
-  } else {
-    pg->next_free                             = free_page_list_head;
-    pg->prev_free                             = free_page_list_head->prev_free;
-    free_page_list_head->prev_free->next_free = pg;
-    free_page_list_head->prev_free            = pg;
-  }
-
-  kstat.num_free_pages++;
+  free_area_insert(free_page_list(pg), pg);
+  (*free_page_count(pg))++;
 }
 
 static void
 remove_from_free_list (page_t *page) {
-  if (!kstat.num_free_pages) {
+  if (!*free_page_count(page)) {
     return;
   }
 
-  page->prev_free->next_free = page->next_free;
-  page->next_free->prev_free = page->prev_free;
-  kstat.num_free_pages--;
+  free_area_remove(free_page_list(page), page);
+  (*free_page_count(page))--;
+}
 
-  if (page == free_page_list_head) {
-    free_page_list_head = page->next_free;
-  }
+static inline unsigned int
+page_cache_hash (deviceno_t dev, int inode, unsigned int file_offset) {
+  // Hash the file first and then its offset, so that consecutive pages of a file end up in unrelated
+  // buckets rather than in neighbouring ones
+  uint32_t file = hash_32(((uint32_t)dev << 16) ^ (uint32_t)inode, 32);
+  return hash_32(file + (file_offset >> PAGE_SHIFT), page_cache_bits);
+}
 
-  if (!kstat.num_free_pages) {
-    free_page_list_head = NULL;
+static void
+hash_link (page_cache_entry_t **head, page_cache_entry_t *entry) {
+  entry->next_hash  = *head;
+  entry->pprev_hash = head;
+  if (*head) {
+    (*head)->pprev_hash = &entry->next_hash;
   }
+  *head = entry;
 }
 
 static void
-insert_into_cache (page_t *page) {
-  int      i    = PAGE_CACHE_HASH(page->inode, page->file_offset);
-  page_t **head = &page_cache[i];
+hash_unlink (page_cache_entry_t *entry) {
+  *entry->pprev_hash = entry->next_hash;
+  if (entry->next_hash) {
+    entry->next_hash->pprev_hash = entry->pprev_hash;
+  }
+}
 
-  if (!*head) {
-    *head              = page;
-    (*head)->prev_hash = (*head)->next_hash = NULL;
-  } else {
-    page->prev_hash    = NULL;
-    page->next_hash    = *head;
-    (*head)->prev_hash = page;
-    *head              = page;
+static page_cache_entry_t *
+find_in_cache (deviceno_t dev, int inode, unsigned int file_offset) {
+  page_cache_entry_t *entry = page_cache[page_cache_hash(dev, inode, file_offset)];
+
+  for (; entry; entry = entry->next_hash) {
+    if (entry->inode == inode && entry->file_offset == file_offset && entry->dev == dev) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static retval_t
+insert_into_cache (page_t *page, deviceno_t dev, int inode, unsigned int file_offset) {
+  page_cache_entry_t *entry;
+  if (!page_cache_entries || !(entry = kmem_cache_alloc(page_cache_entries, GFP_NOWAIT))) {
+    return RET_FAIL;
   }
 
+  entry->page        = page;
+  entry->inode       = inode;
+  entry->file_offset = file_offset;
+  entry->dev         = dev;
+  page->cache        = entry;
+
+  hash_link(&page_cache[page_cache_hash(dev, inode, file_offset)], entry);
+
+  kstat.page_cache_pages++;
   kstat.page_cache_consumption += (PAGE_SIZE / 1024);
+
+  return RET_OK;
 }
 
 static void
 remove_from_cache (page_t *page) {
-  if (!page->inode) {
+  page_cache_entry_t *entry = page->cache;
+  if (!entry) {
     return;
   }
 
-  int      i    = PAGE_CACHE_HASH(page->inode, page->file_offset);
-  page_t **head = &page_cache[i];
+  hash_unlink(entry);
+  page->cache = NULL;
 
-  while (*head) {
-    if (*head == page) {
-      if ((*head)->next_hash) {
-        (*head)->next_hash->prev_hash = (*head)->prev_hash;
-      }
+  kstat.page_cache_pages--;
+  kstat.page_cache_consumption -= (PAGE_SIZE / 1024);
 
-      if ((*head)->prev_hash) {
-        (*head)->prev_hash->next_hash = (*head)->next_hash;
-      }
+  kmem_cache_free(page_cache_entries, entry);
+}
 
-      if (head == &page_cache[i]) {
-        *head = (*head)->next_hash;
-      }
+/**
+ * Whether the page heads a free block of the given order that may be merged. Cached pages are never
+ * merged so that they stay reclaimable.
+ */
+static inline bool
+page_is_free_block (page_t *page, unsigned int order) {
+  return (page->flags & PAGE_FREE) && page->order == order && !page->cache;
+}
+
+static void
+add_free_block (page_t *page, unsigned int order) {
+  page->flags |= PAGE_FREE;
+  page->order  = order;
+
+  if (!order) {
+    insert_into_free_list(page);
+
+    // If the page isn't cached, place it at the head of the free pages list
+    if (!page->cache) {
+      *free_page_list(page) = page;
+    }
+    return;
+  }
+
+  free_area_insert(&free_area[order], page);
+  kstat.num_free_pages += 1 << order;
+}
 
-      kstat.page_cache_consumption -= (PAGE_SIZE / 1024);
+static void
+remove_free_block (page_t *page) {
+  page->flags &= ~PAGE_FREE;
+
+  if (!page->order) {
+    remove_from_free_list(page);
+    return;
+  }
+
+  free_area_remove(&free_area[page->order], page);
+  kstat.num_free_pages -= 1 << page->order;
+}
+
+/**
+ * Returns a block of 2^order pages to the free lists, merging it with its buddy for as long as the
+ * buddy is a free block of the same order. A block's buddy is found by flipping the order bit of its
+ * page number, so each merge step is constant time.
+ */
+static void
+free_block (page_t *page, unsigned int order) {
+  while (!page->cache && !page_is_highmem(page) && order < PAGE_MAX_ORDER) {
+    page_t *buddy = page_from_num(page->page_num ^ (1 << order));
+    if (!buddy || !page_is_free_block(buddy, order)) {
       break;
     }
 
-    head = &(*head)->next_hash;
+    remove_free_block(buddy);
+
+    // We address a merged pair using its lower page
+    if (buddy->page_num < page->page_num) {
+      page = buddy;
+    }
+    order++;
   }
+
+  add_free_block(page, order);
 }
 
-overridable page_t *
-page_get_free (void) {
-  // If the number of pages is too low, we need to reclaim some memory from the buffer cache
-  if (kstat.num_free_pages <= kstat.min_free_pages) {
-    // wakeup(&kswapd); // TODO:
-    if (!kstat.num_free_pages) {
-      sleep(SLEEP_FN(&page_get_free), PROC_UNINTERRUPTIBLE);
-
-      if (!kstat.num_free_pages && !kstat.pages_reclaimed) {
-        // We're for sure out of memory at this point
-        // TODO: log
-        return NULL;
-      }
+/**
+ * Takes a page out of the pre-zeroed pool.
+ */
+static page_t *
+take_zeroed_page (void) {
+  page_t *page;
+  if (!(page = zeroed_list_head)) {
+    return NULL;
+  }
+
+  free_area_remove(&zeroed_list_head, page);
+  page->flags &= ~PAGE_ZEROED;
+  kstat.num_free_pages--;
+  kstat.zeroed_pages--;
+
+  return page;
+}
+
+/**
+ * Takes a page off the highmem free list.
+ */
+static page_t *
+take_highmem_page (void) {
+  INTERRUPTS_OFF();
+
+  page_t *page;
+  if ((page = free_highmem_list)) {
+    remove_free_block(page);
+    remove_from_cache(page);
+    page->usage_count = 1;
+  }
+
+  INTERRUPTS_ON();
+
+  return page;
+}
+
+/**
+ * Takes a free block of 2^from pages off the free lists and splits it down to a block of the given
+ * order, returning the halves produced by splitting to the free lists. While the halves are smaller
+ * than a full set of colors, we keep the half that holds the requested color.
+ */
+static page_t *
+split_free_block (page_t *page, unsigned int from, unsigned int order, unsigned int color) {
+  remove_free_block(page);
+  remove_from_cache(page);
+
+  for (unsigned int n = from; n > order;) {
+    n--;
+    page_t *upper = page_from_num(page->page_num + (1 << n));
+
+    if (n < page_color_bits && (color & (1 << n))) {
+      add_free_block(page, n);
+      page = upper;
+    } else {
+      add_free_block(upper, n);
     }
+  }
+  page->order = order;
 
-    kstat.min_free_pages -= NUM_BUFFER_RECLAIM;
-    kstat.min_free_pages  = kstat.min_free_pages < 0 ? 0 : kstat.min_free_pages;
-  } else {
-    // Recalculate if free mem back to normal levels
-    if (!kstat.min_free_pages) {
-      if (kstat.num_free_pages > NUM_BUFFER_RECLAIM) {
-        kstat.min_free_pages = (kstat.total_mem_pages * FREE_PAGES_RATIO) / 100;
-      }
+  return page;
+}
+
+/**
+ * Takes a block of 2^order pages off the free lists, splitting the smallest larger block if there is
+ * no free block of the exact order.
+ */
+static page_t *
+take_free_block (unsigned int order) {
+  unsigned int n;
+  for (n = order; n <= PAGE_MAX_ORDER && !free_area[n]; n++);
+
+  if (n > PAGE_MAX_ORDER) {
+    return NULL;
+  }
+
+  return split_free_block(free_area[n], n, order, 0);
+}
+
+/**
+ * Whether splitting the free block of 2^order pages can yield a page of the given color. Blocks
+ * smaller than a full set of colors only hold the colors that share their upper bits.
+ */
+static inline bool
+block_holds_color (page_t *page, unsigned int order, unsigned int color) {
+  return !(((page->page_num ^ color) & (page_colors - 1)) >> order);
+}
+
+/**
+ * Takes a single page off the free lists. A page of the requested color is preferred, even if it has
+ * to be split off a larger block; only then do we settle for a page of another color, and finally for
+ * splitting whatever block is left.
+ */
+static page_t *
+take_free_page (unsigned int color) {
+  color        &= page_colors - 1;
+
+  page_t *page  = free_page_lists[color];
+  for (unsigned int n = 1; !page && n <= PAGE_MAX_ORDER; n++) {
+    if (free_area[n] && block_holds_color(free_area[n], n, color)) {
+      return split_free_block(free_area[n], n, 0, color);
     }
   }
 
+  for (unsigned int n = 1; !page && n < page_colors; n++) {
+    page = free_page_lists[(color + n) & (page_colors - 1)];
+  }
+
+  if (!page) {
+    if ((page = take_free_block(0))) {
+      kstat.page_color_misses++;
+    }
+    return page;
+  }
+
+  if ((page->page_num & (page_colors - 1)) != color) {
+    kstat.page_color_misses++;
+  }
+
+  remove_free_block(page);
+  remove_from_cache(page);
+
+  return page;
+}
+
+/**
+ * Initializes deferred page frames until free memory is back above the low watermark, since that's
+ * far cheaper than reclaiming memory.
+ */
+static inline void
+page_grow_deferred (void) {
+  while (kstat.page_init_pending && kstat.num_free_pages <= kstat.low_free_pages
+         && page_init_deferred());
+}
+
+/**
+ * The number of free pages an allocation has to leave alone. The pages below the min watermark are
+ * held back for allocations that can't wait for kswapd to reclaim memory.
+ */
+static inline int
+page_reserve (gfp_t gfp) {
+  return (gfp & GFP_HIGH) ? 0 : kstat.min_free_pages;
+}
+
+/**
+ * Sleeps until kswapd is done reclaiming, whether or not it managed to reclaim anything, or until a
+ * page is released. Interrupts stay off until we're queued so kswapd can't finish in between.
+ */
+static void
+page_wait_reclaim (void) {
   INTERRUPTS_OFF();
 
+  kswapd_wakeup();
+  sleep_on_exclusive(&page_wait, PROC_UNINTERRUPTIBLE);
+
+  INTERRUPTS_ON();
+}
+
+overridable page_t *
+page_get_free (gfp_t gfp) {
+  // Spread consecutive allocations across the cache
+  page_t *page = page_get_free_color(gfp, page_next_color++);
+  allocprof_page_alloc(page, gfp, ALLOCPROF_CALLER());
+
+  return page;
+}
+
+overridable page_t *
+page_get_free_color (gfp_t gfp, unsigned int color) {
+  // Highmem is of no use to most allocations, so it's used up first by those that can take it
   page_t *page;
-  if (!(page = free_page_list_head)) {
+  if ((gfp & GFP_HIGHMEM) && (page = take_highmem_page())) {
+    return page;
+  }
+
+  page_grow_deferred();
+
+  // Start reclaiming in the background well before we actually run out
+  if ((gfp & GFP_KSWAPD) && kstat.num_free_pages <= kstat.low_free_pages) {
+    kswapd_wakeup();
+  }
+
+  if (kstat.num_free_pages <= page_reserve(gfp)) {
+    if (!(gfp & GFP_WAIT)) {
+      return NULL;
+    }
+
+    page_wait_reclaim();
+
+    if (!kstat.num_free_pages && !kstat.pages_reclaimed) {
+      // We're for sure out of memory at this point, so show who's holding it
+      // TODO: log
+      allocprof_report();
+      return NULL;
+    }
+  }
+
+  INTERRUPTS_OFF();
+
+  // Fall back to the pre-zeroed pool only once everything else is gone
+  if (!(page = take_free_page(color)) && !(page = take_zeroed_page())) {
     // TODO: log
     INTERRUPTS_ON();
     return NULL;
   }
 
-  remove_from_free_list(page);
-  remove_from_cache(page);
-
   page->usage_count = 1;
-  page->inode       = 0;
-  page->file_offset = 0;
-  page->dev         = 0;
 
   INTERRUPTS_ON();
 
@@ -187,59 +504,478 @@ page_release (page_t *page) {
     return;
   }
 
-  INTERRUPTS_OFF();
+  allocprof_page_free(page);
 
-  insert_into_free_list(page);
+  INTERRUPTS_OFF();
 
   page->flags &= PAGE_RESERVED;
-
-  // If the page isn't cached, place it at the head of the free pages list
-  if (!page->inode) {
-    free_page_list_head = page;
-  }
+  free_block(page, page->order);
 
   INTERRUPTS_ON();
 
   // Wait for free pages to be far greater than NUM_BUFFER_RECLAIM, else `page_get_free` could run
   // out of pages again and kill the process prematurely
   if (kstat.num_free_pages > (NUM_BUFFER_RECLAIM * 3)) {
-    wakeup(func_as_ptr((void (*)(void))page_get_free));
+    wakeup(&page_wait);
   }
 }
 
+overridable page_t *
+page_get_zeroed (gfp_t gfp) {
+  // There's no pre-zeroed highmem, but taking it still spares the direct map
+  page_t *page;
+  if ((gfp & GFP_HIGHMEM) && (page = take_highmem_page())) {
+    kmemset(kmap(page), 0, PAGE_SIZE);
+    kunmap(page);
+    allocprof_page_alloc(page, gfp, ALLOCPROF_CALLER());
+    return page;
+  }
+
+  INTERRUPTS_OFF();
+
+  if (kstat.num_free_pages > page_reserve(gfp) && (page = take_zeroed_page())) {
+    page->usage_count = 1;
+    kstat.zeroed_hits++;
+
+    INTERRUPTS_ON();
+
+    if ((gfp & GFP_KSWAPD) && kstat.num_free_pages <= kstat.low_free_pages) {
+      kswapd_wakeup();
+    }
+    allocprof_page_alloc(page, gfp, ALLOCPROF_CALLER());
+    return page;
+  }
+
+  kstat.zeroed_misses++;
+
+  INTERRUPTS_ON();
+
+  if ((page = page_get_free(gfp | GFP_NOPROFILE))) {
+    kmemset(kmap(page), 0, PAGE_SIZE);
+    kunmap(page);
+  }
+  allocprof_page_alloc(page, gfp, ALLOCPROF_CALLER());
+
+  return page;
+}
+
+/**
+ * Takes an uncached single page off the free list for zeroing, unless the pre-zeroed pool is full.
+ * Neither cached pages nor larger blocks are touched, so we don't destroy cached contents or break up
+ * contiguous memory.
+ */
+static page_t *
+take_page_to_zero (void) {
+  static unsigned int color = 0;
+
+  INTERRUPTS_OFF();
+
+  // Zero pages of every color in turn, so the pool doesn't end up all one color
+  page_t *page = free_page_lists[color++ & (page_colors - 1)];
+  if (kstat.zeroed_pages >= NUM_ZEROED_PAGES || !page || page->cache) {
+    INTERRUPTS_ON();
+    return NULL;
+  }
+  remove_free_block(page);
+
+  INTERRUPTS_ON();
+
+  return page;
+}
+
+static void
+add_zeroed_page (page_t *page) {
+  INTERRUPTS_OFF();
+
+  page->flags |= PAGE_ZEROED;
+  free_area_insert(&zeroed_list_head, page);
+  kstat.num_free_pages++;
+  kstat.zeroed_pages++;
+
+  INTERRUPTS_ON();
+}
+
+overridable int
+page_zero_idle (int nr_pages) {
+  int     zeroed = 0;
+  page_t *page;
+
+  while (zeroed < nr_pages && (page = take_page_to_zero())) {
+    unsigned int addr = page->page_num << PAGE_SHIFT;
+    kmemset((void *)P2V(addr), 0, PAGE_SIZE);
+
+    add_zeroed_page(page);
+    zeroed++;
+  }
+
+  return zeroed;
+}
+
+overridable page_t *
+alloc_pages (unsigned int order, gfp_t gfp) {
+  page_t *page;
+  if (!order) {
+    page = page_get_free(gfp | GFP_NOPROFILE);
+    allocprof_page_alloc(page, gfp, ALLOCPROF_CALLER());
+    return page;
+  }
+
+  if (order > PAGE_MAX_ORDER) {
+    klogf_warn("%s(): order %d exceeds the maximum order %d\n", __func__, order, PAGE_MAX_ORDER);
+    return NULL;
+  }
+
+  page_grow_deferred();
+
+  if ((gfp & GFP_KSWAPD) && kstat.num_free_pages <= kstat.low_free_pages) {
+    kswapd_wakeup();
+  }
+
+  if (kstat.num_free_pages - (1 << order) < page_reserve(gfp)) {
+    return NULL;
+  }
+
+  INTERRUPTS_OFF();
+
+  if (!(page = take_free_block(order))) {
+    INTERRUPTS_ON();
+    klogf_warn("%s(): no free block of order %d\n", __func__, order);
+    return NULL;
+  }
+
+  page->usage_count = 1;
+
+  INTERRUPTS_ON();
+
+  allocprof_page_alloc(page, gfp, ALLOCPROF_CALLER());
+
+  return page;
+}
+
 void
-page_init (unsigned int num_pages) {
-  kmemset(free_page_list, 0, free_page_list_size);
-  kmemset(page_cache, 0, page_cache_size);
+free_pages (page_t *page, unsigned int order) {
+  // The block may still be shared, so a bad order must not overwrite the one it was allocated with
+  if (page->order != order) {
+    klogf_warn(
+      "%s(): page %d was allocated with order %d, not %d\n",
+      __func__,
+      page->page_num,
+      page->order,
+      order
+    );
+  }
 
-  for (unsigned int n = 0; n < num_pages; n++) {
-    page_t *page      = &free_page_list[n];
-    page->page_num    = n;
+  page_release(page);
+}
+
+/**
+ * A run of page frames being initialized, [first, end), and the number of them freed from the
+ * direct map
+ */
+typedef struct {
+  unsigned int first;
+  unsigned int end;
+  unsigned int freed;
+} page_init_span_t;
+
+/**
+ * The number of page frames in the direct map, as passed to `page_init`
+ */
+static unsigned int page_init_num_pages;
+
+/**
+ * The page frames from here up to `memmap_num_pages` have yet to be initialized
+ */
+static unsigned int page_init_next;
+
+/**
+ * Hands the part of a free range reported by the boot allocator that falls within the span to the
+ * free lists, coalescing each page with the preceding free pages.
+ */
+static void
+page_init_range (unsigned int base, unsigned int end, void *ctx) {
+  page_init_span_t *span  = ctx;
+  unsigned int      first = base >> PAGE_SHIFT;
+  unsigned int      last  = end >> PAGE_SHIFT;
 
-    // Flag the kernel pages as reserved
+  first                   = max(first, span->first);
+  last                    = min(last, span->end);
+  last                    = min(last, page_init_num_pages);
+
+  for (unsigned int n = first; n < last; n++) {
+    page_t      *page = page_from_num(n);
     unsigned int addr = n << PAGE_SHIFT;
-    if (addr >= KERNEL_PHYSICAL_BASE && addr < V2P(real_last_addr)) {
-      flag_as_kreserved(page);
+
+    page->flags       = 0;
+    page->data        = (char *)P2V(addr);
+    free_block(page, 0);
+    span->freed++;
+  }
+}
+
+/**
+ * Hands a range of highmem to the free lists. Highmem pages have no address until they're mapped
+ * with `kmap`.
+ */
+static void
+page_init_highmem (unsigned int from, unsigned int to, void *ctx) {
+  for (unsigned int n = from; n < to; n++) {
+    page_t *page;
+    if (!(page = page_from_num(n))) {
       continue;
     }
 
-    // Reserve a page for the kernel stack
-    if (addr == 0x0000F000) {
-      flag_as_reserved(page);
+    page->flags = 0;
+    page->data  = NULL;
+    free_block(page, 0);
+    kstat.highmem_pages++;
+  }
+}
+
+/**
+ * Derives the free page watermarks from the amount of memory. They're spaced a reclaim batch apart,
+ * but no further than the floor itself so they stay sensible on machines with little memory.
+ */
+static void
+page_set_watermarks (void) {
+  int step              = min(kstat.total_mem_pages * FREE_PAGES_RATIO / 100, NUM_BUFFER_RECLAIM);
+  kstat.min_free_pages  = (kstat.total_mem_pages * FREE_PAGES_RATIO) / 100;
+  kstat.low_free_pages  = kstat.min_free_pages + step;
+  kstat.high_free_pages = kstat.low_free_pages + step;
+}
+
+/**
+ * Initializes the descriptors of the page frames in [first, end) and hands the free ones to the
+ * free lists. Everything starts out reserved; only the ranges the boot allocator knows to be free,
+ * and available highmem, are freed. Free memory is classified a range at a time, not page by page.
+ */
+static void
+page_init_span (unsigned int first, unsigned int end) {
+  page_init_span_t span = {.first = first, .end = end, .freed = 0};
+
+  for (unsigned int n = first; n < end; n++) {
+    page_t *page;
+    if (!(page = page_from_num(n))) {
       continue;
     }
 
-    // Flag special memory addresses e.g. VGA, BIOS, etc as reserved
-    if (!bios_mmap_has_addr(addr)) {
-      flag_as_reserved(page);
-      continue;
+    kmemset(page, 0, sizeof(page_t));
+    page->page_num = n;
+    page->flags    = PAGE_RESERVED;
+  }
+
+  unsigned int from = max(first, highmem_start);
+  unsigned int to   = min(end, highmem_end);
+
+  INTERRUPTS_OFF();
+
+  memblock_foreach_free(&page_init_range, &span);
+  // Highmem lies beyond the boot allocator's view of memory, so it's taken from the memory map
+  bios_mmap_foreach_available(from, to, &page_init_highmem, NULL);
+
+  kstat.total_mem_pages   += span.freed;
+  kstat.physical_reserved -= span.freed;
+  kstat.page_init_pending -= end - first;
+  page_set_watermarks();
+
+  INTERRUPTS_ON();
+}
+
+void
+page_init (unsigned int num_pages) {
+  kmemset(page_cache, 0, page_cache_size);
+  kmemset(free_area, 0, sizeof(free_area));
+  kmemset(free_page_lists, 0, sizeof(free_page_lists));
+
+  // Round the number of colors down to a power of two, so a page's color is just the low bits of its
+  // page number
+  page_colors      = min(max(page_colors, 1), PAGE_MAX_COLORS);
+  page_color_bits  = 0;
+  while ((2U << page_color_bits) <= page_colors) {
+    page_color_bits++;
+  }
+  page_colors      = 1 << page_color_bits;
+  page_next_color  = 0;
+
+  // Use as many hash buckets as fit in the table allocated at boot, rounded down to a power of two
+  page_cache_bits  = 1;
+  page_cache_block = NULL;
+  while ((sizeof(page_cache_entry_t *) << (page_cache_bits + 1)) <= page_cache_size) {
+    page_cache_bits++;
+  }
+  zeroed_list_head        = NULL;
+  free_highmem_list       = NULL;
+
+  page_init_num_pages     = num_pages;
+  kstat.total_mem_pages   = 0;
+  kstat.page_init_pending = memmap_num_pages;
+
+  // Only enough memory to boot is initialized up front; the rest is left to `page_init_deferred`.
+  // Whole sections are initialized at a time, so a block's buddy is always initialized with it.
+  unsigned int eager      = (PAGE_INIT_EAGER + PAGES_PER_SECTION - 1) & ~(PAGES_PER_SECTION - 1);
+  page_init_next          = min(eager, memmap_num_pages);
+  page_init_span(0, page_init_next);
+
+  // Reserved pages that the boot allocator handed out belong to the kernel; the rest are holes in
+  // the memory map, e.g. VGA memory and the BIOS, and memory that has yet to be initialized
+  kstat.kernel_reserved = 0;
+  for (unsigned int n = 0; n < memblock_reserved.count; n++) {
+    unsigned int base = memblock_reserved.regions[n].base >> PAGE_SHIFT;
+    unsigned int end  = PAGE_ALIGN(memblock_reserved.regions[n].end) >> PAGE_SHIFT;
+    if (base < num_pages) {
+      kstat.kernel_reserved += min(end, num_pages) - base;
     }
+  }
+  kstat.physical_reserved = num_pages - kstat.total_mem_pages - kstat.kernel_reserved;
+}
 
-    // Everything else can be inserted into the free page list
-    page->data = (char *)P2V(addr);
-    insert_into_free_list(page);
+bool
+page_init_deferred (void) {
+  INTERRUPTS_OFF();
+
+  // Claim the next section before initializing it, so that concurrent callers never initialize the
+  // same one twice
+  unsigned int first = page_init_next;
+  if (first >= memmap_num_pages) {
+    INTERRUPTS_ON();
+    return false;
   }
 
-  kstat.total_mem_pages = kstat.num_free_pages;
-  kstat.min_free_pages  = (kstat.total_mem_pages * FREE_PAGES_RATIO) / 100;
+  unsigned int end   = min(first + PAGES_PER_SECTION, memmap_num_pages);
+  page_init_next     = end;
+
+  INTERRUPTS_ON();
+
+  page_init_span(first, end);
+
+  return true;
+}
+
+/**
+ * Doubles the number of hash buckets and rehashes every cached page. If no memory is available the
+ * table is left as-is, and chains simply grow longer.
+ */
+static void
+page_cache_grow (void) {
+  unsigned int bits = page_cache_bits + 1;
+  size_t       size = sizeof(page_cache_entry_t *) << bits;
+
+  unsigned int order;
+  for (order = 0; ((size_t)PAGE_SIZE << order) < size; order++);
+
+  page_t *block;
+  if (order > PAGE_MAX_ORDER || !(block = alloc_pages(order, GFP_NOWAIT))) {
+    return;
+  }
+  page_cache_entry_t **table = (page_cache_entry_t **)block->data;
+  kmemset(table, 0, size);
+
+  INTERRUPTS_OFF();
+
+  page_cache_entry_t **old         = page_cache;
+  unsigned int         old_buckets = 1U << page_cache_bits;
+  page_t              *old_block   = page_cache_block;
+
+  page_cache                       = table;
+  page_cache_size                  = size;
+  page_cache_bits                  = bits;
+  page_cache_block                 = block;
+
+  for (unsigned int n = 0; n < old_buckets; n++) {
+    page_cache_entry_t *entry;
+    while ((entry = old[n])) {
+      hash_unlink(entry);
+      hash_link(&page_cache[page_cache_hash(entry->dev, entry->inode, entry->file_offset)], entry);
+    }
+  }
+
+  INTERRUPTS_ON();
+
+  // The table allocated at boot isn't managed by the page allocator, so it can't be given back
+  if (old_block) {
+    free_pages(old_block, old_block->order);
+  }
+}
+
+page_t *
+page_cache_lookup (deviceno_t dev, int inode, unsigned int file_offset) {
+  INTERRUPTS_OFF();
+
+  page_cache_entry_t *entry;
+  if (!(entry = find_in_cache(dev, inode, file_offset))) {
+    kstat.page_cache_misses++;
+
+    INTERRUPTS_ON();
+    return NULL;
+  }
+
+  // The page was released but still holds the file's contents, so take it back off the free list
+  page_t *page = entry->page;
+  if (page->flags & PAGE_FREE) {
+    remove_free_block(page);
+  }
+  page->usage_count++;
+  kstat.page_cache_hits++;
+
+  INTERRUPTS_ON();
+
+  return page;
+}
+
+unsigned int
+page_cache_lookup_range (
+  deviceno_t   dev,
+  int          inode,
+  unsigned int file_offset,
+  unsigned int nr_pages,
+  page_t     **pages
+) {
+  unsigned int n;
+  for (n = 0; n < nr_pages; n++) {
+    if (!(pages[n] = page_cache_lookup(dev, inode, file_offset + (n << PAGE_SHIFT)))) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+retval_t
+page_cache_insert (page_t *page, deviceno_t dev, int inode, unsigned int file_offset) {
+  if ((unsigned int)kstat.page_cache_pages >= ((unsigned int)PAGE_CACHE_LOAD << page_cache_bits)) {
+    page_cache_grow();
+  }
+
+  INTERRUPTS_OFF();
+
+  retval_t ret = RET_FAIL;
+  if (!page->cache && !find_in_cache(dev, inode, file_offset)) {
+    ret = insert_into_cache(page, dev, inode, file_offset);
+  }
+
+  INTERRUPTS_ON();
+
+  return ret;
+}
+
+void
+page_cache_remove (page_t *page) {
+  INTERRUPTS_OFF();
+
+  // A free page loses its place among the cached pages at the tail of the free list, and may now be
+  // coalesced
+  if (page->flags & PAGE_FREE) {
+    remove_free_block(page);
+    remove_from_cache(page);
+    free_block(page, 0);
+  } else {
+    remove_from_cache(page);
+  }
+
+  INTERRUPTS_ON();
+}
+
+void
+page_cache_init (void) {
+  page_cache_entries = kmem_cache_create("page_cache", sizeof(page_cache_entry_t), 0, NULL);
 }
@@ -0,0 +1,47 @@
+#include "mem/pageinitd.h"
+
+#include "arch/x86.h"
+#include "drivers/dev/char/tmpcon.h"
+#include "kernel.h"
+#include "kstat.h"
+#include "mem/page.h"
+#include "proc/proc.h"
+#include "proc/sleep.h"
+
+/**
+ * Where pageinitd sleeps once it's done. Nothing ever wakes it up.
+ */
+static wait_queue_head_t pageinitd_wait;
+
+static void
+pageinitd (void) {
+  uint64_t start = rdtsc();
+
+  // Sections are initialized with interrupts disabled, so we're preempted in between them whenever
+  // somebody else needs the CPU
+  while (page_init_deferred());
+
+  kstat.page_init_deferred_cycles = rdtsc() - start;
+  klogf_info(
+    "page frames initialized: %d Kcycles during boot, %d Kcycles in the background\n",
+    (unsigned int)(kstat.page_init_cycles >> 10),
+    (unsigned int)(kstat.page_init_deferred_cycles >> 10)
+  );
+
+  // Kernel processes can't exit, so there's nothing left to do but sleep
+  while (true) {
+    sleep_on(&pageinitd_wait, PROC_UNINTERRUPTIBLE);
+  }
+}
+
+void
+pageinitd_init (void) {
+  // Small machines are initialized in full during boot
+  if (!kstat.page_init_pending) {
+    return;
+  }
+
+  if (!kproc_create("pageinitd", pageinitd)) {
+    klogf_warn("%s(): unable to start pageinitd\n", __func__);
+  }
+}
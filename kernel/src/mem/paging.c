@@ -0,0 +1,205 @@
+#include "mem/paging.h"
+
+#include "arch/interrupt.h"
+#include "arch/tlb.h"
+#include "arch/x86.h"
+#include "lib/compiler.h"
+#include "lib/string.h"
+#include "mem/base.h"
+#include "mem/highmem.h"
+#include "mem/page.h"
+#include "mem/swap.h"
+
+overridable pte_t *
+paging_pgdir_current (void) {
+#ifdef CONFIG_PAE
+  // CR3 points at the page directory pointer table. The page directories are contiguous, so the
+  // first one is all we need.
+  unsigned int pdpt = cr3_get() & ~0x1F;
+  unsigned int addr = ((uint64_t *)P2V(pdpt))[0] & PAGE_MASK;
+#else
+  unsigned int addr = cr3_get() & PAGE_MASK;
+#endif
+  return (pte_t *)P2V(addr);
+}
+
+/**
+ * Allocates a frame filled with zeros. The frame comes from the direct map, since page tables have
+ * to be reachable through it.
+ *
+ * @return unsigned int The physical address of the frame, or 0 if no memory is available.
+ */
+static unsigned int
+frame_get_zeroed (void) {
+  page_t *page;
+  if (!(page = page_get_zeroed(GFP_KERNEL))) {
+    return 0;
+  }
+
+  return page->page_num << PAGE_SHIFT;
+}
+
+/**
+ * Maps a zero-filled frame in place of a reserved, not-present page.
+ */
+static retval_t
+fault_demand_zero (pte_t *pte, unsigned int addr) {
+  if (!(*pte & PAGE_NOALLOC)) {
+    return RET_FAIL;
+  }
+
+  page_t *page;
+  if (!(page = page_get_zeroed(GFP_HIGHUSER))) {
+    return RET_FAIL;
+  }
+
+  *pte = page_to_phys(page) | PAGE_PRESENT | (*pte & (PAGE_RW | PAGE_USER));
+  tlb_flush_page(addr);
+
+  return RET_OK;
+}
+
+/**
+ * Resolves a write to a copy-on-write frame. The frame is only copied if somebody else still maps
+ * it; otherwise we're its last user and can simply write to it.
+ */
+static retval_t
+fault_cow (pte_t *pte, unsigned int addr) {
+  page_t *page = PTE_PAGE(*pte);
+  // Frames without a page frame entry, e.g. in a hole of the memmap, are never shared
+  if (!page || !(page->flags & PAGE_COW)) {
+    return RET_FAIL;
+  }
+
+  pte_t   entry = *pte;
+  page_t *copy  = NULL;
+
+retry:
+  // The page allocator may sleep, so the copy is allocated before interrupts are disabled
+  if (page->usage_count > 1 && !copy && !(copy = page_get_free(GFP_HIGHUSER))) {
+    return RET_FAIL;
+  }
+
+  INTERRUPTS_OFF();
+
+  if (*pte != entry) {
+    // The fault was resolved, or the page unmapped, while we were allocating
+    INTERRUPTS_ON();
+    goto done;
+  }
+
+  if (page->usage_count > 1) {
+    if (!copy) {
+      // The frame was shared while we were allocating
+      INTERRUPTS_ON();
+      goto retry;
+    }
+
+    kmemcpy(kmap(copy), kmap(page), PAGE_SIZE);
+    kunmap(page);
+    kunmap(copy);
+
+    *pte = page_to_phys(copy) | (*pte & ~PAGE_MASK) | PAGE_RW;
+    copy = NULL;
+    // Drop our reference to the shared frame
+    page_release(page);
+  } else {
+    page->flags &= ~PAGE_COW;
+    *pte        |= PAGE_RW;
+  }
+
+  INTERRUPTS_ON();
+
+  tlb_flush_page(addr);
+
+done:
+  // Not needed after all
+  if (copy) {
+    page_release(copy);
+  }
+
+  return RET_OK;
+}
+
+pte_t *
+paging_get_pte (pte_t *pgdir, unsigned int addr, bool create) {
+  pte_t *pde = &pgdir[GET_PGDIR(addr)];
+
+  // A 4 MB page has no page table
+  if (*pde & PAGE_LARGE) {
+    return NULL;
+  }
+
+  if (!(*pde & PAGE_PRESENT)) {
+    if (!create) {
+      return NULL;
+    }
+
+    unsigned int table;
+    if (!(table = frame_get_zeroed())) {
+      return NULL;
+    }
+    // Access is restricted by the page table entries, so the directory entry is as permissive as
+    // possible
+    *pde = table | PAGE_PRESENT | PAGE_RW | PAGE_USER;
+  }
+
+  // Page tables always live in the direct map
+  unsigned int table = (unsigned int)(*pde & PAGE_MASK);
+  return &((pte_t *)P2V(table))[GET_PGTBL(addr)];
+}
+
+retval_t
+paging_reserve (pte_t *pgdir, unsigned int addr, unsigned int flags) {
+  pte_t *pte;
+  if (!(pte = paging_get_pte(pgdir, addr, true))) {
+    return RET_FAIL;
+  }
+
+  // A swapped out page is still mapped, and overwriting its entry would leak its swap slot
+  if (*pte & (PAGE_PRESENT | PAGE_SWAPPED)) {
+    return RET_FAIL;
+  }
+
+  *pte = PAGE_NOALLOC | (flags & (PAGE_RW | PAGE_USER));
+
+  return RET_OK;
+}
+
+void
+paging_share_cow (pte_t *src, pte_t *dst, unsigned int addr) {
+  page_t *page  = PTE_PAGE(*src);
+
+  INTERRUPTS_OFF();
+
+  page->flags  |= PAGE_COW;
+  page->usage_count++;
+
+  *src         &= ~PAGE_RW;
+  *dst          = *src;
+
+  INTERRUPTS_ON();
+
+  tlb_flush_page(addr);
+}
+
+retval_t
+paging_handle_fault (unsigned int addr, unsigned int err) {
+  pte_t *pte;
+  if (!(pte = paging_get_pte(paging_pgdir_current(), addr, false))) {
+    return RET_FAIL;
+  }
+
+  if (!(err & PAGE_FAULT_PROTVIOL)) {
+    if (*pte & PAGE_SWAPPED) {
+      return swap_in(pte, addr);
+    }
+    return fault_demand_zero(pte, addr);
+  }
+
+  if ((err & PAGE_FAULT_WRIT) && (*pte & PAGE_PRESENT)) {
+    return fault_cow(pte, addr);
+  }
+
+  return RET_FAIL;
+}
@@ -0,0 +1,309 @@
+#include "mem/slab.h"
+
+#include "arch/interrupt.h"
+#include "drivers/dev/char/tmpcon.h"
+#include "kernel.h"
+#include "kstat.h"
+#include "lib/compiler.h"
+#include "lib/string.h"
+#include "mem/kswapd.h"
+#include "mem/page.h"
+
+/**
+ * Rounds `size` up to the next multiple of `align`, which must be a power of two.
+ */
+#define SLAB_ALIGN(size, align) (((size) + ((align) - 1)) & ~((align) - 1))
+
+/**
+ * The cache from which all other cache descriptors are allocated
+ */
+static kmem_cache_t cache_cache;
+
+/**
+ * A list of all caches, including `cache_cache`
+ */
+static list_head_t cache_list = list_head(cache_list);
+
+/**
+ * Retrieves the location of the free-list pointer of a free object.
+ */
+static inline void **
+slab_free_ptr (kmem_cache_t *cache, void *obj) {
+  return (void **)((char *)obj + cache->free_offset);
+}
+
+/**
+ * Retrieves the slab which owns the given object. Slab descriptors always live at the start of the
+ * page that holds their objects.
+ */
+static inline slab_t *
+slab_of (void *obj) {
+  return (slab_t *)((unsigned int)obj & PAGE_MASK);
+}
+
+static retval_t
+cache_setup (
+  kmem_cache_t *cache,
+  const char   *name,
+  size_t        size,
+  size_t        align,
+  void (*ctor)(void *)
+) {
+  if (!align) {
+    align = KMEM_CACHE_MIN_ALIGN;
+  }
+
+  // Alignment must be a power of two
+  if (align & (align - 1)) {
+    return RET_FAIL;
+  }
+
+  kmemset(cache, 0, sizeof(kmem_cache_t));
+  for (unsigned int n = 0; name[n] && n < KMEM_CACHE_NAME_LEN - 1; n++) {
+    cache->name[n] = name[n];
+  }
+
+  cache->object_size = size;
+  cache->ctor        = ctor;
+
+  // Free objects store the free-list link in their first word. A constructed object must keep its
+  // state while free, however, so in that case the link is placed just past the object instead.
+  size_t slot        = size < sizeof(void *) ? sizeof(void *) : size;
+  if (ctor) {
+    cache->free_offset = SLAB_ALIGN(slot, sizeof(void *));
+    slot               = cache->free_offset + sizeof(void *);
+  }
+
+  cache->size   = SLAB_ALIGN(slot, align);
+  cache->offset = SLAB_ALIGN(sizeof(slab_t), align);
+
+  if (cache->offset + cache->size > PAGE_SIZE) {
+    return RET_FAIL;
+  }
+  cache->objects_per_slab = (PAGE_SIZE - cache->offset) / cache->size;
+
+  list_init(&cache->slabs_partial);
+  list_init(&cache->slabs_full);
+  list_init(&cache->slabs_empty);
+  list_init(&cache->list);
+
+  return RET_OK;
+}
+
+/**
+ * Allocates a new page for the cache, carves it into objects and threads them onto the slab's free
+ * list. The caller links the new slab into the cache. Getting the page may sleep, so this must not
+ * be called with interrupts disabled unless `gfp` forbids sleeping.
+ */
+static slab_t *
+slab_create (kmem_cache_t *cache, gfp_t gfp) {
+  page_t *page = page_get_free(gfp);
+  if (!page) {
+    return NULL;
+  }
+  page->flags  |= PAGE_SLAB;
+
+  slab_t *slab  = (slab_t *)page->data;
+  slab->cache   = cache;
+  slab->page    = page;
+  slab->in_use  = 0;
+
+  char  *obj    = (char *)slab + cache->offset;
+  void **link   = &slab->free;
+  for (unsigned int n = 0; n < cache->objects_per_slab; n++, obj += cache->size) {
+    if (cache->ctor) {
+      cache->ctor(obj);
+    }
+    *link = obj;
+    link  = slab_free_ptr(cache, obj);
+  }
+  *link = NULL;
+
+  return slab;
+}
+
+/**
+ * Retrieves a slab with free objects, preferring partially used ones, if the cache has any
+ */
+static inline slab_t *
+slab_available (kmem_cache_t *cache) {
+  if (!list_is_empty(&cache->slabs_partial)) {
+    return list_first(&cache->slabs_partial, slab_t, list);
+  }
+  if (!list_is_empty(&cache->slabs_empty)) {
+    return list_first(&cache->slabs_empty, slab_t, list);
+  }
+  return NULL;
+}
+
+static void
+slab_destroy (kmem_cache_t *cache, slab_t *slab) {
+  page_t *page  = slab->page;
+
+  list_remove(&slab->list);
+  cache->num_slabs--;
+  kstat.slab_pages--;
+
+  page->flags  &= ~PAGE_SLAB;
+  page_release(page);
+}
+
+kmem_cache_t *
+kmem_cache_create (const char *name, size_t size, size_t align, void (*ctor)(void *)) {
+  kmem_cache_t *cache = kmem_cache_alloc(&cache_cache, GFP_KERNEL);
+  if (!cache) {
+    return NULL;
+  }
+
+  if (cache_setup(cache, name, size, align, ctor) == RET_FAIL) {
+    klogf_warn("%s(): cannot create cache %s for objects of size %d\n", __func__, name, size);
+    kmem_cache_free(&cache_cache, cache);
+    return NULL;
+  }
+
+  INTERRUPTS_OFF();
+  list_append(&cache->list, &cache_list);
+  INTERRUPTS_ON();
+
+  return cache;
+}
+
+retval_t
+kmem_cache_destroy (kmem_cache_t *cache) {
+  if (cache->num_active) {
+    klogf_warn(
+      "%s(): cache %s still has %d objects in use\n",
+      __func__,
+      cache->name,
+      cache->num_active
+    );
+    return RET_FAIL;
+  }
+
+  kmem_cache_shrink(cache);
+
+  INTERRUPTS_OFF();
+  list_remove(&cache->list);
+  INTERRUPTS_ON();
+
+  kmem_cache_free(&cache_cache, cache);
+
+  return RET_OK;
+}
+
+overridable void *
+kmem_cache_alloc (kmem_cache_t *cache, gfp_t gfp) {
+  INTERRUPTS_OFF();
+
+  slab_t *slab = slab_available(cache);
+  if (!slab) {
+    // The page allocator may sleep, so grow the cache with interrupts back on. Objects may have been
+    // freed in the meantime, so look again before settling on the new slab.
+    INTERRUPTS_ON();
+    slab_t *grown = slab_create(cache, gfp);
+    int_disable();
+
+    if (grown) {
+      list_append(&grown->list, &cache->slabs_empty);
+      cache->num_slabs++;
+      kstat.slab_pages++;
+    }
+
+    if (!(slab = slab_available(cache))) {
+      INTERRUPTS_ON();
+      return NULL;
+    }
+  }
+
+  void *obj  = slab->free;
+  slab->free = *slab_free_ptr(cache, obj);
+  slab->in_use++;
+  cache->num_active++;
+
+  // Move the slab onto the list matching its new state
+  list_remove(&slab->list);
+  list_append(&slab->list, slab->free ? &cache->slabs_partial : &cache->slabs_full);
+
+  INTERRUPTS_ON();
+
+  return obj;
+}
+
+overridable void
+kmem_cache_free (kmem_cache_t *cache, void *obj) {
+  if (!obj) {
+    return;
+  }
+
+  slab_t *slab = slab_of(obj);
+  if (slab->cache != cache) {
+    klogf_warn("%s(): object 0x%x does not belong to cache %s\n", __func__, obj, cache->name);
+    return;
+  }
+
+  INTERRUPTS_OFF();
+
+  *slab_free_ptr(cache, obj) = slab->free;
+  slab->free                 = obj;
+  slab->in_use--;
+  cache->num_active--;
+
+  list_remove(&slab->list);
+  if (slab->in_use) {
+    list_append(&slab->list, &cache->slabs_partial);
+  }
+  // Keep a single empty slab around to absorb alloc/free churn and give the rest back
+  else if (list_is_empty(&cache->slabs_empty)) {
+    list_append(&slab->list, &cache->slabs_empty);
+  } else {
+    slab_destroy(cache, slab);
+  }
+
+  INTERRUPTS_ON();
+}
+
+int
+kmem_cache_shrink (kmem_cache_t *cache) {
+  int released = 0;
+
+  INTERRUPTS_OFF();
+
+  while (!list_is_empty(&cache->slabs_empty)) {
+    slab_destroy(cache, list_first(&cache->slabs_empty, slab_t, list));
+    released++;
+  }
+
+  INTERRUPTS_ON();
+
+  return released;
+}
+
+/**
+ * Gives empty slabs back to the page allocator when memory runs low.
+ */
+static int
+slab_shrink (int nr_pages) {
+  int           released = 0;
+  kmem_cache_t *cache;
+
+  list_foreach_entry(cache, &cache_list, list) {
+    released += kmem_cache_shrink(cache);
+    if (released >= nr_pages) {
+      break;
+    }
+  }
+
+  return released;
+}
+
+static shrinker_t slab_shrinker = {.shrink = &slab_shrink};
+
+void
+slab_init (void) {
+  cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), 0, NULL);
+
+  list_init(&cache_list);
+  list_append(&cache_cache.list, &cache_list);
+
+  shrinker_register(&slab_shrinker);
+}
@@ -0,0 +1,243 @@
+#include "mem/swap.h"
+
+#include "arch/interrupt.h"
+#include "arch/tlb.h"
+#include "drivers/dev/char/tmpcon.h"
+#include "kconfig.h"
+#include "kernel.h"
+#include "kstat.h"
+#include "lib/lz4.h"
+#include "lib/string.h"
+#include "mem/base.h"
+#include "mem/highmem.h"
+#include "mem/kswapd.h"
+#include "mem/vmalloc.h"
+#include "mem/zpool.h"
+
+/**
+ * Pages a single shrink pass looks at before giving up, i.e. one full sweep of the user address
+ * space
+ */
+#define SWAP_SCAN_PAGES (KERNEL_PAGE_OFFSET >> PAGE_SHIFT)
+
+/**
+ * A page held in compressed swap. Swapped-out page table entries store the index of their slot.
+ */
+typedef struct {
+  /**
+   * The compressed contents, or the next free slot if the slot isn't in use
+   */
+  void          *obj;
+  unsigned short size;
+} swap_slot_t;
+
+static swap_slot_t *swap_slots;
+static swap_slot_t *swap_free_slots;
+
+/**
+ * Scratch space for the compressor. Shared by all callers, so only used with interrupts disabled.
+ */
+static char         swap_wrkmem[LZ4_WORKMEM_SIZE];
+static char         swap_buffer[ZPOOL_MAX_SIZE];
+
+/**
+ * Where the next shrink pass resumes its sweep of the user address space
+ */
+static unsigned int swap_cursor;
+
+static inline unsigned int
+swap_slot_index (swap_slot_t *slot) {
+  return slot - swap_slots;
+}
+
+static void
+swap_slot_free (swap_slot_t *slot) {
+  zpool_free(slot->obj, slot->size);
+  kstat.swap_pages--;
+  kstat.swap_compressed_bytes -= slot->size;
+
+  slot->obj                    = swap_free_slots;
+  slot->size                   = 0;
+  swap_free_slots              = slot;
+}
+
+/**
+ * Compresses a page into a free slot. Must be called with interrupts disabled.
+ *
+ * @return swap_slot_t* The slot, or NULL if no slot is free, the page doesn't compress well enough
+ * to be worth storing, or the pool is out of memory.
+ */
+static swap_slot_t *
+swap_store (page_t *page) {
+  if (!swap_free_slots) {
+    return NULL;
+  }
+
+  size_t size
+    = lz4_compress(kmap(page), PAGE_SIZE, swap_buffer, sizeof(swap_buffer), swap_wrkmem);
+  kunmap(page);
+  if (!size) {
+    kstat.swap_rejects++;
+    return NULL;
+  }
+
+  // We're called from reclaim, so waiting on reclaim for the pool's memory would never return
+  void *obj;
+  if (!(obj = zpool_alloc(size, GFP_HIGH))) {
+    return NULL;
+  }
+  kmemcpy(obj, swap_buffer, size);
+
+  swap_slot_t *slot  = swap_free_slots;
+  swap_free_slots    = slot->obj;
+  slot->obj          = obj;
+  slot->size         = size;
+
+  kstat.swap_pages++;
+  kstat.swap_compressed_bytes += size;
+
+  return slot;
+}
+
+/**
+ * Whether the frame is an ordinary anonymous page that only this mapping refers to
+ */
+static inline bool
+swap_page_eligible (page_t *page) {
+  return page && page->usage_count == 1 && !page->cache
+      && !(page->flags & (PAGE_LOCKED | PAGE_BUDDY | PAGE_SLAB | PAGE_RESERVED | PAGE_COW));
+}
+
+/**
+ * Swaps out the page mapped by `pte`, unless it has been accessed since the last sweep, in which
+ * case it gets a second chance. Pages whose accessed bit is cleared are added to `tlb` so their
+ * stale TLB entries, which would keep the bit from being set again, are flushed in one go.
+ *
+ * @return RET_OK if the frame was released
+ */
+static retval_t
+swap_out (pte_t *pte, unsigned int addr, tlb_gather_t *tlb) {
+  if (!(*pte & PAGE_PRESENT)) {
+    return RET_FAIL;
+  }
+
+  if (*pte & PAGE_ACCESSED) {
+    *pte &= ~PAGE_ACCESSED;
+    tlb_gather_page(tlb, addr, NULL);
+    return RET_FAIL;
+  }
+
+  INTERRUPTS_OFF();
+
+  page_t      *page = PTE_PAGE(*pte);
+  swap_slot_t *slot;
+  if (!swap_page_eligible(page) || !(slot = swap_store(page))) {
+    INTERRUPTS_ON();
+    return RET_FAIL;
+  }
+
+  // The page must not be written through a stale TLB entry once it has been compressed, so this
+  // can't wait for a batched flush
+  *pte = (swap_slot_index(slot) << PAGE_SHIFT) | PAGE_SWAPPED | (*pte & (PAGE_RW | PAGE_USER));
+  tlb_flush_page(addr);
+
+  INTERRUPTS_ON();
+
+  page_release(page);
+
+  return RET_OK;
+}
+
+retval_t
+swap_in (pte_t *pte, unsigned int addr) {
+  page_t *page;
+  if (!(page = page_get_free(GFP_HIGHUSER))) {
+    return RET_FAIL;
+  }
+
+  INTERRUPTS_OFF();
+
+  // We may have slept waiting for a frame, during which somebody else could have faulted the page
+  // back in
+  if (!(*pte & PAGE_SWAPPED)) {
+    INTERRUPTS_ON();
+    page_release(page);
+    return (*pte & PAGE_PRESENT) ? RET_OK : RET_FAIL;
+  }
+
+  unsigned int index = (unsigned int)(*pte >> PAGE_SHIFT);
+  int          size  = 0;
+  if (index < NUM_SWAP_SLOTS) {
+    size = lz4_decompress(swap_slots[index].obj, swap_slots[index].size, kmap(page), PAGE_SIZE);
+    kunmap(page);
+  }
+
+  if (size != PAGE_SIZE) {
+    INTERRUPTS_ON();
+    klogf_warn("%s(): corrupt swap entry 0x%x at 0x%x\n", __func__, (unsigned int)*pte, addr);
+    page_release(page);
+    return RET_FAIL;
+  }
+
+  *pte = page_to_phys(page) | PAGE_PRESENT | (*pte & (PAGE_RW | PAGE_USER));
+  swap_slot_free(&swap_slots[index]);
+  kstat.swap_faults++;
+
+  INTERRUPTS_ON();
+
+  tlb_flush_page(addr);
+
+  return RET_OK;
+}
+
+/**
+ * Compresses anonymous user pages into swap when memory runs low. A clock hand sweeps the user
+ * address space, so that pages which are still in use keep getting their accessed bit set before
+ * the hand comes around again.
+ */
+static int
+swap_shrink (int nr_pages) {
+  int          released = 0;
+  unsigned int scanned  = 0;
+  tlb_gather_t tlb;
+
+  tlb_gather_init(&tlb);
+
+  while (scanned < SWAP_SCAN_PAGES && released < nr_pages) {
+    unsigned int addr = swap_cursor;
+    pte_t       *pte  = paging_get_pte(kpage_dir, addr, false);
+    // Skip the whole range if there's no page table for it
+    unsigned int next = pte ? addr + PAGE_SIZE : (addr & ~(PGDIR_SIZE - 1)) + PGDIR_SIZE;
+
+    scanned          += (next - addr) >> PAGE_SHIFT;
+    swap_cursor       = next < KERNEL_PAGE_OFFSET ? next : 0;
+
+    if (pte && swap_out(pte, addr, &tlb) == RET_OK) {
+      released++;
+    }
+  }
+
+  tlb_gather_finish(&tlb);
+
+  return released;
+}
+
+static shrinker_t swap_shrinker = {.shrink = &swap_shrink};
+
+void
+swap_init (void) {
+  if (!(swap_slots = vmalloc(NUM_SWAP_SLOTS * sizeof(swap_slot_t)))) {
+    klogf_warn("%s(): not enough memory for the swap slots, swap is disabled\n", __func__);
+    return;
+  }
+
+  swap_free_slots = NULL;
+  for (unsigned int n = NUM_SWAP_SLOTS; n--;) {
+    swap_slots[n].obj  = swap_free_slots;
+    swap_slots[n].size = 0;
+    swap_free_slots    = &swap_slots[n];
+  }
+
+  zpool_init();
+  shrinker_register(&swap_shrinker);
+}
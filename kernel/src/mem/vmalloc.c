@@ -0,0 +1,182 @@
+#include "mem/vmalloc.h"
+
+#include "arch/interrupt.h"
+#include "arch/tlb.h"
+#include "drivers/dev/char/tmpcon.h"
+#include "kernel.h"
+#include "kstat.h"
+#include "lib/compiler.h"
+#include "mem/alloc.h"
+#include "mem/allocprof.h"
+#include "mem/base.h"
+#include "mem/paging.h"
+#include "mem/slab.h"
+
+unsigned int vmalloc_start;
+
+/**
+ * Areas currently in use, sorted by address
+ */
+static list_head_t   vm_area_list = list_head(vm_area_list);
+
+static kmem_cache_t *vm_area_cache;
+
+/**
+ * Finds the lowest free range of `size` bytes in the vmalloc area and links `area` into it.
+ *
+ * @return RET_FAIL if the address space is too fragmented or exhausted
+ */
+static retval_t
+vm_area_insert (vm_area_t *area, unsigned int size) {
+  unsigned int addr = vmalloc_start;
+  vm_area_t   *next;
+
+  INTERRUPTS_OFF();
+
+  // First fit; the gap before each area is checked in turn
+  list_foreach_entry(next, &vm_area_list, list) {
+    if (addr + size <= next->addr) {
+      break;
+    }
+    addr = next->addr + next->size;
+  }
+
+  if (addr + size > VMALLOC_END || addr + size < addr) {
+    INTERRUPTS_ON();
+    return RET_FAIL;
+  }
+
+  area->addr = addr;
+  area->size = size;
+  // If no gap was found, `next` is the list head itself and the area goes on the end
+  list_append(&area->list, next->list.prev);
+
+  INTERRUPTS_ON();
+
+  return RET_OK;
+}
+
+static vm_area_t *
+vm_area_find (unsigned int addr) {
+  vm_area_t *area;
+
+  list_foreach_entry(area, &vm_area_list, list) {
+    if (area->addr == addr) {
+      return area;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Unmaps and releases the first `nr_pages` frames of an area.
+ */
+static void
+vm_area_unmap (vm_area_t *area, unsigned int nr_pages) {
+  tlb_gather_t tlb;
+  tlb_gather_init(&tlb);
+
+  for (unsigned int n = 0; n < nr_pages; n++) {
+    unsigned int addr                       = area->addr + (n << PAGE_SHIFT);
+
+    *paging_get_pte(kpage_dir, addr, false) = 0;
+    tlb_gather_page(&tlb, addr, area->pages[n]);
+    kstat.vmalloc_pages--;
+  }
+
+  tlb_gather_finish(&tlb);
+}
+
+static void
+vm_area_destroy (vm_area_t *area) {
+  INTERRUPTS_OFF();
+  list_remove(&area->list);
+  INTERRUPTS_ON();
+
+  kfree((unsigned int)area->pages);
+  kmem_cache_free(vm_area_cache, area);
+}
+
+overridable void *
+vmalloc (size_t size) {
+  if (!size) {
+    return NULL;
+  }
+
+  // The frames are attributed to our caller rather than to us
+  unsigned int site = ALLOCPROF_CALLER();
+
+  vm_area_t *area;
+  if (!(area = kmem_cache_alloc(vm_area_cache, GFP_KERNEL))) {
+    return NULL;
+  }
+
+  area->nr_pages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+  if (!(area->pages = (page_t **)kmalloc(area->nr_pages * sizeof(page_t *), GFP_KERNEL))) {
+    kmem_cache_free(vm_area_cache, area);
+    return NULL;
+  }
+
+  // Leave an unmapped page after each area so running off its end faults
+  if (vm_area_insert(area, (area->nr_pages + 1) << PAGE_SHIFT) == RET_FAIL) {
+    klogf_warn("%s(): out of vmalloc space for %d bytes\n", __func__, size);
+    kfree((unsigned int)area->pages);
+    kmem_cache_free(vm_area_cache, area);
+    return NULL;
+  }
+
+  for (unsigned int n = 0; n < area->nr_pages; n++) {
+    unsigned int addr = area->addr + (n << PAGE_SHIFT);
+    // Color the frames after their virtual addresses, so the buffer is as cache-friendly as a
+    // physically contiguous one. The area is mapped separately, so highmem will do.
+    page_t      *page = page_get_free_color(GFP_KERNEL | GFP_HIGHMEM, page_color(addr));
+    pte_t       *pte;
+
+    // Page tables in the vmalloc area live in the kernel page directory, which every process shares
+    if (!page || !(pte = paging_get_pte(kpage_dir, addr, true))) {
+      if (page) {
+        page_release(page);
+      }
+      vm_area_unmap(area, n);
+      vm_area_destroy(area);
+      return NULL;
+    }
+
+    area->pages[n] = page;
+    *pte           = page_to_phys(page) | PAGE_PRESENT | PAGE_RW | tlb_global;
+    kstat.vmalloc_pages++;
+    allocprof_page_alloc(page, GFP_KERNEL, site);
+  }
+
+  return (void *)area->addr;
+}
+
+void
+vfree (void *addr) {
+  if (!addr) {
+    return;
+  }
+
+  vm_area_t *area;
+  if (!(area = vm_area_find((unsigned int)addr))) {
+    klogf_warn("%s(): 0x%x was not allocated by vmalloc\n", __func__, addr);
+    return;
+  }
+
+  vm_area_unmap(area, area->nr_pages);
+  vm_area_destroy(area);
+}
+
+void
+vmalloc_init (void) {
+  unsigned int direct_end = kstat.physical_pages << PAGE_SHIFT;
+  unsigned int table_size = 1 << PGDIR_SHIFT;
+
+  // Start on a page table boundary so the area never shares a page table with the direct map
+  direct_end              = P2V(direct_end);
+  vmalloc_start           = (direct_end + VMALLOC_OFFSET + (table_size - 1)) & ~(table_size - 1);
+
+  list_init(&vm_area_list);
+  vm_area_cache = kmem_cache_create("vm_area", sizeof(vm_area_t), 0, NULL);
+}
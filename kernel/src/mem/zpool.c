@@ -0,0 +1,62 @@
+#include "mem/zpool.h"
+
+#include "kernel.h"
+#include "lib/printf.h"
+#include "mem/slab.h"
+
+/**
+ * One cache per size class; class `n` holds objects of up to (n + 1) * ZPOOL_CLASS_SIZE bytes
+ */
+static kmem_cache_t *zpool_classes[ZPOOL_NUM_CLASSES];
+
+static inline kmem_cache_t *
+zpool_class (size_t size) {
+  return zpool_classes[(size - 1) / ZPOOL_CLASS_SIZE];
+}
+
+void *
+zpool_alloc (size_t size, gfp_t gfp) {
+  if (!size || size > ZPOOL_MAX_SIZE) {
+    return NULL;
+  }
+
+  kmem_cache_t *cache = zpool_class(size);
+  if (!cache) {
+    return NULL;
+  }
+
+  return kmem_cache_alloc(cache, gfp);
+}
+
+void
+zpool_free (void *obj, size_t size) {
+  if (!obj) {
+    return;
+  }
+
+  kmem_cache_free(zpool_class(size), obj);
+}
+
+unsigned int
+zpool_pages (void) {
+  unsigned int pages = 0;
+
+  // Counted on demand, since the slab allocator's shrinker also releases the classes' empty slabs
+  for (unsigned int n = 0; n < ZPOOL_NUM_CLASSES; n++) {
+    if (zpool_classes[n]) {
+      pages += zpool_classes[n]->num_slabs;
+    }
+  }
+
+  return pages;
+}
+
+void
+zpool_init (void) {
+  for (unsigned int n = 0; n < ZPOOL_NUM_CLASSES; n++) {
+    char name[KMEM_CACHE_NAME_LEN];
+    snprintf(name, sizeof(name), "zpool-%d", (n + 1) * ZPOOL_CLASS_SIZE);
+
+    zpool_classes[n] = kmem_cache_create(name, (n + 1) * ZPOOL_CLASS_SIZE, 0, NULL);
+  }
+}
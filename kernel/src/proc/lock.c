@@ -19,8 +19,8 @@ lock_resource (resource_t *resource) {
 
     if (resource->locked) {
       resource->wanted = 1;
+      sleep_on_exclusive(&resource->wait, PROC_UNINTERRUPTIBLE);
       INTERRUPTS_ON();
-      sleep(resource, PROC_UNINTERRUPTIBLE);
     } else {
       break;
     }
@@ -36,8 +36,9 @@ unlock_resource (resource_t *resource) {
 
   resource->locked = false;
   if (resource->wanted) {
-    resource->wanted = false;
-    wakeup(resource);
+    // Only one waiter is woken up, so the resource is still wanted by the rest
+    wakeup(&resource->wait);
+    resource->wanted = wait_queue_active(&resource->wait);
   }
 
   INTERRUPTS_ON();
@@ -0,0 +1,41 @@
+#include "proc/preempt.h"
+
+#include "arch/eflags.h"
+#include "arch/interrupt.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+void
+preempt_disable (void) {
+  proc_current->preempt_count++;
+}
+
+void
+preempt_enable_no_resched (void) {
+  proc_current->preempt_count--;
+}
+
+void
+preempt_enable (void) {
+  preempt_enable_no_resched();
+  preempt_check_resched();
+}
+
+bool
+preemptible (void) {
+  return !proc_current->preempt_count && int_enabled();
+}
+
+void
+preempt_check_resched (void) {
+  if (needs_resched && preemptible()) {
+    sched_run();
+  }
+}
+
+void
+preempt_schedule_irq (unsigned int eflags) {
+  if (needs_resched && !proc_current->preempt_count && (eflags & EFLAGS_INT_ENABLED)) {
+    sched_run();
+  }
+}
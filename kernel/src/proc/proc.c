@@ -1,11 +1,18 @@
 #include "proc/proc.h"
 
 #include "arch/interrupt.h"
+#include "arch/tss.h"
+#include "debug/panic.h"
+#include "drivers/dev/char/tmpcon.h"
 #include "lib/compiler.h"
+#include "lib/errno.h"
 #include "lib/string.h"
 #include "mem/alloc.h"
 #include "mem/base.h"
+#include "mem/page.h"
+#include "mem/segments.h"
 #include "proc/lock.h"
+#include "proc/sched.h"
 #include "proc/sleep.h"
 
 proc_t *proc_current;
@@ -14,8 +21,6 @@ proc_t *proc_list;
 proc_t *proc_list_head;
 proc_t *proc_list_tail;
 
-proc_t *proc_running_list;
-
 /**
  * Head pointer into linked list of free processes
  */
@@ -28,6 +33,116 @@ static unsigned int proc_free_list_size = 0;
 
 static resource_t lock                  = {.locked = 0, .wanted = 0};
 
+/**
+ * The last pid handed out. Pids up to and including the init process are reserved.
+ */
+static pid_t last_pid                   = PROC_INIT_PID;
+
+static void
+proc_set_name (proc_t *p, const char *name) {
+  for (unsigned int n = 0; name[n] && n < PROC_NAME_LEN - 1; n++) {
+    p->name[n] = name[n];
+  }
+}
+
+/**
+ * Takes a process off the free list, assigns it a pid and appends it to the process list.
+ */
+static proc_t *
+proc_get_new (void) {
+  lock_resource(&lock);
+
+  proc_t *p;
+  if (!(p = proc_free_list)) {
+    unlock_resource(&lock);
+    return NULL;
+  }
+  proc_free_list = p->next;
+  proc_free_list_size--;
+
+  kmemset(p, 0, sizeof(proc_t));
+  p->pid  = ++last_pid;
+
+  p->prev = proc_list_tail;
+  if (proc_list_tail) {
+    proc_list_tail->next = p;
+  } else {
+    proc_list_head = p;
+  }
+  proc_list_tail = p;
+
+  unlock_resource(&lock);
+
+  return p;
+}
+
+/**
+ * The first code run by a new kernel process. Entered with interrupts disabled, by way of the
+ * context switch that first selected the process.
+ */
+static noreturn void
+kproc_start (void (*fn)(void)) {
+  int_enable();
+  fn();
+
+  kpanic("Kernel process %s returned.\n", proc_current->name);
+}
+
+proc_t *
+proc_get (pid_t pid) {
+  for (proc_t *p_iter = proc_list_head; p_iter; p_iter = p_iter->next) {
+    if (p_iter->pid == pid && p_iter->state != PROC_ZOMBLEY) {
+      return p_iter;
+    }
+  }
+
+  return NULL;
+}
+
+int
+sys_ioperm (unsigned int from, unsigned int num, int turn_on) {
+  if (from + num < from || from + num > IO_BITMAP_SIZE * 8) {
+    return -EINVAL;
+  }
+
+  proc_t *p = proc_current;
+  if (!p->io_bitmap) {
+    // Nothing to revoke
+    if (!turn_on) {
+      return 0;
+    }
+
+    unsigned int bitmap;
+    if (!(bitmap = kmalloc(IO_BITMAP_SIZE, GFP_KERNEL))) {
+      return -ENOMEM;
+    }
+    kmemset((void *)bitmap, 0xFF, IO_BITMAP_SIZE);
+    p->io_bitmap = (unsigned char *)bitmap;
+  }
+
+  INTERRUPTS_OFF();
+
+  for (unsigned int port = from; port < from + num; port++) {
+    if (turn_on) {
+      p->io_bitmap[port >> 3] &= ~(1 << (port & 7));
+    } else {
+      p->io_bitmap[port >> 3] |= 1 << (port & 7);
+    }
+  }
+
+  unsigned int size = (from + num + 7) >> 3;
+  if (turn_on && size > p->io_bitmap_size) {
+    p->io_bitmap_size = size;
+  }
+
+  // We're the current process, so the TSS holds our bitmap already
+  tss_set_io_bitmap(p->io_bitmap, p->io_bitmap_size);
+
+  INTERRUPTS_ON();
+
+  return 0;
+}
+
 bool
 proc_is_orphaned_pgrp (pid_t pgid) {
   lock_resource(&lock);
@@ -67,11 +182,11 @@ pid_t
 proc_release_zombley (proc_t *p) {
   pid_t pid = p->pid;
   // Free the kernel-mode stack allocated for this process
-  kfree(p->tss.esp0);
+  kfree(p->thread.esp0);
   // One less page
   p->rss--;
   // Free the page directory allocated to this process
-  kfree(P2V(p->tss.cr3));
+  kfree(P2V(p->thread.cr3));
   // Another less page
   p->rss--;
 
@@ -101,6 +216,10 @@ proc_release (proc_t *p) {
     p->next->prev = p->prev;
   }
 
+  if (p->io_bitmap) {
+    kfree((unsigned int)p->io_bitmap);
+  }
+
   // TODO: Fix root Makefile test targets et al
   kmemset(p, 0, sizeof(proc_t));
   p->next        = proc_free_list;
@@ -119,14 +238,8 @@ proc_runnable (proc_t *p) {
 
   INTERRUPTS_OFF();
 
-  // TODO: separate fn
-  if (proc_running_list) {
-    p->next_running                 = proc_running_list;
-    proc_running_list->prev_running = p;
-  }
-  proc_running_list = p;
-
-  p->state          = PROC_RUNNING;
+  p->state = PROC_RUNNING;
+  sched_enqueue(p);
 
   INTERRUPTS_ON();
 }
@@ -135,26 +248,59 @@ overridable void
 proc_not_runnable (proc_t *p, proc_state state) {
   INTERRUPTS_OFF();
 
-  if (p->next_running) {
-    p->next_running->prev_running = p->prev_running;
+  sched_dequeue(p);
+  p->state = state;
+
+  INTERRUPTS_ON();
+}
+
+overridable proc_t *
+kproc_create (const char *name, void (*fn)(void)) {
+  proc_t *p;
+  if (!(p = proc_get_new())) {
+    klogf_warn("%s(): no free process slot for %s\n", __func__, name);
+    return NULL;
   }
-  if (p->prev_running) {
-    p->prev_running->next_running = p->next_running;
+
+  unsigned int stack;
+  if (!(stack = kmalloc(PAGE_SIZE, GFP_KERNEL))) {
+    klogf_warn("%s(): unable to allocate a stack for %s\n", __func__, name);
+    proc_release(p);
+    return NULL;
   }
-  if (p == proc_running_list) {
-    proc_running_list = p->next_running;
+
+  proc_set_name(p, name);
+  p->parent              = &proc_list[PROC_IDLE_PID];
+  p->parent->children++;
+  p->flags               = PROC_FLAG_KPROC;
+  p->priority            = PROC_DEFAULT_PRIORITY;
+  p->remaining_cpu_time  = PROC_DEFAULT_PRIORITY;
+
+  // Lay out the stack as though `kproc_start` had been called with `fn`, and the process had been
+  // switched away from right at its start. The first context switch into the process restores the
+  // zeroed callee-saved registers and "returns" to `kproc_start`, which never returns itself.
+  unsigned int *sp       = (unsigned int *)(stack + PAGE_SIZE);
+  *--sp                  = (unsigned int)fn;
+  *--sp                  = 0;
+  *--sp                  = (unsigned int)kproc_start;
+  for (unsigned int n = 0; n < SWITCH_TO_REGS; n++) {
+    *--sp = 0;
   }
-  p->prev_running = p->next_running = NULL;
-  p->state                          = state;
 
-  INTERRUPTS_ON();
+  p->thread.esp0         = stack + PAGE_SIZE - sizeof(unsigned int);
+  p->thread.esp          = (unsigned int)sp;
+  p->thread.cr3          = kpage_dir_cr3();
+
+  proc_runnable(p);
+
+  return p;
 }
 
 void
 proc_init (void) {
   kmemset(proc_list, 0, proc_list_size);
 
-  // Fill up the free list by reverse-populating it
+  // Fill up the free list by reverse-populating it. The first slot is reserved for the idle process.
   proc_free_list = NULL;
 
   unsigned int n = (proc_list_size / sizeof(proc_t)) - 1;
@@ -163,7 +309,17 @@ proc_init (void) {
     p->next        = proc_free_list;
     proc_free_list = p;
     proc_free_list_size++;
-  } while (n--);
-
-  proc_list_head = proc_list_tail = NULL;
+  } while (--n > PROC_IDLE_PID);
+
+  // The boot context becomes the idle process, which runs whenever nothing else is runnable
+  proc_t *idle     = &proc_list[PROC_IDLE_PID];
+  proc_set_name(idle, "idle");
+  idle->pid        = PROC_IDLE_PID;
+  idle->state      = PROC_IDLE;
+  idle->flags      = PROC_FLAG_KPROC;
+  idle->priority   = PROC_DEFAULT_PRIORITY;
+  idle->thread.cr3 = kpage_dir_cr3();
+
+  proc_list_head = proc_list_tail = idle;
+  proc_current   = idle;
 }
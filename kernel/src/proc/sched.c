@@ -1,12 +1,42 @@
 #include "proc/sched.h"
 
 #include "arch/interrupt.h"
+#include "arch/tss.h"
+#include "arch/x86.h"
+#include "kconfig.h"
 #include "lib/compiler.h"
-#include "mem/segments.h"
+#include "lib/errno.h"
 #include "proc/proc.h"
 
 bool needs_resched = false;
 
+/**
+ * The run queues of the processes with CPU time left in the current round, and of those which have
+ * used theirs up and wait for the next round
+ */
+static sched_array_t  sched_arrays[2];
+static sched_array_t* sched_active  = &sched_arrays[0];
+static sched_array_t* sched_expired = &sched_arrays[1];
+
+/**
+ * The run queues of the real-time processes. They have fixed priorities and aren't recharged in
+ * rounds, so a single set is enough.
+ */
+static sched_array_t  sched_rt;
+
+/**
+ * Ticks into the current real-time throttling period, and how many of them were spent running
+ * real-time processes
+ */
+static unsigned int   sched_rt_period_ticks;
+static unsigned int   sched_rt_ticks;
+
+/**
+ * Set once real-time processes have used up their share of the current period. Until the period
+ * ends, they only run if nobody else wants to.
+ */
+static bool           sched_rt_throttled;
+
 /**
  * Performs a manual context switch, swapping out the current proc task state to that of `next`.
  */
@@ -15,23 +45,251 @@ do_context_switch (proc_t* next) {
   INTERRUPTS_OFF();
 
   proc_t* prev = proc_current;
-  sched_set_tss(next);
   proc_current = next;
-  do_switch(&prev->tss.esp, &prev->tss.eip, next->tss.esp, next->tss.eip, next->tss.cr3, TSS);
+
+  // Interrupts from user mode switch to the kernel stack of whichever process is running
+  tss_set_stack(next->thread.esp0);
+  // Only processes that asked for port access have a bitmap, and the TSS holds the current one's
+  if (prev->io_bitmap || next->io_bitmap) {
+    tss_set_io_bitmap(next->io_bitmap, next->io_bitmap_size);
+  }
+  // Reloading cr3 flushes the TLB, so skip it if the address space is the same
+  if (next->thread.cr3 != prev->thread.cr3) {
+    cr3_set(next->thread.cr3);
+  }
+
+  switch_to(&prev->thread.esp, next->thread.esp);
 
   INTERRUPTS_ON();
 }
 
-overridable void
-sched_set_tss (proc_t* p) {
-  //  Get GDT entry for TSS so we can modify it
-  seg_desc_t* g = &gdt[TSS / sizeof(seg_desc_t)];
-  // Set the low 24 bits of the base address of the TSS.
-  g->low_base   = (unsigned int)&p->tss;
-  // Set type and flags ; mark as TSS and present
-  g->low_flags  = SD_TSS_PRESENT;
-  // Write high 8 bits of base to complete the 32-bit base address
-  g->hi_base    = (char)(((unsigned int)&p->tss) >> 24);
+static inline bool
+sched_is_rt (proc_t* p) {
+  return p->policy != SCHED_OTHER;
+}
+
+/**
+ * Returns the run queue level of the process. Larger real-time priorities and time slices mean
+ * higher priority, and lower levels are picked first.
+ */
+static inline unsigned int
+sched_prio (proc_t* p) {
+  if (sched_is_rt(p)) {
+    return SCHED_MAX_RT_PRIO - p->rt_priority;
+  }
+
+  unsigned int priority = p->priority > 0 ? p->priority : 0;
+  return priority >= SCHED_NUM_PRIOS ? 0 : SCHED_NUM_PRIOS - 1 - priority;
+}
+
+/**
+ * Whether `p` should take the CPU from the current process straight away, i.e. whether it's a
+ * real-time process of a higher priority, or the current process is idle
+ */
+static inline bool
+sched_preempts (proc_t* p) {
+  if (!sched_is_rt(p)) {
+    return false;
+  }
+  if (!proc_current_is_running()) {
+    return true;
+  }
+
+  return !sched_is_rt(proc_current) || p->rt_priority > proc_current->rt_priority;
+}
+
+static void
+sched_array_enqueue (sched_array_t* array, proc_t* p) {
+  unsigned int prio = sched_prio(p);
+  proc_t**     head = &array->queues[prio];
+
+  if (*head) {
+    // Append to the tail, which is the head's predecessor
+    p->next_running               = *head;
+    p->prev_running               = (*head)->prev_running;
+    p->prev_running->next_running = p;
+    (*head)->prev_running         = p;
+  } else {
+    p->next_running  = p->prev_running = p;
+    *head            = p;
+    array->bitmap   |= 1U << prio;
+  }
+
+  p->run_array = array;
+  p->run_prio  = prio;
+  array->nr_running++;
+}
+
+/**
+ * Requeues the current process once it has used up its time slice: time-share processes move to the
+ * expired set, and SCHED_RR ones to the back of their queue.
+ */
+static void
+sched_expire (proc_t* p) {
+  sched_dequeue(p);
+  sched_enqueue(p);
+}
+
+/**
+ * Returns the process to run next, or the idle process if there's none.
+ */
+static proc_t*
+sched_pick_next (void) {
+  // Everybody has used up their time slice, so start a new round
+  if (!sched_active->nr_running) {
+    sched_array_t* array = sched_active;
+    sched_active         = sched_expired;
+    sched_expired        = array;
+  }
+
+  // Real-time processes always go first, unless they've used up their share of the CPU and somebody
+  // else is waiting
+  if (sched_rt.nr_running && (!sched_rt_throttled || !sched_active->nr_running)) {
+    return sched_rt.queues[__builtin_ctz(sched_rt.bitmap)];
+  }
+
+  if (!sched_active->nr_running) {
+    return &proc_list[PROC_IDLE_PID];
+  }
+
+  return sched_active->queues[__builtin_ctz(sched_active->bitmap)];
+}
+
+void
+sched_enqueue (proc_t* p) {
+  if (sched_is_rt(p)) {
+    // A fresh quantum for SCHED_RR. SCHED_FIFO processes never use theirs up.
+    p->remaining_cpu_time = SCHED_RR_QUANTUM;
+    sched_array_enqueue(&sched_rt, p);
+
+    if (sched_preempts(p)) {
+      needs_resched = true;
+    }
+    return;
+  }
+
+  if (p->remaining_cpu_time > 0) {
+    sched_array_enqueue(sched_active, p);
+    return;
+  }
+
+  p->remaining_cpu_time = p->priority;
+  sched_array_enqueue(sched_expired, p);
+}
+
+void
+sched_dequeue (proc_t* p) {
+  sched_array_t* array = p->run_array;
+  if (!array) {
+    return;
+  }
+
+  proc_t** head = &array->queues[p->run_prio];
+  if (p->next_running == p) {
+    *head          = NULL;
+    array->bitmap &= ~(1U << p->run_prio);
+  } else {
+    p->next_running->prev_running = p->prev_running;
+    p->prev_running->next_running = p->next_running;
+    if (*head == p) {
+      *head = p->next_running;
+    }
+  }
+
+  p->prev_running = p->next_running = NULL;
+  p->run_array                      = NULL;
+  array->nr_running--;
+}
+
+void
+sched_tick (void) {
+  if (++sched_rt_period_ticks >= SCHED_RT_PERIOD) {
+    sched_rt_period_ticks = 0;
+    sched_rt_ticks        = 0;
+
+    if (sched_rt_throttled && sched_rt.nr_running) {
+      needs_resched = true;
+    }
+    sched_rt_throttled = false;
+  }
+
+  if (!proc_current_is_running()) {
+    return;
+  }
+
+  if (sched_is_rt(proc_current) && ++sched_rt_ticks >= SCHED_RT_RUNTIME && !sched_rt_throttled) {
+    sched_rt_throttled = true;
+    needs_resched      = true;
+  }
+
+  if (proc_current->policy != SCHED_FIFO && proc_current->remaining_cpu_time > 0
+      && !--proc_current->remaining_cpu_time) {
+    needs_resched = true;
+  }
+}
+
+int
+sched_setscheduler (proc_t* p, unsigned int policy, unsigned int rt_priority) {
+  switch (policy) {
+    case SCHED_OTHER:
+      if (rt_priority) {
+        return -EINVAL;
+      }
+      break;
+    case SCHED_FIFO:
+    case SCHED_RR:
+      if (rt_priority < 1 || rt_priority > SCHED_MAX_RT_PRIO) {
+        return -EINVAL;
+      }
+      break;
+    default:
+      return -EINVAL;
+  }
+
+  INTERRUPTS_OFF();
+
+  bool queued    = p->run_array != NULL;
+  sched_dequeue(p);
+
+  p->policy      = policy;
+  p->rt_priority = rt_priority;
+
+  if (queued) {
+    sched_enqueue(p);
+  }
+
+  // The current process may no longer be the one that should be running
+  if (p == proc_current) {
+    needs_resched = true;
+  }
+
+  INTERRUPTS_ON();
+
+  return 0;
+}
+
+int
+sys_sched_setscheduler (pid_t pid, int policy, int rt_priority) {
+  proc_t* p;
+  if (!(p = pid ? proc_get(pid) : proc_current)) {
+    return -ESRCH;
+  }
+
+  if (policy < 0 || rt_priority < 0) {
+    return -EINVAL;
+  }
+
+  return sched_setscheduler(p, policy, rt_priority);
+}
+
+int
+sys_sched_getscheduler (pid_t pid) {
+  proc_t* p;
+  if (!(p = pid ? proc_get(pid) : proc_current)) {
+    return -ESRCH;
+  }
+
+  return p->policy;
 }
 
 overridable void
@@ -43,40 +301,27 @@ sched_run (void) {
   }
   needs_resched = false;
 
-  proc_t* proc_to_run_next;
-  while (true) {
-    int count        = -1;
-    // Fallback to idle proc if no other process is eligible for scheduling at this time
-    proc_to_run_next = &proc_list[PROC_IDLE_PID];
-
-    // Find the running process with the highest remaining CPU time slice
-    proc_t* p_iter   = proc_running_list;
-    while (p_iter) {
-      if (p_iter->remaining_cpu_time > count) {
-        count            = p_iter->remaining_cpu_time;
-        proc_to_run_next = p_iter;
-      }
-
-      p_iter = p_iter->next_running;
-    }
+  // Keep the scheduler from preempting itself once interrupts are back on. The count stays raised
+  // while we're switched away from, and drops once we're switched back to.
+  proc_t* prev = proc_current;
+  prev->preempt_count++;
 
-    if (count) {
-      break;
-    }
+  INTERRUPTS_OFF();
 
-    // If no processes were eligible, recharge all of them by resetting their time slice to
-    // `priority`
-    p_iter = proc_running_list;
-    while (p_iter) {
-      p_iter->remaining_cpu_time = p_iter->priority;
-      p_iter                     = p_iter->next_running;
-    }
+  if (proc_current_is_running() && !proc_current_has_remaining_cpu_time_remaining()) {
+    sched_expire(proc_current);
   }
 
+  proc_t* proc_to_run_next = sched_pick_next();
+
+  INTERRUPTS_ON();
+
   // If the current process isn't the selected one, switch to the new process.
   if (proc_current != proc_to_run_next) {
     do_context_switch(proc_to_run_next);
   }
+
+  prev->preempt_count--;
 }
 
 void
@@ -1,31 +1,53 @@
 #include "proc/sleep.h"
 
 #include "arch/interrupt.h"
-#include "kconfig.h"
+#include "interrupt/timer.h"
 #include "lib/compiler.h"
-#include "lib/string.h"
+#include "lib/errno.h"
 #include "proc/proc.h"
 #include "proc/sched.h"
 
 /**
- * The number of buckets in the sleep hash table.
- * Approx ~10% of processes
+ * Takes a sleeping process off its wait queue and makes it runnable again. Must be called with
+ * interrupts disabled.
  */
-#define NUM_SLEEP_HASH_TABLE_BUCKETS ((NUM_PROCS * 10) / 100)
+static void
+sleep_wake (proc_t *p) {
+  list_remove(&p->wait_list);
+  p->wait_queue          = NULL;
 
-/**
- * Computes a hash key for the sleep hash table
- */
-#define TO_SLEEP_TABLE_HASH(addr)    ((addr) % (NUM_SLEEP_HASH_TABLE_BUCKETS))
+  // Clear the non-interruptible sleep flag, and restore the CPU quantum
+  p->remaining_cpu_time  = p->priority;
+  p->flags              &= ~PROC_FLAG_NOTINTERRUPT;
+
+  proc_runnable(p);
+  needs_resched = true;
+}
 
 /**
- * A hash table for storing sleeping processes. Keys are the address of a resource being slept on,
- * and values are a linked list of processes sleeping on that resource
+ * Wakes up a process whose sleep timed out, unless it has been woken up already. Run as a timer task.
  */
-static proc_t *sleep_hash_table[NUM_SLEEP_HASH_TABLE_BUCKETS];
+static void
+sleep_timeout (unsigned int arg) {
+  proc_t *p = (proc_t *)arg;
 
-overridable int
-sleep (void *addr, proc_inttype state) {
+  INTERRUPTS_OFF();
+
+  if (p->wait_queue) {
+    p->wait_flags |= WAIT_TIMED_OUT;
+    sleep_wake(p);
+  }
+
+  INTERRUPTS_ON();
+}
+
+static int
+sleep_on_common (
+  wait_queue_head_t *wq,
+  proc_inttype       state,
+  unsigned int       wait_flags,
+  unsigned int       ticks
+) {
   INTERRUPTS_OFF();
 
   int signum = 0;
@@ -43,86 +65,101 @@ sleep (void *addr, proc_inttype state) {
     goto done;
   }
 
-  int      key  = TO_SLEEP_TABLE_HASH((unsigned int)addr);
-  proc_t **head = &sleep_hash_table[key];
+  if (!wq->waiters.next) {
+    list_init(&wq->waiters);
+  }
 
-  // Insert the current process as the head of the list
-  if (!*head) {
-    *head                  = proc_current;
-    (*head)->prev_sleeping = (*head)->next_sleeping = NULL;
+  // Exclusive waiters queue up behind the others, so that waking up stops at the first of them
+  if (wait_flags & WAIT_EXCLUSIVE) {
+    list_append(&proc_current->wait_list, wq->waiters.prev);
   } else {
-    proc_current->prev_sleeping = NULL;
-    proc_current->next_sleeping = *head;
-    (*head)->prev_sleeping      = proc_current;
-    *head                       = proc_current;
+    list_append(&proc_current->wait_list, &wq->waiters);
   }
-
-  proc_current->sleep_addr = addr;
+  proc_current->wait_queue = wq;
+  proc_current->wait_flags = wait_flags;
 
   if (state == PROC_UNINTERRUPTIBLE) {
     proc_current->flags |= PROC_FLAG_NOTINTERRUPT;
   }
+
+  timer_task_request_t timeout = {.fn = &sleep_timeout, .arg = (unsigned int)proc_current};
+  if (ticks) {
+    timer_task_add(&timeout, ticks);
+  }
+
   proc_not_runnable(proc_current, PROC_SLEEPING);
 
   sched_run();
 
-  // Check again for signals
-  signum = 0;
-  if (state == PROC_INTERRUPTIBLE) {
-    signum = sig_get();
+  if (ticks) {
+    timer_task_remove(&timeout);
+  }
+
+  bool woken = !proc_current->wait_queue;
+  if (!woken) {
+    // Something other than the queue made us runnable again, e.g. a signal
+    list_remove(&proc_current->wait_list);
+    proc_current->wait_queue = NULL;
   }
 
+  if (proc_current->wait_flags & WAIT_TIMED_OUT) {
+    signum = -ETIMEDOUT;
+  } else if (state == PROC_INTERRUPTIBLE && (signum = sig_get()) && woken
+             && (wait_flags & WAIT_EXCLUSIVE)) {
+    // We won't make use of the wakeup, so hand it to the next exclusive waiter
+    wakeup(wq);
+  }
+  proc_current->wait_flags = 0;
+
 done:
   INTERRUPTS_ON();
   return signum;
 }
 
-overridable void
-wakeup (void *addr) {
+overridable int
+sleep_on (wait_queue_head_t *wq, proc_inttype state) {
+  return sleep_on_common(wq, state, 0, 0);
+}
+
+overridable int
+sleep_on_exclusive (wait_queue_head_t *wq, proc_inttype state) {
+  return sleep_on_common(wq, state, WAIT_EXCLUSIVE, 0);
+}
+
+overridable int
+sleep_on_timeout (wait_queue_head_t *wq, proc_inttype state, unsigned int ticks) {
+  return sleep_on_common(wq, state, 0, ticks);
+}
+
+static void
+wakeup_common (wait_queue_head_t *wq, bool all) {
+  if (!wait_queue_active(wq)) {
+    return;
+  }
+
   INTERRUPTS_OFF();
 
-  // Grab the bucket from the hash table
-  int      key  = TO_SLEEP_TABLE_HASH((unsigned int)addr);
-  proc_t **head = &sleep_hash_table[key];
-
-  // Find the processes sleeping on addr
-  while (*head) {
-    // Once found...
-    if ((*head)->sleep_addr == addr) {
-      // Clear the sleep state, non-interruptible sleep flag, and restore the CPU quantum
-      (*head)->sleep_addr          = NULL;
-      (*head)->remaining_cpu_time  = (*head)->priority;
-      (*head)->flags              &= ~PROC_FLAG_NOTINTERRUPT;
-
-      // Make it runnable again and indicate we need to reschedule
-      proc_runnable(*head);
-      needs_resched = true;
-
-      // Remove from the sleeping list
-      if ((*head)->next_sleeping) {
-        (*head)->next_sleeping->prev_sleeping = (*head)->prev_sleeping;
-      }
-      if ((*head)->prev_sleeping) {
-        (*head)->prev_sleeping->next_sleeping = (*head)->next_sleeping;
-      }
-
-      // If it was the list head, we need to update the head pointer itself
-      if (head == &sleep_hash_table[key]) {
-        *head = (*head)->next_sleeping;
-        continue;
-      }
-    }
+  list_head_t *curr = wq->waiters.next;
+  while (curr != &wq->waiters) {
+    proc_t *p  = list_entry(curr, proc_t, wait_list);
+    curr       = curr->next;
 
-    if (*head) {
-      head = &(*head)->next_sleeping;
+    bool stop  = !all && (p->wait_flags & WAIT_EXCLUSIVE);
+    sleep_wake(p);
+    if (stop) {
+      break;
     }
   }
 
   INTERRUPTS_ON();
 }
 
-void
-sleep_init (void) {
-  proc_running_list = NULL;
-  kmemset(sleep_hash_table, 0, sizeof(sleep_hash_table));
+overridable void
+wakeup (wait_queue_head_t *wq) {
+  wakeup_common(wq, false);
+}
+
+overridable void
+wakeup_all (wait_queue_head_t *wq) {
+  wakeup_common(wq, true);
 }
@@ -1,5 +1,35 @@
 #include "syscall/syscall.h"
 
+#include "lib/errno.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+typedef int (*syscall_fn_t)(int arg_1, int arg_2, int arg_3, int arg_4, int arg_5);
+
+static int
+syscall_ioperm (int from, int num, int turn_on, int arg_4, int arg_5) {
+  return sys_ioperm(from, num, turn_on);
+}
+
+static int
+syscall_sched_setscheduler (int pid, int policy, int rt_priority, int arg_4, int arg_5) {
+  return sys_sched_setscheduler(pid, policy, rt_priority);
+}
+
+static int
+syscall_sched_getscheduler (int pid, int arg_2, int arg_3, int arg_4, int arg_5) {
+  return sys_sched_getscheduler(pid);
+}
+
+/**
+ * The syscalls, indexed by number
+ */
+static syscall_fn_t syscall_table[NUM_SYSCALLS] = {
+  [SYS_IOPERM]             = &syscall_ioperm,
+  [SYS_SCHED_SETSCHEDULER] = &syscall_sched_setscheduler,
+  [SYS_SCHED_GETSCHEDULER] = &syscall_sched_getscheduler,
+};
+
 int
 syscall_exec (
   unsigned int   num,
@@ -10,5 +40,9 @@ syscall_exec (
   int            arg_5,
   sig_context_t* sc
 ) {
-  return 1;
+  if (num >= NUM_SYSCALLS || !syscall_table[num]) {
+    return -ENOSYS;
+  }
+
+  return syscall_table[num](arg_1, arg_2, arg_3, arg_4, arg_5);
 }
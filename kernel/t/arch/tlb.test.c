@@ -0,0 +1,142 @@
+#include "arch/tlb.h"
+
+#include <string.h>
+
+#include "../stubs.h"
+#include "libtap/libtap.h"
+#include "mem/base.h"
+
+#define USER_ADDR 0x08048000
+
+static page_t mock_pages[TLB_GATHER_PAGES + 1];
+static int    pages_flushed;
+static int    full_flushes;
+static int    global_flushes;
+static int    pages_released;
+
+/**
+ * How many flushes had happened when the first frame was released
+ */
+static int flushes_before_release;
+
+void
+tlb_flush_page (unsigned int addr) {
+  pages_flushed++;
+}
+
+void
+tlb_flush_all (void) {
+  full_flushes++;
+}
+
+void
+tlb_flush_global (void) {
+  global_flushes++;
+}
+
+void
+page_release (page_t *page) {
+  if (!pages_released++) {
+    flushes_before_release = pages_flushed + full_flushes + global_flushes;
+  }
+}
+
+static void
+reset_mocks (void) {
+  memset(mock_pages, 0, sizeof(mock_pages));
+  pages_flushed          = 0;
+  full_flushes           = 0;
+  global_flushes         = 0;
+  pages_released         = 0;
+  flushes_before_release = 0;
+}
+
+static void
+finish_flushes_then_releases_test (void) {
+  tlb_gather_t tlb;
+  tlb_gather_init(&tlb);
+
+  tlb_gather_page(&tlb, USER_ADDR + PAGE_SIZE, &mock_pages[0]);
+  tlb_gather_page(&tlb, USER_ADDR, &mock_pages[1]);
+  tlb_gather_page(&tlb, USER_ADDR + 3 * PAGE_SIZE, NULL);
+
+  eq_num(pages_flushed, 0, "Nothing is flushed while gathering");
+  eq_num(pages_released, 0, "Nothing is released while gathering");
+
+  tlb_gather_finish(&tlb);
+
+  eq_num(pages_flushed, 4, "The whole gathered range is flushed");
+  eq_num(pages_released, 2, "Only the gathered frames are released");
+  eq_num(flushes_before_release, 4, "Frames are released after the flush");
+  eq_num(tlb.nr_pages, 0, "The gather is empty afterwards");
+}
+
+static void
+full_gather_flushes_and_releases_test (void) {
+  tlb_gather_t tlb;
+  tlb_gather_init(&tlb);
+
+  for (int n = 0; n < TLB_GATHER_PAGES - 1; n++) {
+    tlb_gather_page(&tlb, USER_ADDR + (n << PAGE_SHIFT), &mock_pages[n]);
+  }
+  eq_num(pages_released, 0, "Frames are held until the gather is full");
+
+  tlb_gather_page(&tlb, USER_ADDR + ((TLB_GATHER_PAGES - 1) << PAGE_SHIFT), &mock_pages[0]);
+
+  eq_num(pages_released, TLB_GATHER_PAGES, "A full gather releases its frames");
+  eq_num(pages_flushed, TLB_GATHER_PAGES, "A full gather flushes its range first");
+  eq_num(tlb.nr_pages, 0, "A full gather starts over");
+
+  tlb_gather_page(&tlb, USER_ADDR, &mock_pages[TLB_GATHER_PAGES]);
+  tlb_gather_finish(&tlb);
+
+  eq_num(pages_released, TLB_GATHER_PAGES + 1, "Frames gathered after that are released on finish");
+  eq_num(pages_flushed, TLB_GATHER_PAGES + 1, "Only the new range is flushed on finish");
+}
+
+static void
+large_range_flushed_wholesale_test (void) {
+  tlb_gather_t tlb;
+  tlb_gather_init(&tlb);
+
+  tlb_gather_page(&tlb, USER_ADDR, NULL);
+  tlb_gather_page(&tlb, USER_ADDR + ((TLB_FLUSH_MAX_PAGES + 1) << PAGE_SHIFT), NULL);
+  tlb_gather_finish(&tlb);
+
+  eq_num(full_flushes, 1, "A large user range flushes the whole TLB");
+  eq_num(pages_flushed, 0, "No page is flushed on its own");
+
+  tlb_gather_page(&tlb, KERNEL_PAGE_OFFSET, NULL);
+  tlb_gather_page(&tlb, KERNEL_PAGE_OFFSET + ((TLB_FLUSH_MAX_PAGES + 1) << PAGE_SHIFT), NULL);
+  tlb_gather_finish(&tlb);
+
+  eq_num(global_flushes, 1, "A large kernel range flushes global entries too");
+}
+
+static void
+empty_gather_flushes_nothing_test (void) {
+  tlb_gather_t tlb;
+  tlb_gather_init(&tlb);
+  tlb_gather_finish(&tlb);
+
+  ok(!pages_flushed && !full_flushes && !global_flushes, "An empty gather flushes nothing");
+}
+
+int
+main (void) {
+  plan(16);
+
+  reset_mocks();
+  finish_flushes_then_releases_test();
+
+  reset_mocks();
+  full_gather_flushes_and_releases_test();
+
+  reset_mocks();
+  large_range_flushed_wholesale_test();
+
+  reset_mocks();
+  empty_gather_flushes_nothing_test();
+
+  done_testing();
+}
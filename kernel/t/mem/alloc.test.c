@@ -18,11 +18,12 @@ unsigned int fake_addr                = 0xDEADBEEF;
 unsigned int buddy_malloc_called_with = 0;
 unsigned int buddy_malloc_return_val  = 0;
 unsigned int page_release_called      = 0;
+unsigned int alloc_pages_called_with  = 0;
 unsigned int buddy_free_called        = 0;
 page_t*      buddy_free_page          = NULL;
 
 unsigned int
-buddy_malloc (size_t size) {
+buddy_malloc (size_t size, gfp_t gfp) {
   buddy_malloc_called_with = size;
   return buddy_malloc_return_val;
 }
@@ -34,7 +35,7 @@ buddy_free (page_t* page) {
 }
 
 page_t*
-page_get_free (void) {
+page_get_free (gfp_t gfp) {
   for (int i = 0; i < PAGE_POOL_SIZE; ++i) {
     if (!(fake_page_pool[i].flags & 0x1)) {
       fake_page_pool[i].page_num = i + 1;
@@ -44,6 +45,12 @@ page_get_free (void) {
   return NULL;
 }
 
+page_t*
+alloc_pages (unsigned int order, gfp_t gfp) {
+  alloc_pages_called_with = order;
+  return order ? &fake_page_pool[0] : page_get_free(gfp);
+}
+
 void
 page_release (page_t* page) {
   page_release_called++;
@@ -56,6 +63,7 @@ page_release (page_t* page) {
   buddy_malloc_called_with = 0;                      \
   buddy_malloc_return_val  = 0;                      \
   page_release_called      = 0;                      \
+  alloc_pages_called_with  = 0;                      \
   buddy_free_called        = 0;                      \
   buddy_free_page          = NULL;
 
@@ -64,7 +72,7 @@ kmalloc_uses_buddy_if_small_enough_test (void) {
   size_t requested        = 64;
   buddy_malloc_return_val = 0xCAFEBABE;
 
-  unsigned int result     = kmalloc(requested);
+  unsigned int result     = kmalloc(requested, GFP_KERNEL);
 
   eq_num(result, 0xCAFEBABE, "kmalloc should delegate to buddy_malloc and return its value");
   ok(
@@ -75,18 +83,32 @@ kmalloc_uses_buddy_if_small_enough_test (void) {
 
 static void
 kmalloc_returns_0_if_too_large_test (void) {
-  size_t too_large    = PAGE_SIZE + 1;
+  size_t too_large    = (PAGE_SIZE << PAGE_MAX_ORDER) + 1;
 
-  unsigned int result = kmalloc(too_large);
+  unsigned int result = kmalloc(too_large, GFP_KERNEL);
 
-  eq_num(result, 0, "kmalloc should return 0 if size > PAGE_SIZE");
+  eq_num(result, 0, "kmalloc should return 0 if size exceeds the largest page block");
+}
+
+static void
+kmalloc_uses_page_blocks_for_multi_page_allocations_test (void) {
+  fake_page_pool[0].page_num = 4;
+
+  unsigned int result        = kmalloc((PAGE_SIZE * 3) + 1, GFP_KERNEL);
+
+  eq_num(alloc_pages_called_with, 2, "kmalloc should round up to the next page order");
+  eq_num(
+    result,
+    KERNEL_PAGE_OFFSET + (4 << PAGE_SHIFT),
+    "kmalloc should return the address of the first page in the block"
+  );
 }
 
 static void
 kmalloc_falls_back_to_page_allocator_test (void) {
   size_t large_size   = PAGE_SIZE;
 
-  unsigned int result = kmalloc(large_size);
+  unsigned int result = kmalloc(large_size, GFP_KERNEL);
 
   eq_num(
     result,
@@ -105,16 +127,16 @@ kmalloc_returns_0_if_no_pages_available_test (void) {
     fake_page_pool[i].flags = 0x1;
   }
 
-  unsigned int result = kmalloc(large_size);
+  unsigned int result = kmalloc(large_size, GFP_KERNEL);
   eq_num(result, 0, "kmalloc should return 0 if no pages are available");
 }
 
 static void
 kfree_calls_buddy_free_for_buddy_page_test (void) {
-  page_t* page       = &fake_page_pool[0];
-  page->flags       |= PAGE_BUDDY;
-  page->file_offset  = 99;
-  free_page_list     = fake_page_pool;
+  page_t* page        = &fake_page_pool[0];
+  page->flags        |= PAGE_BUDDY;
+  memmap_sections[0]  = fake_page_pool;
+  memmap_num_pages    = PAGE_POOL_SIZE;
 
   kfree(0xC0000001);
 
@@ -123,10 +145,10 @@ kfree_calls_buddy_free_for_buddy_page_test (void) {
 
 static void
 kfree_calls_page_release_for_regular_page_test (void) {
-  page_t* page       = &fake_page_pool[0];
-  page->flags       |= PAGE_RESERVED;
-  page->file_offset  = 99;
-  free_page_list     = fake_page_pool;
+  page_t* page        = &fake_page_pool[0];
+  page->flags        |= PAGE_RESERVED;
+  memmap_sections[0]  = fake_page_pool;
+  memmap_num_pages    = PAGE_POOL_SIZE;
 
   kfree(0xC0000001);
 
@@ -135,7 +157,7 @@ kfree_calls_page_release_for_regular_page_test (void) {
 
 int
 main (void) {
-  plan(7);
+  plan(9);
 
   reset_mocks();
   kmalloc_uses_buddy_if_small_enough_test();
@@ -143,6 +165,9 @@ main (void) {
   reset_mocks();
   kmalloc_returns_0_if_too_large_test();
 
+  reset_mocks();
+  kmalloc_uses_page_blocks_for_multi_page_allocations_test();
+
   reset_mocks();
   kmalloc_falls_back_to_page_allocator_test();
 
@@ -0,0 +1,157 @@
+#include "mem/allocprof.h"
+
+#include <stdlib.h>
+
+#include "../stubs.h"
+#include "arch/eflags.h"
+#include "kconfig.h"
+#include "libtap/libtap.h"
+#include "mem/buddy.h"
+
+#ifdef CONFIG_ALLOC_PROFILE
+
+#  define SITE_A 0xc0101000
+#  define SITE_B 0xc0102000
+
+unsigned int
+eflags_get (void) {
+  return 0;
+}
+
+void
+int_disable (void) {}
+
+void
+eflags_set (uint32_t eflags) {}
+
+static void
+page_alloc_free_test (void) {
+  page_t small = {.order = 0};
+  page_t big   = {.order = 2};
+
+  allocprof_page_alloc(&small, GFP_KERNEL, SITE_A);
+  allocprof_page_alloc(&big, GFP_KERNEL, SITE_A);
+
+  const allocprof_site_t *entry = allocprof_site(small.alloc_tag);
+
+  neq_null(entry, "The page is tagged");
+  eq_num(big.alloc_tag, small.alloc_tag, "Pages from the same site share a tag");
+  eq_num(entry->site, SITE_A, "The entry records the call site");
+  eq_num(entry->allocs, 2, "Both allocations are counted");
+  eq_num(entry->live_bytes, 5 * PAGE_SIZE, "Blocks of pages are accounted by their order");
+  eq_num(entry->peak_bytes, 5 * PAGE_SIZE, "The peak follows the live bytes up");
+
+  allocprof_page_free(&big);
+
+  eq_num(big.alloc_tag, 0, "The tag is cleared once the page is freed");
+  eq_num(entry->frees, 1, "The free is counted");
+  eq_num(entry->live_bytes, PAGE_SIZE, "The freed bytes are no longer live");
+  eq_num(entry->peak_bytes, 5 * PAGE_SIZE, "The peak is kept");
+
+  allocprof_page_free(&big);
+
+  eq_num(entry->frees, 1, "Freeing an untagged page isn't counted");
+  eq_num(entry->live_bytes, PAGE_SIZE, "Freeing an untagged page leaves the live bytes alone");
+
+  allocprof_page_free(&small);
+
+  eq_num(entry->live_bytes, 0, "Nothing is live once every page is freed");
+}
+
+static void
+page_alloc_untracked_test (void) {
+  page_t page = {.order = 0};
+
+  allocprof_page_alloc(&page, GFP_KERNEL | GFP_NOPROFILE, SITE_B);
+  eq_num(page.alloc_tag, 0, "GFP_NOPROFILE allocations aren't tagged");
+
+  allocprof_page_alloc(NULL, GFP_KERNEL, SITE_B);
+  ok(1, "Failed allocations are ignored");
+
+  eq_null(allocprof_site(0), "The untracked tag has no entry");
+  eq_null(allocprof_site(ALLOCPROF_SITES + 2), "Tags past the table have no entry");
+}
+
+static void
+buddy_alloc_free_test (void) {
+  buddy_head_t *block = calloc(1, blocksizes[2]);
+  unsigned int  addr  = (unsigned int)(block + 1);
+  block->level        = 2;
+
+  allocprof_buddy_alloc(addr, SITE_B);
+
+  const allocprof_site_t *entry = allocprof_site(block->alloc_tag);
+
+  neq_null(entry, "The block is tagged");
+  eq_num(entry->site, SITE_B, "The block is attributed to its call site");
+  eq_num(entry->live_bytes, blocksizes[2], "Blocks are accounted by their level's size");
+
+  allocprof_buddy_free(addr);
+
+  eq_num(block->alloc_tag, 0, "The tag is cleared once the block is freed");
+  eq_num(entry->live_bytes, 0, "The freed block is no longer live");
+  eq_num(entry->peak_bytes, blocksizes[2], "The peak is kept");
+
+  free(block);
+}
+
+static void
+overflow_test (void) {
+  page_t       page  = {.order = 0};
+  page_t       other = {.order = 0};
+  unsigned int site  = SITE_B;
+
+  // Fill the table with new call sites until one no longer fits
+  for (int n = 0; n <= ALLOCPROF_SITES; n++) {
+    site += 0x10;
+    allocprof_page_alloc(&page, GFP_KERNEL, site);
+    if (page.alloc_tag == ALLOCPROF_SITES + 1) {
+      break;
+    }
+    allocprof_page_free(&page);
+  }
+
+  const allocprof_site_t *entry = allocprof_site(page.alloc_tag);
+
+  eq_num(page.alloc_tag, ALLOCPROF_SITES + 1, "Sites that don't fit get the overflow tag");
+  eq_num(entry->site, 0, "The overflow entry isn't tied to a call site");
+  eq_num(entry->live_bytes, PAGE_SIZE, "The overflow entry accounts the page");
+
+  allocprof_page_alloc(&other, GFP_KERNEL, site + 0x10);
+
+  eq_num(other.alloc_tag, ALLOCPROF_SITES + 1, "Further sites share the overflow entry");
+  eq_num(entry->allocs, 2, "The overflow entry counts both allocations");
+
+  allocprof_page_free(&other);
+
+  eq_num(entry->live_bytes, PAGE_SIZE, "The overflow entry releases freed pages");
+
+  allocprof_page_alloc(&other, GFP_KERNEL, SITE_A);
+
+  eq_num(allocprof_site(other.alloc_tag)->site, SITE_A, "Known sites keep their own entry");
+}
+
+int
+main (void) {
+  plan(30);
+
+  page_alloc_free_test();
+  page_alloc_untracked_test();
+  buddy_alloc_free_test();
+  overflow_test();
+
+  done_testing();
+}
+
+#else
+
+int
+main (void) {
+  plan(1);
+
+  skip(1, "The allocation profiler is disabled");
+
+  done_testing();
+}
+
+#endif /* CONFIG_ALLOC_PROFILE */
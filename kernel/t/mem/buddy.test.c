@@ -0,0 +1,146 @@
+#include "mem/buddy.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../stubs.h"
+#include "kstat.h"
+#include "libtap/libtap.h"
+#include "mem/base.h"
+#include "mem/page.h"
+
+/**
+ * The page handed out to the allocator. Blocks are addressed through the direct map, so the page's
+ * direct-mapped address has to be backed by real memory.
+ */
+#define TEST_PAGE_NUM 1
+#define TEST_PAGE     (KERNEL_PAGE_OFFSET + (TEST_PAGE_NUM << PAGE_SHIFT))
+
+extern kstat_t kstat;
+
+static page_t mock_page_pool[TEST_PAGE_NUM + 1];
+static int    pages_allocated = 0;
+static int    pages_released  = 0;
+
+page_t *
+page_get_free (gfp_t gfp) {
+  page_t *page   = &mock_page_pool[TEST_PAGE_NUM];
+  page->page_num = TEST_PAGE_NUM;
+  pages_allocated++;
+  return page;
+}
+
+void
+page_release (page_t *page) {
+  pages_released++;
+}
+
+static void
+reset_mocks (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  memset((void *)TEST_PAGE, 0, PAGE_SIZE);
+  pages_allocated = 0;
+  pages_released  = 0;
+  buddy_init();
+}
+
+/**
+ * Retrieves the address of the block at `offset` in the test page, as handed out by `buddy_malloc`
+ */
+static unsigned int
+block_at (unsigned int offset) {
+  return TEST_PAGE + offset + sizeof(buddy_head_t);
+}
+
+static void
+malloc_splits_page_test (void) {
+  unsigned int addr = buddy_malloc(blocksizes[0], GFP_KERNEL);
+
+  eq_num(addr, block_at(0), "The block is taken from the start of a new page");
+  eq_num(pages_allocated, 1, "A single page is allocated");
+  ok(mock_page_pool[TEST_PAGE_NUM].flags & PAGE_BUDDY, "The page is marked as a buddy page");
+
+  for (int level = 0; level < BUDDY_MAX_LEVEL; level++) {
+    eq_num(kstat.buddy_free_blocks[level], 1, "One upper half is left free at level %d", level);
+  }
+
+  eq_num(
+    buddy_malloc(blocksizes[0], GFP_KERNEL),
+    block_at(blocksizes[0]),
+    "The next block is the buddy left free by the split"
+  );
+  eq_num(kstat.buddy_free_blocks[0], 0, "No free blocks are left at the smallest level");
+  eq_num(pages_allocated, 1, "No other page is allocated");
+}
+
+static void
+free_coalesces_with_buddy_test (void) {
+  unsigned int a = buddy_malloc(blocksizes[0], GFP_KERNEL);
+  unsigned int b = buddy_malloc(blocksizes[0], GFP_KERNEL);
+
+  buddy_free(b);
+
+  eq_num(kstat.buddy_free_blocks[0], 1, "The block is not merged while its buddy is in use");
+  eq_num(pages_released, 0, "The page is kept while a block is in use");
+
+  buddy_free(a);
+
+  for (int level = 0; level < BUDDY_MAX_LEVEL; level++) {
+    eq_num(kstat.buddy_free_blocks[level], 0, "No free blocks are left at level %d", level);
+  }
+  eq_num(pages_released, 1, "Blocks coalesce back into a whole page, which is released");
+}
+
+static void
+free_skips_split_buddy_test (void) {
+  // The 64-byte block's buddy is split further to serve the 32-byte one, so its header carries a
+  // lower level and the two must not be merged
+  unsigned int big   = buddy_malloc(blocksizes[1], GFP_KERNEL);
+  unsigned int small = buddy_malloc(blocksizes[0], GFP_KERNEL);
+
+  eq_num(big, block_at(0), "The larger block is at the start of the page");
+  eq_num(small, block_at(blocksizes[1]), "The smaller block is carved from its buddy");
+
+  buddy_free(big);
+
+  eq_num(kstat.buddy_free_blocks[1], 1, "The larger block is not merged with its split buddy");
+  eq_num(kstat.buddy_free_blocks[0], 1, "The smaller block's own buddy is still free");
+  eq_num(pages_released, 0, "The page is kept while a block is in use");
+
+  buddy_free(small);
+
+  eq_num(kstat.buddy_free_blocks[0], 0, "The smaller block merges with its buddy");
+  eq_num(kstat.buddy_free_blocks[1], 0, "The merged block merges with the larger one");
+  eq_num(pages_released, 1, "The whole page is released");
+}
+
+int
+main (void) {
+  memmap_sections[0] = mock_page_pool;
+  memmap_num_pages   = TEST_PAGE_NUM + 1;
+
+  if (mmap(
+        (void *)TEST_PAGE,
+        PAGE_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+        -1,
+        0
+      )
+      == MAP_FAILED) {
+    bail_out("unable to map the test page");
+  }
+
+  plan(31);
+
+  reset_mocks();
+  malloc_splits_page_test();
+
+  reset_mocks();
+  free_coalesces_with_buddy_test();
+
+  reset_mocks();
+  free_skips_split_buddy_test();
+
+  done_testing();
+}
@@ -0,0 +1,223 @@
+#include "mem/ksm.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../stubs.h"
+#include "kstat.h"
+#include "libtap/libtap.h"
+#include "mem/base.h"
+#include "mem/page.h"
+#include "mem/paging.h"
+#include "mem/slab.h"
+#include "proc/proc.h"
+#include "proc/sleep.h"
+
+/**
+ * Frames handed out as the page directory and page tables, which are reached through the direct map,
+ * so their direct-mapped addresses have to be backed by real memory. The directory spans four pages
+ * with PAE.
+ */
+#define PGDIR_PAGE     1
+#define NUM_TEST_PAGES 16
+#define FRAME_ADDR(n)  (KERNEL_PAGE_OFFSET + ((n) << PAGE_SHIFT))
+
+#define ADDR_A         0x08048000
+#define ADDR_B         0x08049000
+
+extern kstat_t kstat;
+
+static page_t  mock_page_pool[NUM_TEST_PAGES];
+static char    page_data[NUM_TEST_PAGES][PAGE_SIZE];
+static int     next_page;
+static int     pages_released;
+static proc_t  fake_ksmd;
+static void (*ksmd_fn)(void);
+static jmp_buf ksmd_asleep;
+
+unsigned int
+eflags_get (void) {
+  return 0;
+}
+
+void
+int_disable (void) {}
+
+void
+eflags_set (uint32_t eflags) {}
+
+void
+tlb_flush_page (unsigned int addr) {}
+
+void
+tlb_flush_all (void) {}
+
+void
+tlb_flush_global (void) {}
+
+pte_t *
+paging_pgdir_current (void) {
+  return kpage_dir;
+}
+
+proc_t *
+kproc_create (const char *name, void (*fn)(void)) {
+  ksmd_fn = fn;
+  return &fake_ksmd;
+}
+
+int
+sleep_on_timeout (wait_queue_head_t *wq, proc_inttype state, unsigned int ticks) {
+  // Stop ksmd once it's done with a pass
+  longjmp(ksmd_asleep, 1);
+}
+
+void *
+kmem_cache_alloc (kmem_cache_t *cache, gfp_t gfp) {
+  return calloc(1, sizeof(kmem_cache_t));
+}
+
+void
+kmem_cache_free (kmem_cache_t *cache, void *obj) {
+  free(obj);
+}
+
+page_t *
+page_get_free (gfp_t gfp) {
+  if (next_page >= NUM_TEST_PAGES) {
+    return NULL;
+  }
+
+  page_t *page      = &mock_page_pool[next_page++];
+  page->usage_count = 1;
+  return page;
+}
+
+page_t *
+page_get_zeroed (gfp_t gfp) {
+  page_t *page;
+  if ((page = page_get_free(gfp))) {
+    memset((void *)FRAME_ADDR(page->page_num), 0, PAGE_SIZE);
+  }
+  return page;
+}
+
+void
+page_release (page_t *page) {
+  page->usage_count--;
+  pages_released++;
+}
+
+/**
+ * Maps a fresh frame at `addr`, filled with `contents` throughout
+ */
+static page_t *
+map_page (unsigned int addr, char contents) {
+  page_t *page = page_get_free(GFP_HIGHUSER);
+  memset(page->data, contents, PAGE_SIZE);
+
+  *paging_get_pte(kpage_dir, addr, true) = page_to_phys(page) | PAGE_PRESENT | PAGE_RW | PAGE_USER;
+
+  return page;
+}
+
+/**
+ * Runs ksmd for a full sweep of the page table the test pages live in
+ */
+static void
+run_sweep (void) {
+  if (!setjmp(ksmd_asleep)) {
+    ksmd_fn();
+  }
+}
+
+static void
+merge_then_unshare_test (void) {
+  page_t *a     = map_page(ADDR_A, 'k');
+  page_t *b     = map_page(ADDR_B, 'k');
+  pte_t  *pte_a = paging_get_pte(kpage_dir, ADDR_A, false);
+  pte_t  *pte_b = paging_get_pte(kpage_dir, ADDR_B, false);
+
+  run_sweep();
+
+  ok(PTE_PAGE(*pte_a) == a && PTE_PAGE(*pte_b) == a, "Identical pages share a frame");
+  ok(!(*pte_a & PAGE_RW) && !(*pte_b & PAGE_RW), "The shared frame is write-protected");
+  ok(a->flags & PAGE_COW, "The shared frame is copy-on-write");
+  eq_num(a->usage_count, 3, "Both mappings and the stable tree hold a reference");
+  eq_num(b->usage_count, 0, "The duplicate frame is released");
+  eq_num(kstat.ksm_pages_shared, 1, "One frame is shared");
+  eq_num(kstat.ksm_pages_saved, 1, "One frame is saved");
+
+  eq_num(
+    paging_handle_fault(ADDR_B, PAGE_FAULT_PROTVIOL | PAGE_FAULT_WRIT | PAGE_FAULT_USRMOD),
+    RET_OK,
+    "A write to a shared page is resolved"
+  );
+
+  page_t *copy = PTE_PAGE(*pte_b);
+  ok(copy != a && (*pte_b & PAGE_RW), "The writer gets a writable copy");
+  ok(!memcmp(copy->data, a->data, PAGE_SIZE), "The copy holds the shared contents");
+  eq_num(a->usage_count, 2, "The writer's reference to the shared frame is dropped");
+
+  // The other mapping goes away too
+  *pte_a = 0;
+  page_release(a);
+
+  run_sweep();
+
+  eq_num(a->usage_count, 0, "The stable tree lets go of frames nobody maps anymore");
+  eq_num(kstat.ksm_pages_shared, 0, "No frame is shared anymore");
+}
+
+static void
+different_pages_not_merged_test (void) {
+  page_t *a = map_page(ADDR_A, 'x');
+  page_t *b = map_page(ADDR_B, 'y');
+
+  run_sweep();
+
+  ok(PTE_PAGE(*paging_get_pte(kpage_dir, ADDR_B, false)) == b, "Different pages aren't merged");
+  ok(a->usage_count == 1 && b->usage_count == 1, "No references are taken");
+}
+
+int
+main (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  for (int i = 0; i < NUM_TEST_PAGES; i++) {
+    mock_page_pool[i].page_num = i;
+    mock_page_pool[i].data     = page_data[i];
+  }
+  memmap_sections[0] = mock_page_pool;
+  memmap_num_pages   = NUM_TEST_PAGES;
+  kpage_dir          = (pte_t *)FRAME_ADDR(PGDIR_PAGE);
+  next_page          = PGDIR_PAGE + 4;
+
+  if (mmap(
+        (void *)FRAME_ADDR(0),
+        NUM_TEST_PAGES * PAGE_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+        -1,
+        0
+      )
+      == MAP_FAILED) {
+    bail_out("unable to map the test frames");
+  }
+  memset((void *)FRAME_ADDR(PGDIR_PAGE), 0, 4 * PAGE_SIZE);
+
+  ksm_init();
+  if (!ksmd_fn) {
+    bail_out("ksmd was not started");
+  }
+  // The test pages share a single page table
+  kstat.param.ksm_pages_to_scan = PAGE_SIZE / sizeof(pte_t);
+
+  plan(15);
+
+  merge_then_unshare_test();
+  different_pages_not_merged_test();
+
+  done_testing();
+}
@@ -0,0 +1,156 @@
+#include "mem/kswapd.h"
+
+#include "../stubs.h"
+#include "arch/eflags.h"
+#include "kstat.h"
+#include "libtap/libtap.h"
+#include "proc/proc.h"
+#include "proc/sleep.h"
+
+#include <setjmp.h>
+
+extern kstat_t kstat;
+
+static proc_t  fake_kswapd;
+static void (*kswapd_fn)(void);
+static jmp_buf kswapd_asleep;
+
+static int gain_per_call;
+static int shrink_calls;
+
+static bool irqs_off;
+static bool woke_irqs_off;
+static bool slept_irqs_off;
+
+unsigned int
+eflags_get (void) {
+  return irqs_off ? 0 : EFLAGS_INT_ENABLED;
+}
+
+void
+int_disable (void) {
+  irqs_off = true;
+}
+
+void
+eflags_set (uint32_t eflags) {
+  irqs_off = !(eflags & EFLAGS_INT_ENABLED);
+}
+
+proc_t *
+kproc_create (const char *name, void (*fn)(void)) {
+  kswapd_fn = fn;
+  return &fake_kswapd;
+}
+
+void
+wakeup_all (wait_queue_head_t *wq) {
+  woke_irqs_off = irqs_off;
+}
+
+int
+sleep_on (wait_queue_head_t *wq, proc_inttype state) {
+  slept_irqs_off = irqs_off;
+  // Stop kswapd once it's done with a round of reclaim
+  longjmp(kswapd_asleep, 1);
+}
+
+/**
+ * Reports releasing every page asked for, but only `gain_per_call` of them reach the free lists
+ */
+static int
+test_shrink (int nr_pages) {
+  shrink_calls++;
+  kstat.num_free_pages += gain_per_call;
+  return nr_pages;
+}
+
+static shrinker_t test_shrinker = {.shrink = test_shrink};
+
+static void
+reset_mocks (void) {
+  kstat                 = (kstat_t){0};
+  kstat.low_free_pages  = 4;
+  kstat.high_free_pages = 8;
+  gain_per_call         = 0;
+  shrink_calls          = 0;
+  irqs_off              = false;
+  woke_irqs_off         = false;
+  slept_irqs_off        = false;
+}
+
+static void
+run_kswapd (void) {
+  if (!setjmp(kswapd_asleep)) {
+    kswapd_fn();
+  }
+}
+
+static void
+reclaims_up_to_high_watermark_test (void) {
+  gain_per_call = 3;
+
+  run_kswapd();
+
+  eq_num(kstat.num_free_pages, 9, "Reclaim stops once the high watermark is reached");
+  eq_num(kstat.pages_reclaimed, 9, "Pages reclaimed is what the free lists gained");
+  eq_num(shrink_calls, 3, "Shrinkers are called until the watermark is reached");
+}
+
+static void
+reports_no_reclaim_without_gain_test (void) {
+  kstat.num_free_pages = 2;
+  gain_per_call        = 0;
+
+  run_kswapd();
+
+  eq_num(kstat.pages_reclaimed, 0, "Pages released elsewhere do not count as reclaimed");
+  eq_num(shrink_calls, 1, "Reclaim stops as soon as nothing is gained");
+  eq_num(kstat.num_free_pages, 2, "Free pages are unchanged");
+}
+
+static void
+reclaims_nothing_without_shrinkers_test (void) {
+  shrinker_unregister(&test_shrinker);
+
+  run_kswapd();
+
+  eq_num(kstat.pages_reclaimed, 0, "Nothing is reclaimed without shrinkers");
+  eq_num(shrink_calls, 0, "Unregistered shrinkers are not called");
+
+  shrinker_register(&test_shrinker);
+}
+
+static void
+sleeps_without_missing_wakeups_test (void) {
+  run_kswapd();
+
+  ok(woke_irqs_off, "Waiters are woken up with interrupts disabled");
+  ok(slept_irqs_off, "kswapd goes to sleep before anything else can run");
+}
+
+int
+main (void) {
+  plan(10);
+
+  kswapd_init();
+  if (!kswapd_fn) {
+    bail_out("kswapd was not started");
+  }
+
+  shrinker_register(&test_shrinker);
+
+  reset_mocks();
+  reclaims_up_to_high_watermark_test();
+
+  reset_mocks();
+  reports_no_reclaim_without_gain_test();
+
+  reset_mocks();
+  reclaims_nothing_without_shrinkers_test();
+
+  reset_mocks();
+  sleeps_without_missing_wakeups_test();
+
+  done_testing();
+}
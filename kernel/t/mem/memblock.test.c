@@ -0,0 +1,111 @@
+#include "mem/memblock.h"
+
+#include <string.h>
+
+#include "../stubs.h"
+#include "libtap/libtap.h"
+#include "mem/page.h"
+
+#define MAX_RANGES 8
+
+static memblock_region_t ranges[MAX_RANGES];
+static unsigned int      num_ranges;
+
+static void
+collect_range (unsigned int base, unsigned int end, void *ctx) {
+  ranges[num_ranges].base = base;
+  ranges[num_ranges].end  = end;
+  num_ranges++;
+}
+
+#define reset_memblock()                                  \
+  memset(&memblock_memory, 0, sizeof(memblock_memory));     \
+  memset(&memblock_reserved, 0, sizeof(memblock_reserved)); \
+  num_ranges = 0;
+
+static void
+add_merges_adjacent_and_overlapping_regions_test (void) {
+  memblock_add(0x1000, 0x1000);
+  memblock_add(0x4000, 0x1000);
+  memblock_add(0x2000, 0x1000);
+
+  eq_num(memblock_memory.count, 2, "adjacent regions are merged");
+  eq_num(memblock_memory.regions[0].end, 0x3000, "merged region spans both regions");
+
+  memblock_add(0x2800, 0x2000);
+  eq_num(memblock_memory.count, 1, "a region bridging two others merges all three");
+  eq_num(memblock_memory.regions[0].base, 0x1000, "merged region starts at the lowest base");
+  eq_num(memblock_memory.regions[0].end, 0x5000, "merged region ends at the highest end");
+}
+
+static void
+free_splits_reserved_regions_test (void) {
+  memblock_reserve(0x1000, 0x4000);
+  memblock_free(0x2000, 0x1000);
+
+  eq_num(memblock_reserved.count, 2, "freeing the middle of a region splits it");
+  eq_num(memblock_reserved.regions[0].end, 0x2000, "lower half ends at the freed range");
+  eq_num(memblock_reserved.regions[1].base, 0x3000, "upper half starts after the freed range");
+
+  memblock_free(0x0000, 0x3000);
+  eq_num(memblock_reserved.count, 1, "freeing a whole region removes it");
+}
+
+static void
+foreach_free_skips_reservations_test (void) {
+  memblock_add(0x0000, 0x10000);
+  memblock_add(0x20000, 0x10000);
+  memblock_reserve(0x0000, 0x1000);
+  memblock_reserve(0x8000, 0x1000);
+  memblock_reserve(0x1F000, 0x2000);
+
+  memblock_foreach_free(&collect_range, NULL);
+
+  eq_num(num_ranges, 3, "free ranges are the gaps between reservations");
+  ok(ranges[0].base == 0x1000 && ranges[0].end == 0x8000, "first free range precedes a reservation");
+  ok(ranges[1].base == 0x9000 && ranges[1].end == 0x10000, "second free range ends with memory");
+  ok(
+    ranges[2].base == 0x21000 && ranges[2].end == 0x30000,
+    "reservations straddling a region boundary are honoured"
+  );
+}
+
+static void
+alloc_is_top_down_and_aligned_test (void) {
+  memblock_add(0x1000, 0x20000);
+  memblock_reserve(0x1F000, 0x1000);
+
+  unsigned int a = memblock_alloc(0x1000, PAGE_SIZE);
+  eq_num(a, 0x20000, "allocations are placed at the top of memory");
+
+  unsigned int b = memblock_alloc(0x100, 0x4000);
+  eq_num(b, 0x1C000, "allocations honour the requested alignment");
+  eq_num(b % 0x4000, 0, "allocation is aligned");
+
+  eq_num(memblock_alloc(0x20000, PAGE_SIZE), 0, "oversized allocations fail");
+
+  memblock_foreach_free(&collect_range, NULL);
+  ok(
+    num_ranges == 2 && ranges[0].end == 0x1C000 && ranges[1].base == 0x1C100,
+    "allocated memory is no longer reported as free"
+  );
+}
+
+int
+main (void) {
+  plan(18);
+
+  reset_memblock();
+  add_merges_adjacent_and_overlapping_regions_test();
+
+  reset_memblock();
+  free_splits_reserved_regions_test();
+
+  reset_memblock();
+  foreach_free_skips_reservations_test();
+
+  reset_memblock();
+  alloc_is_top_down_and_aligned_test();
+
+  done_testing();
+}
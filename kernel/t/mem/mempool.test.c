@@ -0,0 +1,201 @@
+#include "mem/mempool.h"
+
+#include <stdlib.h>
+
+#include "../stubs.h"
+#include "arch/eflags.h"
+#include "libtap/libtap.h"
+#include "mem/alloc.h"
+#include "proc/sleep.h"
+
+#define MIN_NR     2
+#define NUM_OBJECT 8
+
+static mempool_t    pool;
+static kmem_cache_t test_cache;
+static int          objects[NUM_OBJECT];
+static int          next_object;
+static int          objects_freed;
+
+/**
+ * Whether the cache can hand out objects
+ */
+static bool cache_full;
+
+static bool irqs_off;
+static bool slept_irqs_off;
+static int  sleeps;
+static int  wakeups;
+
+/**
+ * Run once from within `sleep_on_exclusive`, as if another process ran while we slept
+ */
+static void (*while_asleep)(void);
+
+unsigned int
+eflags_get (void) {
+  return irqs_off ? 0 : EFLAGS_INT_ENABLED;
+}
+
+void
+int_disable (void) {
+  irqs_off = true;
+}
+
+void
+eflags_set (uint32_t eflags) {
+  irqs_off = !(eflags & EFLAGS_INT_ENABLED);
+}
+
+unsigned int
+kmalloc (size_t size, gfp_t gfp) {
+  return (unsigned int)malloc(size);
+}
+
+void
+kfree (unsigned int addr) {
+  free((void *)addr);
+}
+
+void *
+kmem_cache_alloc (kmem_cache_t *cache, gfp_t gfp) {
+  if (cache_full || next_object >= NUM_OBJECT) {
+    return NULL;
+  }
+  return &objects[next_object++];
+}
+
+void
+kmem_cache_free (kmem_cache_t *cache, void *obj) {
+  objects_freed++;
+}
+
+int
+sleep_on_exclusive (wait_queue_head_t *wq, proc_inttype state) {
+  slept_irqs_off = irqs_off;
+  sleeps++;
+
+  if (while_asleep) {
+    void (*fn)(void) = while_asleep;
+    while_asleep     = NULL;
+    fn();
+  }
+  return 0;
+}
+
+void
+wakeup (wait_queue_head_t *wq) {
+  wakeups++;
+}
+
+static void
+reset_mocks (void) {
+  next_object    = 0;
+  objects_freed  = 0;
+  cache_full     = false;
+  irqs_off       = false;
+  slept_irqs_off = false;
+  sleeps         = 0;
+  wakeups        = 0;
+  while_asleep   = NULL;
+
+  mempool_init(&pool, MIN_NR, &test_cache);
+}
+
+static void
+init_fills_reserve_test (void) {
+  eq_num(pool.curr_nr, MIN_NR, "The reserve is filled up front");
+  eq_num(next_object, MIN_NR, "The reserve comes from the cache");
+}
+
+static void
+alloc_prefers_cache_test (void) {
+  void *obj = mempool_alloc(&pool, GFP_KERNEL);
+
+  ok(obj == &objects[MIN_NR], "Objects come from the cache while it can grow");
+  eq_num(pool.curr_nr, MIN_NR, "The reserve is left alone");
+}
+
+static void
+alloc_exhausts_reserve_test (void) {
+  cache_full = true;
+
+  void *a    = mempool_alloc(&pool, GFP_NOWAIT);
+  void *b    = mempool_alloc(&pool, GFP_NOWAIT);
+
+  ok(a == &objects[1] && b == &objects[0], "The reserve is used once the cache is out");
+  eq_num(pool.curr_nr, 0, "The reserve is empty");
+
+  eq_null(mempool_alloc(&pool, GFP_NOWAIT), "Non-blocking allocations fail once it's empty");
+  eq_num(sleeps, 0, "Non-blocking allocations never sleep");
+}
+
+static void
+free_refills_reserve_test (void) {
+  cache_full = true;
+
+  void *a    = mempool_alloc(&pool, GFP_NOWAIT);
+  void *b    = mempool_alloc(&pool, GFP_NOWAIT);
+
+  mempool_free(&pool, a);
+
+  eq_num(pool.curr_nr, 1, "Freed objects refill the reserve");
+  eq_num(objects_freed, 0, "The object isn't returned to the cache");
+  eq_num(wakeups, 1, "A waiter is woken up");
+
+  mempool_free(&pool, b);
+  mempool_free(&pool, &objects[MIN_NR]);
+
+  eq_num(pool.curr_nr, MIN_NR, "The reserve is refilled up to its minimum");
+  eq_num(objects_freed, 1, "Objects go back to the cache once the reserve is full");
+}
+
+static void *in_flight;
+
+static void
+free_in_flight (void) {
+  mempool_free(&pool, in_flight);
+}
+
+static void
+alloc_waits_for_free_test (void) {
+  cache_full = true;
+
+  mempool_alloc(&pool, GFP_NOWAIT);
+  in_flight    = mempool_alloc(&pool, GFP_NOWAIT);
+  while_asleep = free_in_flight;
+
+  void *obj    = mempool_alloc(&pool, GFP_KERNEL);
+
+  eq_num(sleeps, 1, "Blocking allocations sleep once the reserve is empty");
+  ok(slept_irqs_off, "Interrupts are off until we're queued, so the wakeup can't be lost");
+  ok(obj == in_flight, "The object freed while asleep is handed out");
+  ok(!irqs_off, "Interrupts are restored");
+}
+
+int
+main (void) {
+  plan(17);
+
+  reset_mocks();
+  init_fills_reserve_test();
+  mempool_exit(&pool);
+
+  reset_mocks();
+  alloc_prefers_cache_test();
+  mempool_exit(&pool);
+
+  reset_mocks();
+  alloc_exhausts_reserve_test();
+  mempool_exit(&pool);
+
+  reset_mocks();
+  free_refills_reserve_test();
+  mempool_exit(&pool);
+
+  reset_mocks();
+  alloc_waits_for_free_test();
+  mempool_exit(&pool);
+
+  done_testing();
+}
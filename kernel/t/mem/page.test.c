@@ -1,32 +1,32 @@
 #include "mem/page.h"
 
+#include <sys/mman.h>
+
 #include "../stubs.h"
 #include "kstat.h"
 #include "libtap/libtap.h"
+#include "mem/base.h"
+#include "mem/memblock.h"
+#include "mem/slab.h"
 
 #define NUM_TEST_PAGES 32
 
-static page_t  mock_page_pool[NUM_TEST_PAGES];
-static page_t *mock_cache[NUM_TEST_PAGES];
-extern kstat_t kstat;
-extern page_t *free_page_list_head;
-static void   *real_last_addr;
-
-bool
-bios_mmap_has_addr (unsigned int addr) {
-  // Simulate only a few addresses being valid
-  return (addr < 0x100000 || addr >= 0x200000);
-}
+static page_t              mock_page_pool[NUM_TEST_PAGES];
+static page_cache_entry_t *mock_cache[NUM_TEST_PAGES];
+extern kstat_t             kstat;
+extern page_t             *free_page_lists[];
 
 #define P2V (p) p + 0xC0000000
 
 #define V2P (v) v - 0xC0000000
 
 void
-wakeup (void *chan) {}
+wakeup (wait_queue_head_t *wq) {}
 
-void
-sleep (void *chan, int flags) {}
+int
+sleep_on_exclusive (wait_queue_head_t *wq, int state) {
+  return 0;
+}
 
 #define INTERRUPTS_OFF() \
   {}
@@ -50,14 +50,33 @@ int_disable (void) {}
 void
 eflags_set (uint32_t eflags) {}
 
+void *
+kmem_cache_alloc (kmem_cache_t *cache, gfp_t gfp) {
+  return calloc(1, sizeof(kmem_cache_t) + sizeof(page_cache_entry_t));
+}
+
+void
+kmem_cache_free (kmem_cache_t *cache, void *obj) {
+  free(obj);
+}
+
+// Page 0 is missing from the memory map and the boot stack page is reserved
+static void
+seed_memblock (void) {
+  memset(&memblock_memory, 0, sizeof(memblock_memory));
+  memset(&memblock_reserved, 0, sizeof(memblock_reserved));
+
+  memblock_add(PAGE_SIZE, (NUM_TEST_PAGES - 1) * PAGE_SIZE);
+  memblock_reserve(0x0000F000, PAGE_SIZE);
+}
+
 static void
 page_init_reserves_and_initializes_free_list_test (void) {
   memset(mock_page_pool, 0, sizeof(mock_page_pool));
   memset(mock_cache, 0, sizeof(mock_cache));
-  real_last_addr = (void *)0x200000;
+  seed_memblock();
 
   kstat          = (kstat_t){0};
-  free_page_list = mock_page_pool;
   page_init(NUM_TEST_PAGES);
 
   unsigned int free_pages = 0, reserved_pages = 0;
@@ -71,16 +90,25 @@ page_init_reserves_and_initializes_free_list_test (void) {
 
   ok(free_pages > 0, "Some pages were inserted into the free list");
   ok(reserved_pages > 0, "Some pages were reserved");
+  eq_num(mock_page_pool[0].flags, PAGE_RESERVED, "Pages missing from the memory map are reserved");
+  eq_num(mock_page_pool[15].flags, PAGE_RESERVED, "Boot allocator reservations are reserved");
+  eq_num(kstat.kernel_reserved, 1, "Boot allocator reservations are accounted to the kernel");
 
   eq_num(kstat.total_mem_pages, kstat.num_free_pages, "Total pages match free pages");
+  eq_num(kstat.page_init_pending, 0, "Small machines are initialized in full up front");
+  ok(!page_init_deferred(), "There's nothing left to initialize in the background");
 
   ok(kstat.min_free_pages > 0, "Minimum free pages is computed");
+  ok(
+    kstat.min_free_pages < kstat.low_free_pages && kstat.low_free_pages < kstat.high_free_pages,
+    "Reclaim watermarks are ordered min < low < high"
+  );
 }
 
 static void
 page_get_free_returns_page_test (void) {
   memset(mock_page_pool, 0, sizeof(mock_page_pool));
-  free_page_list_head = &mock_page_pool[0];
+  free_page_lists[0] = &mock_page_pool[0];
   for (int i = 0; i < 3; i++) {
     mock_page_pool[i].next_free = &mock_page_pool[(i + 1) % 3];
     mock_page_pool[i].prev_free = &mock_page_pool[(i + 2) % 3];
@@ -88,12 +116,31 @@ page_get_free_returns_page_test (void) {
 
   kstat        = (kstat_t){.num_free_pages = 3, .min_free_pages = 0};
 
-  page_t *page = page_get_free();
+  page_t *page = page_get_free(GFP_KERNEL);
   ok(page != NULL, "Got a page");
   eq_num(kstat.num_free_pages, 2, "Free pages decremented");
   eq_num(page->usage_count, 1, "Usage count set to 1");
 }
 
+static void
+page_get_free_dips_into_reserve_only_for_atomic_test (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  free_page_lists[0] = &mock_page_pool[0];
+  for (int i = 0; i < 3; i++) {
+    mock_page_pool[i].next_free = &mock_page_pool[(i + 1) % 3];
+    mock_page_pool[i].prev_free = &mock_page_pool[(i + 2) % 3];
+  }
+
+  kstat = (kstat_t){.num_free_pages = 3, .min_free_pages = 3};
+
+  eq_null(page_get_free(GFP_NOWAIT), "Non-blocking allocations fail at the min watermark");
+  eq_num(kstat.num_free_pages, 3, "The reserve is left untouched");
+
+  page_t *page = page_get_free(GFP_ATOMIC);
+  ok(page != NULL, "Atomic allocations are served from the reserve");
+  eq_num(kstat.num_free_pages, 2, "Free pages decremented");
+}
+
 static void
 page_release_returns_page_to_free_list_test (void) {
   memset(mock_page_pool, 0, sizeof(mock_page_pool));
@@ -108,7 +155,7 @@ page_release_returns_page_to_free_list_test (void) {
 
   eq_num(pg->usage_count, 0, "Usage count is 0 after release");
   eq_num(kstat.num_free_pages, 1, "Page is returned to free list");
-  eq_num(free_page_list_head, pg, "Page is at head of free list");
+  eq_num(free_page_lists[0], pg, "Page is at head of free list");
 }
 
 static void
@@ -128,24 +175,268 @@ page_get_free_returns_null_if_empty_test (void) {
   kstat.pages_reclaimed = 0;
   kstat.min_free_pages  = 1;
 
-  page_t *pg            = page_get_free();
+  page_t *pg            = page_get_free(GFP_KERNEL);
   eq_null(pg, "No page available, returns NULL");
 }
 
+static void
+alloc_pages_returns_contiguous_blocks_test (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  memset(mock_cache, 0, sizeof(mock_cache));
+  seed_memblock();
+
+  kstat          = (kstat_t){0};
+  page_init(NUM_TEST_PAGES);
+
+  int     num_free = kstat.num_free_pages;
+  page_t *pg       = alloc_pages(2, GFP_KERNEL);
+
+  ok(pg != NULL, "Got a block of pages");
+  eq_num(pg->page_num % 4, 0, "Block is aligned to its size");
+  eq_num(kstat.num_free_pages, num_free - 4, "Free pages decremented by the block size");
+
+  free_pages(pg, 2);
+  eq_num(kstat.num_free_pages, num_free, "Block is returned to the free lists");
+
+  // Pages 16 through 31 are all free, so they should have coalesced into a single block
+  pg = alloc_pages(4, GFP_KERNEL);
+  ok(pg != NULL && pg->page_num == 16, "Free pages coalesce with their buddies");
+}
+
+static void
+free_pages_keeps_recorded_order_test (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  memset(mock_cache, 0, sizeof(mock_cache));
+  seed_memblock();
+
+  kstat          = (kstat_t){0};
+  page_init(NUM_TEST_PAGES);
+
+  int     num_free = kstat.num_free_pages;
+  page_t *pg       = alloc_pages(2, GFP_KERNEL);
+
+  free_pages(pg, 1);
+  eq_num(kstat.num_free_pages, num_free, "The whole block is freed despite the wrong order");
+
+  pg = alloc_pages(4, GFP_KERNEL);
+  ok(pg != NULL && pg->page_num == 16, "The freed block coalesces with its buddies");
+}
+
+/**
+ * Only single free pages are zeroed ahead of time, so leave `n` of them on the free lists by freeing
+ * every other page of a run of allocations. Their buddies stay allocated, so they can't coalesce.
+ */
+static void
+leave_single_free_pages (int n) {
+  page_t *pages[NUM_TEST_PAGES];
+
+  for (int i = 0; i < 2 * n; i++) {
+    pages[i] = page_get_free(GFP_KERNEL);
+  }
+  for (int i = 0; i < 2 * n; i++) {
+    if (!(pages[i]->page_num & 1)) {
+      page_release(pages[i]);
+    }
+  }
+}
+
+static void
+page_zero_idle_fills_zeroed_pool_test (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  memset(mock_cache, 0, sizeof(mock_cache));
+  seed_memblock();
+
+  kstat          = (kstat_t){0};
+  page_init(NUM_TEST_PAGES);
+  leave_single_free_pages(4);
+  memset((void *)KERNEL_PAGE_OFFSET, 0xAA, NUM_TEST_PAGES * PAGE_SIZE);
+
+  int num_free = kstat.num_free_pages;
+
+  eq_num(page_zero_idle(8), 4, "The single free pages are zeroed");
+  eq_num(kstat.zeroed_pages, 4, "The pages are added to the pre-zeroed pool");
+  eq_num(kstat.num_free_pages, num_free, "Pre-zeroed pages still count as free");
+
+  page_t        *pg   = page_get_zeroed(GFP_KERNEL);
+  unsigned char *data = (unsigned char *)(KERNEL_PAGE_OFFSET + (pg->page_num << PAGE_SHIFT));
+
+  eq_num(kstat.zeroed_hits, 1, "The page is taken from the pre-zeroed pool");
+  eq_num(kstat.zeroed_pages, 3, "The pool shrinks by one page");
+  ok(!data[0] && !data[PAGE_SIZE - 1], "The page is filled with zeros");
+  ok(!(pg->flags & PAGE_ZEROED), "The page is no longer marked as pre-zeroed");
+}
+
+static void
+page_get_free_falls_back_to_zeroed_pool_test (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  memset(mock_cache, 0, sizeof(mock_cache));
+  seed_memblock();
+
+  kstat                = (kstat_t){0};
+  page_init(NUM_TEST_PAGES);
+  kstat.min_free_pages = 0;
+
+  leave_single_free_pages(2);
+  page_zero_idle(2);
+
+  // Drain the free lists, leaving only the pre-zeroed pool
+  for (int n = kstat.num_free_pages - kstat.zeroed_pages; n > 0; n--) {
+    page_get_free(GFP_KERNEL);
+  }
+  eq_num(kstat.zeroed_pages, 2, "The pre-zeroed pool is left alone while there are other pages");
+
+  page_t *pg = page_get_free(GFP_KERNEL);
+
+  ok(pg != NULL, "The pre-zeroed pool is used once the free lists are empty");
+  eq_num(kstat.zeroed_pages, 1, "The page is taken from the pre-zeroed pool");
+  eq_num(pg->usage_count, 1, "Usage count set to 1");
+}
+
+static void
+page_get_free_color_prefers_requested_color_test (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  memset(mock_cache, 0, sizeof(mock_cache));
+  seed_memblock();
+
+  kstat       = (kstat_t){0};
+  page_colors = 4;
+  page_init(NUM_TEST_PAGES);
+
+  // Pages 1 and 14 are the only free single pages; everything else sits in larger blocks
+  page_t *pg  = page_get_free_color(GFP_KERNEL, 1);
+  eq_num(pg->page_num, 1, "A free page of the requested color is used first");
+
+  pg = page_get_free_color(GFP_KERNEL, 3);
+  eq_num(pg->page_num % 4, 3, "Larger blocks are split to yield the requested color");
+
+  pg = page_get_free_color(GFP_KERNEL, 7);
+  eq_num(pg->page_num % 4, 3, "Colors wrap around");
+  eq_num(kstat.page_color_misses, 0, "No allocation had to settle for another color");
+
+  eq_num(page_color(0xC0005000), 1, "Colors follow virtual addresses");
+
+  page_colors = 1;
+}
+
+static void
+highmem_is_only_handed_to_highmem_allocations_test (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  memset(mock_cache, 0, sizeof(mock_cache));
+  seed_memblock();
+
+  kstat         = (kstat_t){0};
+  highmem_start = NUM_TEST_PAGES - 8;
+  highmem_end   = NUM_TEST_PAGES;
+  page_init(NUM_TEST_PAGES);
+
+  eq_num(kstat.num_free_highmem, 8, "Free highmem is counted separately");
+
+  page_t *pg = page_get_free(GFP_KERNEL);
+  ok(!page_is_highmem(pg), "Regular allocations are never given highmem");
+
+  pg = page_get_free(GFP_HIGHUSER);
+  ok(page_is_highmem(pg), "Highmem allocations use up highmem first");
+  eq_num(kstat.num_free_highmem, 7, "Allocating highmem takes it off the highmem free list");
+
+  page_release(pg);
+  eq_num(kstat.num_free_highmem, 8, "Released highmem goes back to the highmem free list");
+
+  highmem_start = 0;
+  highmem_end   = 0;
+}
+
+static void
+page_from_num_skips_missing_sections_test (void) {
+  memmap_num_pages = 2 * PAGES_PER_SECTION;
+
+  eq_num(page_from_num(1), &mock_page_pool[1], "Pages are found within their section");
+  eq_null(page_from_num(PAGES_PER_SECTION), "Sections without usable memory have no pages");
+  ok(!page_is_valid(PAGES_PER_SECTION + 1), "Pages in missing sections are invalid");
+  eq_null(page_from_num(2 * PAGES_PER_SECTION), "Pages beyond the end of memory have no pages");
+
+  memmap_num_pages = NUM_TEST_PAGES;
+}
+
+static void
+page_cache_insert_and_lookup_test (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  memset(mock_cache, 0, sizeof(mock_cache));
+  seed_memblock();
+
+  kstat = (kstat_t){0};
+  page_init(NUM_TEST_PAGES);
+
+  page_t *pg = page_get_free(GFP_KERNEL);
+  eq_num(page_cache_insert(pg, 1, 42, 0), RET_OK, "Page is added to the cache");
+  eq_num(page_cache_insert(pg, 1, 42, PAGE_SIZE), RET_FAIL, "A page is only cached once");
+  eq_num(kstat.page_cache_pages, 1, "Cached pages are counted");
+
+  eq_num(page_cache_lookup(1, 42, 0), pg, "Cached page is found");
+  eq_num(pg->usage_count, 2, "Lookup takes a reference");
+  eq_null(page_cache_lookup(2, 42, 0), "Pages are keyed by device as well as inode");
+  eq_num(kstat.page_cache_hits, 1, "Hits are counted");
+  eq_num(kstat.page_cache_misses, 1, "Misses are counted");
+
+  page_release(pg);
+  page_release(pg);
+  int num_free = kstat.num_free_pages;
+  eq_num(page_cache_lookup(1, 42, 0), pg, "Released pages stay cached");
+  eq_num(kstat.num_free_pages, num_free - 1, "Lookup takes a released page off the free list");
+
+  page_cache_remove(pg);
+  eq_null(pg->cache, "Removed page has no cache metadata");
+  eq_null(page_cache_lookup(1, 42, 0), "Removed page is no longer found");
+}
+
+static void
+page_cache_lookup_range_stops_at_first_miss_test (void) {
+  for (unsigned int n = 0; n < 3; n++) {
+    page_cache_insert(page_get_free(GFP_KERNEL), 1, 7, n << PAGE_SHIFT);
+  }
+
+  page_t *pages[5];
+  eq_num(page_cache_lookup_range(1, 7, 0, 5, pages), 3, "Range lookup returns consecutive pages");
+  eq_num(page_cache_lookup_range(1, 7, PAGE_SIZE, 1, pages), 1, "Range lookup honours the limit");
+  ok(pages[0]->cache->file_offset == PAGE_SIZE, "Range lookup starts at the given offset");
+}
+
 int
 main (void) {
-  page_cache_size     = sizeof(mock_cache);
-  free_page_list_size = sizeof(mock_page_pool);
-  free_page_list      = mock_page_pool;
-  page_cache          = mock_cache;
+  page_cache_size    = sizeof(mock_cache);
+  memmap_sections[0] = mock_page_pool;
+  memmap_num_pages   = NUM_TEST_PAGES;
+  page_cache         = mock_cache;
+
+  if (mmap(
+        (void *)KERNEL_PAGE_OFFSET,
+        NUM_TEST_PAGES * PAGE_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+        -1,
+        0
+      )
+      == MAP_FAILED) {
+    bail_out("unable to map the test pages");
+  }
 
-  plan(12);
+  plan(69);
 
   page_init_reserves_and_initializes_free_list_test();
   page_get_free_returns_page_test();
+  page_get_free_dips_into_reserve_only_for_atomic_test();
   page_release_returns_page_to_free_list_test();
   page_release_with_zero_use_count_does_nothing_test();
   page_get_free_returns_null_if_empty_test();
+  alloc_pages_returns_contiguous_blocks_test();
+  free_pages_keeps_recorded_order_test();
+  page_zero_idle_fills_zeroed_pool_test();
+  page_get_free_falls_back_to_zeroed_pool_test();
+  page_get_free_color_prefers_requested_color_test();
+  highmem_is_only_handed_to_highmem_allocations_test();
+  page_from_num_skips_missing_sections_test();
+  page_cache_init();
+  page_cache_insert_and_lookup_test();
+  page_cache_lookup_range_stops_at_first_miss_test();
 
   done_testing();
 }
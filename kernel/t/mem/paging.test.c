@@ -0,0 +1,273 @@
+#include "mem/paging.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../stubs.h"
+#include "arch/tlb.h"
+#include "libtap/libtap.h"
+#include "mem/base.h"
+#include "mem/page.h"
+
+/**
+ * Frames handed out as page tables and user pages. Page tables are reached through the direct map,
+ * so the frames' direct-mapped addresses have to be backed by real memory.
+ */
+#define NUM_TEST_PAGES 8
+#define PGDIR_PAGE     1
+#define FRAME_ADDR(n)  (KERNEL_PAGE_OFFSET + ((n) << PAGE_SHIFT))
+
+#define ADDR_A 0x08048000
+#define ADDR_B 0x08049000
+
+static page_t mock_page_pool[NUM_TEST_PAGES];
+static int    next_page;
+static int    pages_allocated;
+static int    pages_released;
+static int    pages_flushed;
+
+/**
+ * Run once from within the next page allocation, as if another process ran while we slept
+ */
+static void (*while_allocating)(void);
+
+unsigned int
+eflags_get (void) {
+  return 0;
+}
+
+void
+int_disable (void) {}
+
+void
+eflags_set (uint32_t eflags) {}
+
+pte_t *
+paging_pgdir_current (void) {
+  return (pte_t *)FRAME_ADDR(PGDIR_PAGE);
+}
+
+void
+tlb_flush_page (unsigned int addr) {
+  pages_flushed++;
+}
+
+page_t *
+page_get_free (gfp_t gfp) {
+  if (while_allocating) {
+    void (*fn)(void) = while_allocating;
+    while_allocating = NULL;
+    fn();
+  }
+
+  if (next_page >= NUM_TEST_PAGES) {
+    return NULL;
+  }
+
+  page_t *page      = &mock_page_pool[next_page++];
+  page->usage_count = 1;
+  pages_allocated++;
+  return page;
+}
+
+page_t *
+page_get_zeroed (gfp_t gfp) {
+  page_t *page;
+  if ((page = page_get_free(gfp))) {
+    memset(page->data, 0, PAGE_SIZE);
+  }
+  return page;
+}
+
+void
+page_release (page_t *page) {
+  page->usage_count--;
+  pages_released++;
+}
+
+static void
+reset_mocks (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  for (int i = 0; i < NUM_TEST_PAGES; i++) {
+    mock_page_pool[i].page_num = i;
+    mock_page_pool[i].data     = (void *)FRAME_ADDR(i);
+  }
+  memset((void *)FRAME_ADDR(PGDIR_PAGE), 0, PAGE_SIZE);
+
+  next_page        = PGDIR_PAGE + 1;
+  pages_allocated  = 0;
+  pages_released   = 0;
+  pages_flushed    = 0;
+  while_allocating = NULL;
+}
+
+static pte_t *
+pte_at (unsigned int addr) {
+  return paging_get_pte(paging_pgdir_current(), addr, false);
+}
+
+/**
+ * Maps a fresh frame holding `contents` at `addr`, and returns its descriptor
+ */
+static page_t *
+map_frame (unsigned int addr, const char *contents) {
+  page_t *page = page_get_free(GFP_HIGHUSER);
+  strcpy(page->data, contents);
+
+  *paging_get_pte(paging_pgdir_current(), addr, true) =
+    page_to_phys(page) | PAGE_PRESENT | PAGE_RW | PAGE_USER;
+
+  return page;
+}
+
+static void
+demand_zero_test (void) {
+  pte_t *pgdir = paging_pgdir_current();
+
+  eq_num(paging_reserve(pgdir, ADDR_A, PAGE_RW | PAGE_USER), RET_OK, "The page is reserved");
+  eq_num(pages_allocated, 1, "Only a page table is allocated");
+
+  pte_t *pte = pte_at(ADDR_A);
+  ok(*pte == (PAGE_NOALLOC | PAGE_RW | PAGE_USER), "The entry is reserved but not present");
+  eq_num(
+    paging_reserve(pgdir, ADDR_A, PAGE_RW | PAGE_USER),
+    RET_OK,
+    "A reserved page may be reserved again"
+  );
+
+  eq_num(
+    paging_handle_fault(ADDR_B, PAGE_FAULT_USRMOD),
+    RET_FAIL,
+    "Unreserved pages don't fault in"
+  );
+
+  memset((void *)FRAME_ADDR(next_page), 0xAA, PAGE_SIZE);
+  eq_num(paging_handle_fault(ADDR_A, PAGE_FAULT_USRMOD), RET_OK, "The fault is resolved");
+
+  page_t *page = PTE_PAGE(*pte);
+  ok(*pte & PAGE_PRESENT, "The page is present");
+  ok(
+    (*pte & (PAGE_RW | PAGE_USER)) == (PAGE_RW | PAGE_USER),
+    "The reserved permissions are kept"
+  );
+  eq_num(((unsigned char *)page->data)[PAGE_SIZE - 1], 0, "The frame is zero-filled");
+  eq_num(pages_flushed, 1, "The TLB entry is flushed");
+  eq_num(paging_reserve(pgdir, ADDR_A, PAGE_RW), RET_FAIL, "A present page can't be reserved");
+}
+
+static void
+cow_shared_test (void) {
+  page_t *page = map_frame(ADDR_A, "shared");
+  pte_t  *src  = pte_at(ADDR_A);
+  pte_t  *dst  = pte_at(ADDR_B);
+
+  paging_share_cow(src, dst, ADDR_A);
+
+  eq_num(page->usage_count, 2, "Sharing takes a reference to the frame");
+  ok(page->flags & PAGE_COW, "The frame is marked copy-on-write");
+  ok(!(*src & PAGE_RW) && !(*dst & PAGE_RW), "Both mappings are read-only");
+  ok(*src == *dst, "Both mappings point at the same frame");
+
+  int faulted = paging_handle_fault(ADDR_A, PAGE_FAULT_PROTVIOL | PAGE_FAULT_WRIT);
+
+  eq_num(faulted, RET_OK, "The write fault is resolved");
+  ok(PTE_PAGE(*src) != page, "The writer gets its own frame");
+  ok(*src & PAGE_RW, "The writer's mapping is writable");
+  ok(!strcmp(PTE_PAGE(*src)->data, "shared"), "The frame's contents are copied");
+  eq_num(page->usage_count, 1, "The writer's reference to the shared frame is dropped");
+  ok(PTE_PAGE(*dst) == page && !(*dst & PAGE_RW), "The other mapping is untouched");
+}
+
+static void
+cow_single_owner_test (void) {
+  page_t *page = map_frame(ADDR_A, "owned");
+  pte_t  *src  = pte_at(ADDR_A);
+  pte_t  *dst  = pte_at(ADDR_B);
+
+  paging_share_cow(src, dst, ADDR_A);
+  // The other user unmaps the frame
+  *dst = 0;
+  page_release(page);
+
+  int allocated = pages_allocated;
+  int faulted   = paging_handle_fault(ADDR_A, PAGE_FAULT_PROTVIOL | PAGE_FAULT_WRIT);
+
+  eq_num(faulted, RET_OK, "The write fault is resolved");
+  ok(PTE_PAGE(*src) == page && (*src & PAGE_RW), "The last user writes to the frame in place");
+  ok(!(page->flags & PAGE_COW), "The frame is no longer copy-on-write");
+  eq_num(pages_allocated, allocated, "No frame is allocated");
+}
+
+static page_t *racing_page;
+
+static void
+unmap_other_user (void) {
+  *pte_at(ADDR_B) = 0;
+  page_release(racing_page);
+}
+
+static void
+cow_shared_released_while_allocating_test (void) {
+  page_t *page = racing_page = map_frame(ADDR_A, "racing");
+  pte_t  *src  = pte_at(ADDR_A);
+
+  paging_share_cow(src, pte_at(ADDR_B), ADDR_A);
+  while_allocating = unmap_other_user;
+
+  int released     = pages_released;
+  int faulted      = paging_handle_fault(ADDR_A, PAGE_FAULT_PROTVIOL | PAGE_FAULT_WRIT);
+
+  eq_num(faulted, RET_OK, "The write fault is resolved");
+  ok(PTE_PAGE(*src) == page && (*src & PAGE_RW), "The frame is taken over once it's unshared");
+  eq_num(pages_released, released + 2, "The unneeded copy is released");
+}
+
+static void
+cow_unknown_frame_test (void) {
+  // A frame past the end of the memmap, as found in a hole between memory sections
+  *paging_get_pte(paging_pgdir_current(), ADDR_A, true) =
+    ((pte_t)(NUM_TEST_PAGES + 16) << PAGE_SHIFT) | PAGE_PRESENT | PAGE_USER;
+
+  eq_num(
+    paging_handle_fault(ADDR_A, PAGE_FAULT_PROTVIOL | PAGE_FAULT_WRIT),
+    RET_FAIL,
+    "Writes to read-only frames without a page frame entry fail"
+  );
+}
+
+int
+main (void) {
+  memmap_sections[0] = mock_page_pool;
+  memmap_num_pages   = NUM_TEST_PAGES;
+
+  if (mmap(
+        (void *)FRAME_ADDR(0),
+        NUM_TEST_PAGES * PAGE_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+        -1,
+        0
+      )
+      == MAP_FAILED) {
+    bail_out("unable to map the test frames");
+  }
+
+  plan(29);
+
+  reset_mocks();
+  demand_zero_test();
+
+  reset_mocks();
+  cow_shared_test();
+
+  reset_mocks();
+  cow_single_owner_test();
+
+  reset_mocks();
+  cow_shared_released_while_allocating_test();
+
+  reset_mocks();
+  cow_unknown_frame_test();
+
+  done_testing();
+}
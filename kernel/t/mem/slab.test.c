@@ -0,0 +1,229 @@
+#include "mem/slab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../stubs.h"
+#include "arch/eflags.h"
+#include "kstat.h"
+#include "libtap/libtap.h"
+#include "mem/page.h"
+
+#define PAGE_POOL_SIZE 8
+
+extern kstat_t kstat;
+
+static page_t fake_page_pool[PAGE_POOL_SIZE];
+static char  *fake_page_data;
+static int    pages_in_use   = 0;
+static int    pages_released = 0;
+static int    ctor_called    = 0;
+static bool   irqs_off       = false;
+static bool   page_irqs_off  = false;
+
+page_t *
+page_get_free (gfp_t gfp) {
+  page_irqs_off = irqs_off;
+  for (int i = 0; i < PAGE_POOL_SIZE; i++) {
+    if (!fake_page_pool[i].usage_count) {
+      fake_page_pool[i].usage_count = 1;
+      fake_page_pool[i].page_num    = i;
+      fake_page_pool[i].data        = fake_page_data + (i * PAGE_SIZE);
+      pages_in_use++;
+      return &fake_page_pool[i];
+    }
+  }
+  return NULL;
+}
+
+void
+page_release (page_t *page) {
+  page->usage_count = 0;
+  pages_in_use--;
+  pages_released++;
+}
+
+unsigned int
+eflags_get (void) {
+  return irqs_off ? 0 : EFLAGS_INT_ENABLED;
+}
+
+void
+int_disable (void) {
+  irqs_off = true;
+}
+
+void
+eflags_set (uint32_t eflags) {
+  irqs_off = !(eflags & EFLAGS_INT_ENABLED);
+}
+
+static void
+test_ctor (void *obj) {
+  ctor_called++;
+  *(unsigned int *)obj = 0xCAFEBABE;
+}
+
+#define reset_mocks()                                \
+  memset(fake_page_pool, 0, sizeof(fake_page_pool)); \
+  pages_in_use   = 0;                                \
+  pages_released = 0;                                \
+  ctor_called    = 0;                                \
+  irqs_off       = false;                            \
+  page_irqs_off  = false;                            \
+  kstat          = (kstat_t){0};                     \
+  slab_init();
+
+static void
+cache_create_computes_layout_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("test", 24, 0, NULL);
+
+  neq_null(cache, "kmem_cache_create returns a cache");
+  eq_num(cache->size, 24, "object slots are not padded beyond the alignment");
+  ok(cache->objects_per_slab > 1, "multiple objects fit in a single slab");
+  eq_num(pages_in_use, 1, "cache descriptor is allocated from the cache of caches");
+}
+
+static void
+cache_create_rejects_oversized_objects_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("huge", PAGE_SIZE, 0, NULL);
+
+  eq_null(cache, "kmem_cache_create fails for objects larger than a slab");
+}
+
+static void
+alloc_packs_objects_into_one_page_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("test", 32, 0, NULL);
+  int           pages = pages_in_use;
+
+  char *a             = kmem_cache_alloc(cache, GFP_KERNEL);
+  char *b             = kmem_cache_alloc(cache, GFP_KERNEL);
+
+  neq_null(a, "first allocation succeeds");
+  neq_null(b, "second allocation succeeds");
+  eq_num(pages_in_use, pages + 1, "both objects come from the same slab");
+  eq_num(
+    ((unsigned int)a & PAGE_MASK),
+    ((unsigned int)b & PAGE_MASK),
+    "both objects live in the same page"
+  );
+  eq_num(cache->num_active, 2, "active object count is tracked");
+}
+
+static void
+alloc_grows_cache_when_full_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("test", 512, 0, NULL);
+  int           pages = pages_in_use;
+
+  for (unsigned int n = 0; n <= cache->objects_per_slab; n++) {
+    kmem_cache_alloc(cache, GFP_KERNEL);
+  }
+
+  eq_num(pages_in_use, pages + 2, "a second slab is allocated once the first is full");
+  eq_num(cache->num_slabs, 2, "slab count is tracked");
+  eq_num(kstat.slab_pages, 3, "kstat tracks slab pages");
+}
+
+static void
+alloc_grows_cache_with_interrupts_enabled_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("test", 128, 0, NULL);
+  void         *obj   = kmem_cache_alloc(cache, GFP_KERNEL);
+
+  neq_null(obj, "an object is allocated from a new slab");
+  ok(!page_irqs_off, "the slab's page is allocated with interrupts enabled");
+  ok(!irqs_off, "interrupts are restored after the allocation");
+}
+
+static void
+free_reuses_object_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("test", 64, 0, NULL);
+
+  void *a             = kmem_cache_alloc(cache, GFP_KERNEL);
+  kmem_cache_free(cache, a);
+  void *b = kmem_cache_alloc(cache, GFP_KERNEL);
+
+  eq_num(a, b, "a freed object is handed out again");
+}
+
+static void
+free_releases_surplus_empty_slabs_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("test", 1024, 0, NULL);
+  void         *objs[8];
+  unsigned int  count = cache->objects_per_slab * 2;
+
+  for (unsigned int n = 0; n < count; n++) {
+    objs[n] = kmem_cache_alloc(cache, GFP_KERNEL);
+  }
+  for (unsigned int n = 0; n < count; n++) {
+    kmem_cache_free(cache, objs[n]);
+  }
+
+  eq_num(cache->num_slabs, 1, "only one empty slab is retained");
+  eq_num(pages_released, 1, "surplus empty slabs are returned to the page allocator");
+
+  eq_num(kmem_cache_shrink(cache), 1, "shrink releases the retained empty slab");
+  eq_num(cache->num_slabs, 0, "no slabs remain after shrinking");
+}
+
+static void
+ctor_runs_once_per_object_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("test", sizeof(unsigned int), 0, test_ctor);
+
+  unsigned int *obj   = kmem_cache_alloc(cache, GFP_KERNEL);
+  eq_num(ctor_called, cache->objects_per_slab, "ctor runs for every object on slab creation");
+  eq_num(*obj, 0xCAFEBABE, "allocated object is constructed");
+
+  kmem_cache_free(cache, obj);
+  obj = kmem_cache_alloc(cache, GFP_KERNEL);
+  eq_num(*obj, 0xCAFEBABE, "constructed state survives a free");
+  eq_num(ctor_called, cache->objects_per_slab, "ctor is not run again on reuse");
+}
+
+static void
+destroy_fails_with_active_objects_test (void) {
+  kmem_cache_t *cache = kmem_cache_create("test", 16, 0, NULL);
+  void         *obj   = kmem_cache_alloc(cache, GFP_KERNEL);
+
+  eq_num(kmem_cache_destroy(cache), RET_FAIL, "destroy fails while objects are in use");
+
+  kmem_cache_free(cache, obj);
+  eq_num(kmem_cache_destroy(cache), RET_OK, "destroy succeeds once all objects are freed");
+}
+
+int
+main (void) {
+  fake_page_data = aligned_alloc(PAGE_SIZE, PAGE_POOL_SIZE * PAGE_SIZE);
+
+  plan(27);
+
+  reset_mocks();
+  cache_create_computes_layout_test();
+
+  reset_mocks();
+  cache_create_rejects_oversized_objects_test();
+
+  reset_mocks();
+  alloc_packs_objects_into_one_page_test();
+
+  reset_mocks();
+  alloc_grows_cache_when_full_test();
+
+  reset_mocks();
+  alloc_grows_cache_with_interrupts_enabled_test();
+
+  reset_mocks();
+  free_reuses_object_test();
+
+  reset_mocks();
+  free_releases_surplus_empty_slabs_test();
+
+  reset_mocks();
+  ctor_runs_once_per_object_test();
+
+  reset_mocks();
+  destroy_fails_with_active_objects_test();
+
+  free(fake_page_data);
+
+  done_testing();
+}
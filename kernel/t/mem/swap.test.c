@@ -0,0 +1,214 @@
+#include "mem/swap.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../stubs.h"
+#include "kstat.h"
+#include "libtap/libtap.h"
+#include "mem/base.h"
+#include "mem/kswapd.h"
+#include "mem/page.h"
+#include "mem/paging.h"
+#include "mem/slab.h"
+#include "mem/zpool.h"
+
+/**
+ * Frames handed out as the page directory and page tables, which are reached through the direct map,
+ * so their direct-mapped addresses have to be backed by real memory. The directory spans four pages
+ * with PAE.
+ */
+#define PGDIR_PAGE     1
+#define NUM_TEST_PAGES 16
+#define FRAME_ADDR(n)  (KERNEL_PAGE_OFFSET + ((n) << PAGE_SHIFT))
+
+#define USER_ADDR      0x08048000
+
+extern kstat_t kstat;
+
+static page_t      mock_page_pool[NUM_TEST_PAGES];
+static char        page_data[NUM_TEST_PAGES][PAGE_SIZE];
+static int         next_page;
+static int         pages_released;
+static shrinker_t *swap_shrinker;
+
+unsigned int
+eflags_get (void) {
+  return 0;
+}
+
+void
+int_disable (void) {}
+
+void
+eflags_set (uint32_t eflags) {}
+
+void
+tlb_flush_page (unsigned int addr) {}
+
+void
+tlb_flush_all (void) {}
+
+void
+tlb_flush_global (void) {}
+
+pte_t *
+paging_pgdir_current (void) {
+  return kpage_dir;
+}
+
+void *
+vmalloc (size_t size) {
+  return malloc(size);
+}
+
+void
+shrinker_register (shrinker_t *shrinker) {
+  swap_shrinker = shrinker;
+}
+
+void *
+kmem_cache_alloc (kmem_cache_t *cache, gfp_t gfp) {
+  return calloc(1, sizeof(kmem_cache_t) + ZPOOL_MAX_SIZE);
+}
+
+void
+kmem_cache_free (kmem_cache_t *cache, void *obj) {
+  free(obj);
+}
+
+page_t *
+page_get_free (gfp_t gfp) {
+  if (next_page >= NUM_TEST_PAGES) {
+    return NULL;
+  }
+
+  page_t *page      = &mock_page_pool[next_page++];
+  page->usage_count = 1;
+  return page;
+}
+
+page_t *
+page_get_zeroed (gfp_t gfp) {
+  page_t *page;
+  if ((page = page_get_free(gfp))) {
+    memset((void *)FRAME_ADDR(page->page_num), 0, PAGE_SIZE);
+  }
+  return page;
+}
+
+void
+page_release (page_t *page) {
+  page->usage_count--;
+  pages_released++;
+}
+
+static void
+reset_mocks (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  for (int i = 0; i < NUM_TEST_PAGES; i++) {
+    mock_page_pool[i].page_num = i;
+    mock_page_pool[i].data     = page_data[i];
+  }
+  memset((void *)FRAME_ADDR(PGDIR_PAGE), 0, 4 * PAGE_SIZE);
+
+  kstat          = (kstat_t){0};
+  next_page      = PGDIR_PAGE + 4;
+  pages_released = 0;
+}
+
+/**
+ * Maps a fresh frame filled with a recognizable pattern at `addr`
+ */
+static page_t *
+map_page (unsigned int addr, pte_t flags) {
+  page_t *page = page_get_free(GFP_HIGHUSER);
+  for (int n = 0; n < PAGE_SIZE; n++) {
+    ((unsigned char *)page->data)[n] = n % 7;
+  }
+
+  *paging_get_pte(kpage_dir, addr, true) = page_to_phys(page) | PAGE_PRESENT | flags;
+
+  return page;
+}
+
+static bool
+holds_pattern (page_t *page) {
+  for (int n = 0; n < PAGE_SIZE; n++) {
+    if (((unsigned char *)page->data)[n] != n % 7) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void
+swap_round_trip_test (void) {
+  page_t *page = map_page(USER_ADDR, PAGE_RW | PAGE_USER | PAGE_ACCESSED);
+  pte_t  *pte  = paging_get_pte(kpage_dir, USER_ADDR, false);
+
+  eq_num(swap_shrinker->shrink(1), 0, "A recently accessed page gets a second chance");
+  ok((*pte & PAGE_PRESENT) && !(*pte & PAGE_ACCESSED), "It stays mapped, but is marked unused");
+
+  eq_num(swap_shrinker->shrink(1), 1, "An unused page is swapped out");
+  ok(!(*pte & PAGE_PRESENT) && (*pte & PAGE_SWAPPED), "The entry points at the swap slot");
+  ok((*pte & (PAGE_RW | PAGE_USER)) == (PAGE_RW | PAGE_USER), "The permissions are kept");
+  eq_num(pages_released, 1, "The frame is released");
+  eq_num(kstat.swap_pages, 1, "The page is accounted as swapped");
+  eq_num(paging_reserve(kpage_dir, USER_ADDR, PAGE_RW), RET_FAIL, "It can't be reserved again");
+  ok(*pte & PAGE_SWAPPED, "Its entry still points at the swap slot");
+
+  memset(page->data, 0, PAGE_SIZE);
+  eq_num(paging_handle_fault(USER_ADDR, PAGE_FAULT_USRMOD), RET_OK, "The page faults back in");
+
+  ok(*pte & PAGE_PRESENT, "The page is present again");
+  ok((*pte & (PAGE_RW | PAGE_USER)) == (PAGE_RW | PAGE_USER), "The permissions are restored");
+  ok(holds_pattern(PTE_PAGE(*pte)), "The contents are restored");
+  eq_num(kstat.swap_pages, 0, "The swap slot is freed");
+  eq_num(kstat.swap_faults, 1, "The swap fault is accounted");
+}
+
+static void
+shared_page_not_swapped_test (void) {
+  page_t *page      = map_page(USER_ADDR, PAGE_USER);
+  page->usage_count = 2;
+
+  eq_num(swap_shrinker->shrink(1), 0, "A page mapped more than once isn't swapped out");
+  ok(*paging_get_pte(kpage_dir, USER_ADDR, false) & PAGE_PRESENT, "It stays mapped");
+  eq_num(pages_released, 0, "The frame is kept");
+}
+
+int
+main (void) {
+  memmap_sections[0] = mock_page_pool;
+  memmap_num_pages   = NUM_TEST_PAGES;
+  kpage_dir          = (pte_t *)FRAME_ADDR(PGDIR_PAGE);
+
+  if (mmap(
+        (void *)FRAME_ADDR(0),
+        NUM_TEST_PAGES * PAGE_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+        -1,
+        0
+      )
+      == MAP_FAILED) {
+    bail_out("unable to map the test frames");
+  }
+
+  swap_init();
+  if (!swap_shrinker) {
+    bail_out("swap was not enabled");
+  }
+
+  plan(18);
+
+  reset_mocks();
+  swap_round_trip_test();
+
+  reset_mocks();
+  shared_page_not_swapped_test();
+
+  done_testing();
+}
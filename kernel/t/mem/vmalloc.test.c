@@ -0,0 +1,244 @@
+#include "mem/vmalloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../stubs.h"
+#include "kstat.h"
+#include "libtap/libtap.h"
+#include "mem/allocprof.h"
+#include "mem/base.h"
+#include "mem/page.h"
+#include "mem/paging.h"
+#include "mem/slab.h"
+
+/**
+ * Frames handed out as the kernel page directory and page tables, which are reached through the
+ * direct map, so their direct-mapped addresses have to be backed by real memory. The directory
+ * spans four pages with PAE.
+ */
+#define PGDIR_PAGE     1
+#define NUM_TEST_PAGES 16
+#define FRAME_ADDR(n)  (KERNEL_PAGE_OFFSET + ((n) << PAGE_SHIFT))
+
+#define TEST_START     0xD0000000
+#define PAGE_ADDR(n)   (TEST_START + ((n) << PAGE_SHIFT))
+
+extern kstat_t kstat;
+
+static page_t    mock_page_pool[NUM_TEST_PAGES];
+static vm_area_t mock_areas[4];
+static int       next_page;
+static int       next_area;
+static int       pages_released;
+static int       areas_freed;
+
+/**
+ * The number of frames handed out before the allocator runs dry
+ */
+static int frames_left;
+
+unsigned int
+eflags_get (void) {
+  return 0;
+}
+
+void
+int_disable (void) {}
+
+void
+eflags_set (uint32_t eflags) {}
+
+void
+tlb_flush_page (unsigned int addr) {}
+
+void
+tlb_flush_all (void) {}
+
+void
+tlb_flush_global (void) {}
+
+unsigned int
+kmalloc (size_t size, gfp_t gfp) {
+  return (unsigned int)malloc(size);
+}
+
+void
+kfree (unsigned int addr) {
+  free((void *)addr);
+}
+
+void *
+kmem_cache_alloc (kmem_cache_t *cache, gfp_t gfp) {
+  return &mock_areas[next_area++];
+}
+
+void
+kmem_cache_free (kmem_cache_t *cache, void *obj) {
+  areas_freed++;
+}
+
+static page_t *
+take_mock_page (void) {
+  page_t *page      = &mock_page_pool[next_page++];
+  page->usage_count = 1;
+  return page;
+}
+
+page_t *
+page_get_zeroed (gfp_t gfp) {
+  page_t *page = take_mock_page();
+  memset((void *)FRAME_ADDR(page->page_num), 0, PAGE_SIZE);
+  return page;
+}
+
+page_t *
+page_get_free_color (gfp_t gfp, unsigned int color) {
+  if (!frames_left) {
+    return NULL;
+  }
+  frames_left--;
+  return take_mock_page();
+}
+
+void
+page_release (page_t *page) {
+  page->usage_count--;
+  pages_released++;
+}
+
+static void
+reset_mocks (void) {
+  memset(mock_page_pool, 0, sizeof(mock_page_pool));
+  for (int i = 0; i < NUM_TEST_PAGES; i++) {
+    mock_page_pool[i].page_num = i;
+  }
+  memset(mock_areas, 0, sizeof(mock_areas));
+  memset((void *)FRAME_ADDR(PGDIR_PAGE), 0, 4 * PAGE_SIZE);
+
+  kstat          = (kstat_t){0};
+  next_page      = PGDIR_PAGE + 4;
+  next_area      = 0;
+  pages_released = 0;
+  areas_freed    = 0;
+  frames_left    = NUM_TEST_PAGES;
+}
+
+static bool
+mapped (unsigned int addr) {
+  pte_t *pte = paging_get_pte(kpage_dir, addr, false);
+  return pte && (*pte & PAGE_PRESENT);
+}
+
+static void
+vmalloc_leaves_guard_page_test (void) {
+  void *a = vmalloc(2 * PAGE_SIZE);
+  void *b = vmalloc(1);
+
+  ok(a == (void *)PAGE_ADDR(0), "The first area starts the vmalloc area");
+  ok(mapped(PAGE_ADDR(0)) && mapped(PAGE_ADDR(1)), "The area is mapped");
+  ok(!mapped(PAGE_ADDR(2)), "The page after the area is left unmapped");
+  ok(b == (void *)PAGE_ADDR(3), "The next area starts after the guard page");
+  eq_num(kstat.vmalloc_pages, 3, "Mapped pages are accounted");
+
+  vfree(a);
+  vfree(b);
+}
+
+static void
+vfree_reuses_first_fit_test (void) {
+  void *a = vmalloc(2 * PAGE_SIZE);
+  void *b = vmalloc(PAGE_SIZE);
+
+  vfree(a);
+
+  ok(!mapped(PAGE_ADDR(0)) && !mapped(PAGE_ADDR(1)), "The freed area is unmapped");
+  eq_num(pages_released, 2, "The freed area's frames are released");
+  eq_num(areas_freed, 1, "The freed area's descriptor is released");
+  eq_num(kstat.vmalloc_pages, 1, "Unmapped pages are no longer accounted");
+
+  void *c = vmalloc(PAGE_SIZE);
+  void *d = vmalloc(PAGE_SIZE);
+
+  ok(c == (void *)PAGE_ADDR(0), "A freed range is reused for an area that fits");
+  ok(d == (void *)PAGE_ADDR(5), "Areas that don't fit in the gap go after the last area");
+  ok(b == (void *)PAGE_ADDR(3) && mapped(PAGE_ADDR(3)), "Other areas are left alone");
+
+  vfree(b);
+  vfree(c);
+  vfree(d);
+}
+
+static void
+vmalloc_cleans_up_on_failure_test (void) {
+  frames_left = 2;
+
+  eq_null(vmalloc(3 * PAGE_SIZE), "vmalloc fails when it runs out of frames");
+  ok(!mapped(PAGE_ADDR(0)) && !mapped(PAGE_ADDR(1)), "The pages mapped so far are unmapped");
+  eq_num(pages_released, 2, "Their frames are released");
+  eq_num(areas_freed, 1, "The area's descriptor is released");
+  eq_num(kstat.vmalloc_pages, 0, "Nothing is left accounted");
+
+  frames_left = 1;
+  void *a     = vmalloc(PAGE_SIZE);
+  ok(a == (void *)PAGE_ADDR(0), "The failed area's range is free again");
+
+  vfree(a);
+}
+
+#ifdef CONFIG_ALLOC_PROFILE
+static void
+vmalloc_attributes_frames_test (void) {
+  void    *a     = vmalloc(2 * PAGE_SIZE);
+  page_t **pages = mock_areas[0].pages;
+
+  const allocprof_site_t *entry = allocprof_site(pages[0]->alloc_tag);
+
+  neq_null(entry, "The area's frames are attributed to a call site");
+  eq_num(pages[1]->alloc_tag, pages[0]->alloc_tag, "All of the area's frames go to the same site");
+  eq_num(entry->live_bytes, 2 * PAGE_SIZE, "The site holds the area's frames");
+
+  vfree(a);
+}
+#endif
+
+int
+main (void) {
+  kpage_dir     = (pte_t *)FRAME_ADDR(PGDIR_PAGE);
+  vmalloc_start = TEST_START;
+
+  if (mmap(
+        (void *)FRAME_ADDR(0),
+        NUM_TEST_PAGES * PAGE_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+        -1,
+        0
+      )
+      == MAP_FAILED) {
+    bail_out("unable to map the test frames");
+  }
+
+#ifdef CONFIG_ALLOC_PROFILE
+  plan(21);
+#else
+  plan(18);
+#endif
+
+  reset_mocks();
+  vmalloc_leaves_guard_page_test();
+
+  reset_mocks();
+  vfree_reuses_first_fit_test();
+
+  reset_mocks();
+  vmalloc_cleans_up_on_failure_test();
+
+#ifdef CONFIG_ALLOC_PROFILE
+  reset_mocks();
+  vmalloc_attributes_frames_test();
+#endif
+
+  done_testing();
+}
@@ -0,0 +1,95 @@
+#include "mem/zpool.h"
+
+#include <stdlib.h>
+
+#include "../stubs.h"
+#include "libtap/libtap.h"
+#include "mem/kswapd.h"
+#include "mem/page.h"
+#include "mem/slab.h"
+
+#define PAGE_POOL_SIZE 16
+
+static page_t      fake_page_pool[PAGE_POOL_SIZE];
+static char       *fake_page_data;
+static shrinker_t *slab_shrinker;
+
+page_t *
+page_get_free (gfp_t gfp) {
+  for (int i = 0; i < PAGE_POOL_SIZE; i++) {
+    if (!fake_page_pool[i].usage_count) {
+      fake_page_pool[i].usage_count = 1;
+      fake_page_pool[i].page_num    = i;
+      fake_page_pool[i].data        = fake_page_data + (i * PAGE_SIZE);
+      return &fake_page_pool[i];
+    }
+  }
+  return NULL;
+}
+
+void
+page_release (page_t *page) {
+  page->usage_count = 0;
+}
+
+unsigned int
+eflags_get (void) {
+  return 0;
+}
+
+void
+int_disable (void) {}
+
+void
+eflags_set (uint32_t eflags) {}
+
+void
+shrinker_register (shrinker_t *shrinker) {
+  slab_shrinker = shrinker;
+}
+
+static void
+alloc_rejects_bad_sizes_test (void) {
+  eq_null(zpool_alloc(0, GFP_KERNEL), "Empty objects aren't stored");
+  eq_null(zpool_alloc(ZPOOL_MAX_SIZE + 1, GFP_KERNEL), "Objects over the limit aren't stored");
+  eq_num(zpool_pages(), 0, "Rejected objects take up no pages");
+}
+
+static void
+pages_follow_slabs_test (void) {
+  void *small = zpool_alloc(100, GFP_KERNEL);
+  void *other = zpool_alloc(120, GFP_KERNEL);
+  void *big   = zpool_alloc(ZPOOL_MAX_SIZE, GFP_KERNEL);
+
+  neq_null(small, "A small object is stored");
+  neq_null(big, "The largest object is stored");
+  eq_num(zpool_pages(), 2, "Objects of the same size class share a page");
+
+  zpool_free(small, 100);
+  zpool_free(other, 120);
+  zpool_free(big, ZPOOL_MAX_SIZE);
+
+  eq_num(zpool_pages(), 2, "Each class keeps its empty slab");
+
+  slab_shrinker->shrink(PAGE_POOL_SIZE);
+
+  eq_num(zpool_pages(), 0, "Slabs released by the slab shrinker are no longer counted");
+}
+
+int
+main (void) {
+  fake_page_data = aligned_alloc(PAGE_SIZE, PAGE_POOL_SIZE * PAGE_SIZE);
+
+  slab_init();
+  zpool_init();
+  if (!slab_shrinker) {
+    bail_out("the slab shrinker was not registered");
+  }
+
+  plan(8);
+
+  alloc_rejects_bad_sizes_test();
+  pages_follow_slabs_test();
+
+  done_testing();
+}
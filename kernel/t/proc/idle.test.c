@@ -0,0 +1,143 @@
+#include "kernel.h"
+
+#include <setjmp.h>
+
+#include "../stubs.h"
+#include "arch/interrupt.h"
+#include "libtap/libtap.h"
+#include "mem/page.h"
+#include "proc/sched.h"
+
+extern bool needs_resched;
+
+static jmp_buf halted;
+
+static bool irqs_off;
+static bool halted_irqs_off;
+static bool halted_resched;
+static int  sched_runs;
+static int  zero_calls;
+
+/**
+ * The number of times `page_zero_idle` finds pages to zero before the pool is full
+ */
+static int zero_batches;
+
+/**
+ * Whether an interrupt makes a reschedule due right after `page_zero_idle` finds nothing to do
+ */
+static bool resched_after_zeroing;
+
+void
+int_disable (void) {
+  irqs_off = true;
+}
+
+void
+int_enable (void) {
+  irqs_off = false;
+}
+
+void
+int_enable_halt (void) {
+  halted_irqs_off = irqs_off;
+  halted_resched  = needs_resched;
+  longjmp(halted, 1);
+}
+
+void
+sched_run (void) {
+  sched_runs++;
+  needs_resched = false;
+}
+
+int
+page_zero_idle (int nr_pages) {
+  zero_calls++;
+  if (zero_batches) {
+    zero_batches--;
+    return nr_pages;
+  }
+
+  if (resched_after_zeroing) {
+    resched_after_zeroing = false;
+    needs_resched         = true;
+  }
+  return 0;
+}
+
+static void
+reset_mocks (void) {
+  irqs_off              = false;
+  halted_irqs_off       = false;
+  halted_resched        = false;
+  sched_runs            = 0;
+  zero_calls            = 0;
+  zero_batches          = 0;
+  resched_after_zeroing = false;
+  needs_resched         = false;
+}
+
+static void
+run_idle (void) {
+  if (!setjmp(halted)) {
+    kernel_idle();
+  }
+}
+
+static void
+halts_with_interrupts_disabled_test (void) {
+  run_idle();
+
+  ok(halted_irqs_off, "Interrupts stay disabled until the halt");
+  eq_num(sched_runs, 0, "Nothing is scheduled");
+}
+
+static void
+runs_due_reschedule_test (void) {
+  needs_resched = true;
+
+  run_idle();
+
+  eq_num(sched_runs, 1, "A due reschedule runs before anything else");
+  ok(!halted_resched, "No reschedule is due when halting");
+}
+
+static void
+zeroes_pages_before_halting_test (void) {
+  zero_batches = 2;
+
+  run_idle();
+
+  eq_num(zero_calls, 3, "Pages are zeroed until there's nothing left to zero");
+}
+
+static void
+reschedules_instead_of_halting_test (void) {
+  resched_after_zeroing = true;
+
+  run_idle();
+
+  eq_num(sched_runs, 1, "A reschedule that became due before the halt runs first");
+  ok(!halted_resched, "The idle process doesn't halt on a due reschedule");
+  ok(halted_irqs_off, "Interrupts are disabled when it eventually halts");
+}
+
+int
+main (void) {
+  plan(8);
+
+  reset_mocks();
+  halts_with_interrupts_disabled_test();
+
+  reset_mocks();
+  runs_due_reschedule_test();
+
+  reset_mocks();
+  zeroes_pages_before_halting_test();
+
+  reset_mocks();
+  reschedules_instead_of_halting_test();
+
+  done_testing();
+}
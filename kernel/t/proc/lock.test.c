@@ -35,14 +35,15 @@ eflags_set (uint32_t eflags) {
 }
 
 int
-sleep (void *addr, proc_inttype state) {
+sleep_on_exclusive (wait_queue_head_t *wq, proc_inttype state) {
   slept    = true;
-  slept_on = addr;
+  slept_on = wq;
+  return 0;
 }
 
 void
-wakeup (void *addr) {
-  woken_up = addr;
+wakeup (wait_queue_head_t *wq) {
+  woken_up = wq;
 }
 
 // Reset all mocks between tests
@@ -89,7 +90,7 @@ lock_resource_contended_test (void) {
   ok(contentious_res.locked, "Resource should be locked after loop");
 
   ok(slept, "Should sleep if resource is locked");
-  ok(slept_on == &contentious_res, "Slept on correct resource");
+  ok(slept_on == &contentious_res.wait, "Slept on correct resource");
   eq_num(interrupts_enabled, true, "Interrupts should be re-enabled");
   eq_num(mock_eflags, FAKE_EFLAGS_VAL, "eflags_get should be called");
 
@@ -116,7 +117,7 @@ unlock_resource_with_waiters_test (void) {
 
   ok(!res.locked, "Resource should be unlocked");
   ok(!res.wanted, "Wanted flag should be cleared");
-  ok(woken_up == &res, "Wakeup called with correct resource");
+  ok(woken_up == &res.wait, "Wakeup called with correct resource");
   eq_num(interrupts_enabled, true, "Interrupts re-enabled after unlock");
 }
 
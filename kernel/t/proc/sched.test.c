@@ -4,9 +4,13 @@
 #include <string.h>
 
 #include "../stubs.h"
+#include "arch/eflags.h"
+#include "arch/tss.h"
 #include "kconfig.h"
+#include "lib/compiler.h"
+#include "lib/errno.h"
 #include "libtap/libtap.h"
-#include "mem/segments.h"
+#include "proc/preempt.h"
 #include "proc/proc.h"
 
 // TODO:
@@ -22,24 +26,17 @@
 
 static proc_t dummy_procs[3];
 
-bool did_context_switch = false;
-bool did_set_tss        = false;
+bool         did_context_switch = false;
+unsigned int mock_eflags        = 0;
 
 void
-do_switch (
-  unsigned int      *prev_esp_ptr,
-  unsigned int      *prev_eip_ptr,
-  unsigned int       idle_esp,
-  unsigned int       idle_eip,
-  unsigned int       idle_cr3,
-  unsigned short int tss
-) {
+switch_to (unsigned int *prev_esp, unsigned int next_esp) {
   did_context_switch = true;
 }
 
 unsigned int
 eflags_get (void) {
-  return 0;
+  return mock_eflags;
 }
 
 void
@@ -48,6 +45,27 @@ int_disable (void) {}
 void
 eflags_set (uint32_t eflags) {}
 
+static void
+reset_procs (void) {
+  for (unsigned int n = 0; n < sizeof(dummy_procs) / sizeof(proc_t); n++) {
+    sched_dequeue(&dummy_procs[n]);
+  }
+  memset(dummy_procs, 0, sizeof(dummy_procs));
+
+  proc_list          = dummy_procs;
+  proc_current       = &dummy_procs[0];
+  needs_resched      = true;
+  did_context_switch = false;
+  mock_eflags        = 0;
+}
+
+static void
+make_runnable (proc_t *p, int priority, int remaining_cpu_time) {
+  p->priority           = priority;
+  p->remaining_cpu_time = remaining_cpu_time;
+  proc_runnable(p);
+}
+
 static void
 no_switch_if_still_running_test (void) {
   needs_resched                    = false;
@@ -62,88 +80,286 @@ no_switch_if_still_running_test (void) {
 
 static void
 switches_if_different_proc_selected_test (void) {
-  dummy_procs[0].remaining_cpu_time = 0;
-  dummy_procs[0].priority           = 1;
-  dummy_procs[0].next_running       = &dummy_procs[1];
-  dummy_procs[0].state              = PROC_RUNNING;
-
-  dummy_procs[1].remaining_cpu_time = 2;
-  dummy_procs[1].priority           = 2;
-  dummy_procs[1].next_running       = NULL;
-  dummy_procs[1].state              = PROC_RUNNING;
+  make_runnable(&dummy_procs[1], 1, 1);
+  make_runnable(&dummy_procs[2], 2, 2);
+  proc_current = &dummy_procs[1];
 
-  proc_current->flags               = 0;
+  sched_run();
 
-  proc_running_list                 = &dummy_procs[0];
-  proc_running_list->next_running   = &dummy_procs[1];
-  proc_current                      = &dummy_procs[0];
-  needs_resched                     = true;
+  ok(did_context_switch, "Should perform context switch");
+  eq_num(proc_current, &dummy_procs[2], "Should switch to proc with highest priority");
+}
 
-  did_context_switch                = false;
+static void
+expired_proc_waits_for_next_round_test (void) {
+  make_runnable(&dummy_procs[1], 1, 1);
+  make_runnable(&dummy_procs[2], 2, 2);
+  proc_current                      = &dummy_procs[2];
+  dummy_procs[2].remaining_cpu_time = 0;
 
   sched_run();
 
-  ok(did_context_switch, "Should perform context switch");
-  eq_num(proc_current, &dummy_procs[1], "Should switch to proc with highest CPU time");
+  eq_num(proc_current, &dummy_procs[1], "Should switch to the proc with CPU time left");
+  eq_num(dummy_procs[2].remaining_cpu_time, 2, "Expired proc should be recharged to priority");
+  eq_num(dummy_procs[1].remaining_cpu_time, 1, "Other procs should keep their CPU time");
 }
 
 static void
 recharges_all_on_empty_cpu_time_test (void) {
-  dummy_procs[0].remaining_cpu_time = 0;
-  dummy_procs[0].priority           = 3;
-  dummy_procs[0].next_running       = &dummy_procs[1];
-  dummy_procs[1].remaining_cpu_time = 0;
-  dummy_procs[1].priority           = 4;
-  dummy_procs[1].next_running       = NULL;
+  make_runnable(&dummy_procs[1], 3, 0);
+  make_runnable(&dummy_procs[2], 4, 1);
+  proc_current                      = &dummy_procs[2];
+  dummy_procs[2].remaining_cpu_time = 0;
+
+  sched_run();
+
+  eq_num(dummy_procs[1].remaining_cpu_time, 3, "Proc 1 should be recharged to priority");
+  eq_num(dummy_procs[2].remaining_cpu_time, 4, "Proc 2 should be recharged to priority");
+  ok(!did_context_switch, "Should not switch context");
+  eq_num(proc_current, &dummy_procs[2], "Should select highest after recharge");
+}
+
+static void
+same_priority_runs_in_fifo_order_test (void) {
+  make_runnable(&dummy_procs[1], 5, 5);
+  make_runnable(&dummy_procs[2], 5, 5);
+
+  sched_run();
 
-  proc_running_list                 = &dummy_procs[0];
-  proc_current                      = &dummy_procs[0];
+  eq_num(proc_current, &dummy_procs[1], "Should pick the proc queued first");
 
+  dummy_procs[1].remaining_cpu_time = 0;
   needs_resched                     = true;
-  did_context_switch                = false;
-  did_set_tss                       = false;
 
   sched_run();
 
-  eq_num(dummy_procs[0].remaining_cpu_time, 3, "Proc 0 should be recharged to priority");
-  eq_num(dummy_procs[1].remaining_cpu_time, 4, "Proc 1 should be recharged to priority");
-  ok(did_context_switch, "Should still switch context");
-  eq_num(proc_current, &dummy_procs[1], "Should select highest after recharge");
+  eq_num(proc_current, &dummy_procs[2], "Should pick the next proc once the first one expires");
+}
+
+static void
+idles_when_nothing_runnable_test (void) {
+  proc_current = &dummy_procs[1];
+
+  sched_run();
+
+  eq_num(proc_current, &dummy_procs[PROC_IDLE_PID], "Should fall back to the idle proc");
+}
+
+static void
+tick_consumes_time_slice_test (void) {
+  make_runnable(&dummy_procs[1], 2, 2);
+  proc_current  = &dummy_procs[1];
+  needs_resched = false;
+
+  sched_tick();
+
+  eq_num(dummy_procs[1].remaining_cpu_time, 1, "Tick should consume CPU time");
+  ok(!needs_resched, "Should not reschedule while CPU time is left");
+
+  sched_tick();
+
+  eq_num(dummy_procs[1].remaining_cpu_time, 0, "Tick should consume the last of the CPU time");
+  ok(needs_resched, "Should reschedule once the time slice is used up");
+}
+
+static void
+rt_runs_before_time_share_test (void) {
+  make_runnable(&dummy_procs[1], 30, 30);
+  proc_current  = &dummy_procs[1];
+  needs_resched = false;
+
+  eq_num(sched_setscheduler(&dummy_procs[2], SCHED_FIFO, 1), 0, "Should set the policy");
+  make_runnable(&dummy_procs[2], 1, 1);
+
+  ok(needs_resched, "A runnable real-time proc should preempt a time-share proc");
+
+  sched_run();
+
+  eq_num(proc_current, &dummy_procs[2], "Should run the real-time proc first");
+}
+
+static void
+rt_throttling_test (void) {
+  make_runnable(&dummy_procs[1], 20, 20);
+  sched_setscheduler(&dummy_procs[2], SCHED_FIFO, 1);
+  make_runnable(&dummy_procs[2], 1, 1);
+
+  sched_run();
+
+  for (unsigned int n = 0; n < SCHED_RT_RUNTIME - 1; n++) {
+    sched_tick();
+  }
+
+  ok(!needs_resched, "A FIFO proc should run until it has used up the real-time share");
+  eq_num(dummy_procs[2].remaining_cpu_time, SCHED_RR_QUANTUM, "A FIFO proc has no time slice");
+
+  sched_tick();
+  ok(needs_resched, "Should reschedule once the real-time share is used up");
+
+  sched_run();
+  eq_num(proc_current, &dummy_procs[1], "Should run time-share procs while throttled");
+
+  for (unsigned int n = SCHED_RT_RUNTIME; n < SCHED_RT_PERIOD; n++) {
+    sched_tick();
+  }
+  sched_run();
+
+  eq_num(proc_current, &dummy_procs[2], "Should run real-time procs again once the period ends");
 }
 
 static void
-sched_set_tss_sets_gdt_test (void) {
-  i386_tss_t tss = {
-    .cr3 = 1,
-    .ds  = 1,
-  };
+rr_rotates_within_priority_test (void) {
+  sched_setscheduler(&dummy_procs[1], SCHED_RR, 5);
+  sched_setscheduler(&dummy_procs[2], SCHED_RR, 5);
+  make_runnable(&dummy_procs[1], 1, 1);
+  make_runnable(&dummy_procs[2], 1, 1);
+
+  sched_run();
 
-  proc_t test_proc;
-  memset(&test_proc, 0, sizeof(test_proc));
-  test_proc.tss.esp = 0xCAFEBABE;
+  eq_num(proc_current, &dummy_procs[1], "Should run the RR proc queued first");
 
-  memset(gdt, 0, sizeof(gdt));
-  test_proc.tss = tss;
+  for (unsigned int n = 0; n < SCHED_RR_QUANTUM; n++) {
+    sched_tick();
+  }
+  sched_run();
+
+  eq_num(proc_current, &dummy_procs[2], "Should rotate once the quantum is used up");
+  eq_num(dummy_procs[1].remaining_cpu_time, SCHED_RR_QUANTUM, "Should recharge the quantum");
+}
+
+static void
+setscheduler_validates_args_test (void) {
+  eq_num(sched_setscheduler(&dummy_procs[1], 42, 1), -EINVAL, "Should reject unknown policies");
+  eq_num(
+    sched_setscheduler(&dummy_procs[1], SCHED_FIFO, 0),
+    -EINVAL,
+    "Should reject real-time policies without a priority"
+  );
+  eq_num(
+    sched_setscheduler(&dummy_procs[1], SCHED_RR, SCHED_MAX_RT_PRIO + 1),
+    -EINVAL,
+    "Should reject out of range priorities"
+  );
+  eq_num(
+    sched_setscheduler(&dummy_procs[1], SCHED_OTHER, 1),
+    -EINVAL,
+    "Should reject a priority for time-share procs"
+  );
+  eq_num(sys_sched_setscheduler(12345, SCHED_FIFO, 1), -ESRCH, "Should reject unknown pids");
+
+  sys_sched_setscheduler(0, SCHED_RR, 3);
+  eq_num(sys_sched_getscheduler(0), SCHED_RR, "Pid 0 should be the current proc");
+}
+
+static void
+preempt_disable_defers_resched_test (void) {
+  make_runnable(&dummy_procs[1], 1, 1);
+  make_runnable(&dummy_procs[2], 2, 2);
+  proc_current = &dummy_procs[1];
+  mock_eflags  = EFLAGS_INT_ENABLED;
+
+  preempt_disable();
+  preempt_check_resched();
+
+  ok(!did_context_switch, "Should not preempt while preemption is disabled");
+
+  preempt_enable();
+
+  eq_num(proc_current, &dummy_procs[2], "Should preempt once preemption is enabled again");
+  eq_num(dummy_procs[1].preempt_count, 0, "Should drop the preempted proc's count");
+}
+
+static void
+preempt_irq_respects_interrupted_flags_test (void) {
+  make_runnable(&dummy_procs[1], 1, 1);
+  make_runnable(&dummy_procs[2], 2, 2);
+  proc_current = &dummy_procs[1];
 
-  seg_desc_t *g = &gdt[TSS / sizeof(seg_desc_t)];
+  preempt_schedule_irq(0);
 
-  sched_set_tss(&test_proc);
+  ok(!did_context_switch, "Should not preempt code that ran with interrupts disabled");
 
-  unsigned int base = (unsigned int)&test_proc.tss;
+  preempt_schedule_irq(EFLAGS_INT_ENABLED);
 
-  eq_num(g->low_base, (base & 0xFFFFFF), "GDT base should match TSS");
-  eq_num(g->low_flags, SD_TSS_PRESENT, "GDT flags should be SD_TSS_PRESENT");
-  eq_num(g->hi_base, (base >> 24) & 0xFF, "GDT high base should match");
+  eq_num(proc_current, &dummy_procs[2], "Should preempt code that ran with interrupts enabled");
+  ok(!needs_resched, "Should clear the pending reschedule");
+}
+
+static void
+context_switch_loads_tss_test (void) {
+  unsigned char bitmap[2] = {0xFE, 0x7F};
+
+  make_runnable(&dummy_procs[1], 1, 1);
+  make_runnable(&dummy_procs[2], 2, 2);
+  dummy_procs[1].thread.esp0    = 0x1000;
+  dummy_procs[2].thread.esp0    = 0x2000;
+  dummy_procs[2].io_bitmap      = bitmap;
+  dummy_procs[2].io_bitmap_size = sizeof(bitmap);
+  proc_current                  = &dummy_procs[1];
+  tss.io_bitmap_addr            = TSS_NO_IO_BITMAP;
+
+  sched_run();
+
+  eq_num(tss.esp0, 0x2000, "Should switch to the next proc's kernel stack");
+  eq_num(tss.io_bitmap_addr, offsetof(i386tss_t, io_bitmap), "Should enable the I/O bitmap");
+  ok(tss.io_bitmap[0] == 0xFE && tss.io_bitmap[1] == 0x7F, "Should copy the proc's I/O bitmap");
+
+  dummy_procs[2].remaining_cpu_time = 0;
+  dummy_procs[1].remaining_cpu_time = 1;
+  needs_resched                     = true;
+
+  sched_run();
+
+  eq_num(tss.esp0, 0x1000, "Should switch back to the previous proc's kernel stack");
+  eq_num(tss.io_bitmap_addr, TSS_NO_IO_BITMAP, "Should deny port access without a bitmap");
 }
 
 int
 main (void) {
-  plan(10);
+  plan(45);
 
+  reset_procs();
   no_switch_if_still_running_test();
+
+  reset_procs();
   switches_if_different_proc_selected_test();
+
+  reset_procs();
+  expired_proc_waits_for_next_round_test();
+
+  reset_procs();
   recharges_all_on_empty_cpu_time_test();
-  sched_set_tss_sets_gdt_test();
+
+  reset_procs();
+  same_priority_runs_in_fifo_order_test();
+
+  reset_procs();
+  idles_when_nothing_runnable_test();
+
+  reset_procs();
+  rt_runs_before_time_share_test();
+
+  // Must be the first test to tick, so that it starts at the beginning of a throttling period
+  reset_procs();
+  rt_throttling_test();
+
+  reset_procs();
+  rr_rotates_within_priority_test();
+
+  reset_procs();
+  setscheduler_validates_args_test();
+
+  reset_procs();
+  tick_consumes_time_slice_test();
+
+  reset_procs();
+  preempt_disable_defers_resched_test();
+
+  reset_procs();
+  preempt_irq_respects_interrupted_flags_test();
+
+  reset_procs();
+  context_switch_loads_tss_test();
 
   done_testing();
 }
@@ -0,0 +1,180 @@
+#include "proc/sched.h"
+
+#include "../stubs.h"
+#include "kconfig.h"
+#include "libtap/libtap.h"
+#include "proc/proc.h"
+
+// The kernel's types go first, so that the C library doesn't define its own pid_t
+#include <string.h>
+#include <time.h>
+
+/**
+ * The number of reschedules timed per run, and the number of runs of which the fastest is taken to
+ * filter out noise from the host
+ */
+#define NUM_PICKS 100000
+#define NUM_RUNS  5
+
+/**
+ * The most processes whose run queue links a single reschedule may touch: the expired process, its
+ * neighbours in the queue it leaves and those in the queue it joins
+ */
+#define MAX_QUEUE_UPDATES 5
+
+static proc_t procs[NUM_PROCS];
+
+/**
+ * The run queue links of each process, as of before the last reschedule
+ */
+typedef struct {
+  proc_t        *next_running;
+  proc_t        *prev_running;
+  sched_array_t *run_array;
+  unsigned int   run_prio;
+} queue_links_t;
+
+static queue_links_t links[NUM_PROCS];
+
+void
+switch_to (unsigned int *prev_esp, unsigned int next_esp) {}
+
+unsigned int
+eflags_get (void) {
+  return 0;
+}
+
+void
+int_disable (void) {}
+
+void
+eflags_set (uint32_t eflags) {}
+
+/**
+ * Makes processes 1 through `num_procs` runnable, spread across the priority levels, with
+ * `procs[0]` standing in for the idle process.
+ */
+static void
+setup_procs (unsigned int num_procs) {
+  for (unsigned int n = 0; n < NUM_PROCS; n++) {
+    sched_dequeue(&procs[n]);
+  }
+  memset(procs, 0, sizeof(procs));
+  proc_list = procs;
+
+  for (unsigned int n = 1; n <= num_procs; n++) {
+    procs[n].priority           = 1 + (n % SCHED_NUM_PRIOS);
+    procs[n].remaining_cpu_time = procs[n].priority;
+    proc_runnable(&procs[n]);
+  }
+
+  proc_current = &procs[0];
+}
+
+/**
+ * Times reschedules with `num_procs` runnable processes. Every pick has the current process use up
+ * its time slice, so the run queues are cycled through and recharged over and over again.
+ *
+ * @return double The fastest run's cost of a single reschedule, in nanoseconds.
+ */
+static double
+time_picks (unsigned int num_procs) {
+  double best = 0;
+
+  setup_procs(num_procs);
+
+  for (unsigned int run = 0; run < NUM_RUNS; run++) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (unsigned int n = 0; n < NUM_PICKS; n++) {
+      proc_current->remaining_cpu_time = 0;
+      needs_resched                    = true;
+      sched_run();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / NUM_PICKS;
+    if (!run || ns < best) {
+      best = ns;
+    }
+  }
+
+  return best;
+}
+
+static void
+save_links (void) {
+  for (unsigned int n = 0; n < NUM_PROCS; n++) {
+    links[n].next_running = procs[n].next_running;
+    links[n].prev_running = procs[n].prev_running;
+    links[n].run_array    = procs[n].run_array;
+    links[n].run_prio     = procs[n].run_prio;
+  }
+}
+
+/**
+ * Counts the processes whose run queue links changed since `save_links`
+ */
+static unsigned int
+count_queue_updates (void) {
+  unsigned int updates = 0;
+
+  for (unsigned int n = 0; n < NUM_PROCS; n++) {
+    if (links[n].next_running != procs[n].next_running
+        || links[n].prev_running != procs[n].prev_running
+        || links[n].run_array != procs[n].run_array || links[n].run_prio != procs[n].run_prio) {
+      updates++;
+    }
+  }
+
+  return updates;
+}
+
+/**
+ * Reschedules with `num_procs` runnable processes, for a few rounds of every process using up its
+ * time slice, and tracks how many processes each reschedule touches.
+ *
+ * @return unsigned int The most processes a single reschedule touched.
+ */
+static unsigned int
+max_queue_updates (unsigned int num_procs) {
+  unsigned int max = 0;
+
+  setup_procs(num_procs);
+
+  for (unsigned int n = 0; n < 4 * NUM_PROCS * SCHED_NUM_PRIOS; n++) {
+    save_links();
+
+    proc_current->remaining_cpu_time = 0;
+    needs_resched                    = true;
+    sched_run();
+
+    unsigned int updates = count_queue_updates();
+    if (updates > max) {
+      max = updates;
+    }
+  }
+
+  return max;
+}
+
+int
+main (void) {
+  plan(1);
+
+  for (unsigned int num_procs = 1; num_procs < NUM_PROCS; num_procs *= 2) {
+    diag("%2u runnable processes: %.1f ns per pick", num_procs, time_picks(num_procs));
+  }
+  diag("%2u runnable processes: %.1f ns per pick", NUM_PROCS - 1, time_picks(NUM_PROCS - 1));
+
+  unsigned int updates = max_queue_updates(NUM_PROCS - 1);
+  diag(
+    "%2u runnable processes: up to %u run queue entries updated per pick", NUM_PROCS - 1, updates
+  );
+
+  ok(updates <= MAX_QUEUE_UPDATES, "Picking the next process only updates its neighbours' entries");
+
+  done_testing();
+}
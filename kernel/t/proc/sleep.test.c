@@ -5,24 +5,42 @@
 #include <string.h>
 
 #include "../stubs.h"
-#include "kconfig.h"
+#include "interrupt/timer.h"
+#include "lib/errno.h"
 #include "libtap/libtap.h"
 #include "proc/proc.h"
 #include "proc/sched.h"
 
-#define NUM_SLEEP_HASH_TABLE_BUCKETS ((NUM_PROCS * 10) / 100)
+#define MAX_SLEEPERS 4
 
-#define TO_SLEEP_TABLE_HASH(addr)    ((addr) % (NUM_SLEEP_HASH_TABLE_BUCKETS))
+typedef struct {
+  proc_t proc;
+  bool   exclusive;
+  int    ret;
+} sleeper_t;
 
 // Mocks and helpers
-static proc_t  test_proc;
-static proc_t *sleep_hash_table[NUM_SLEEP_HASH_TABLE_BUCKETS];
+static proc_t            test_proc;
+static wait_queue_head_t test_wq;
 
 extern proc_t *proc_current;
-extern proc_t *proc_running_list;
 extern bool    needs_resched;
 
-static int fake_sig = 0;
+static int     fake_sig = 0;
+static proc_t *fake_sig_proc;
+
+/**
+ * Processes that go to sleep on `test_wq` one after the other, each from within the previous one's
+ * call to `sched_run`. Once they're all asleep, `while_asleep` runs.
+ */
+static sleeper_t sleepers[MAX_SLEEPERS];
+static int       num_sleepers;
+static int       next_sleeper;
+static void (*while_asleep)(void);
+
+static timer_task_request_t *armed_timer;
+static unsigned int          armed_ticks;
+static bool                  timer_removed;
 
 unsigned int
 eflags_get (void) {
@@ -37,7 +55,7 @@ eflags_set (uint32_t eflags) {}
 
 int
 sig_get (void) {
-  return fake_sig;
+  return !fake_sig_proc || fake_sig_proc == proc_current ? fake_sig : 0;
 }
 
 void
@@ -51,150 +69,274 @@ proc_runnable (proc_t *proc) {
 }
 
 void
-sched_run (void) {}
+timer_task_add (timer_task_request_t *req, unsigned int ticks) {
+  armed_timer = req;
+  armed_ticks = ticks;
+}
+
+void
+timer_task_remove (timer_task_request_t *req) {
+  timer_removed = req == armed_timer;
+}
+
+void
+sched_run (void) {
+  if (next_sleeper < num_sleepers) {
+    sleeper_t *s    = &sleepers[next_sleeper++];
+    proc_t    *prev = proc_current;
+
+    proc_current    = &s->proc;
+    s->ret          = s->exclusive ? sleep_on_exclusive(&test_wq, PROC_INTERRUPTIBLE)
+                                   : sleep_on(&test_wq, PROC_INTERRUPTIBLE);
+    proc_current    = prev;
+    return;
+  }
+
+  if (while_asleep) {
+    void (*fn)(void) = while_asleep;
+    while_asleep     = NULL;
+    fn();
+  }
+}
 
 static inline void
 reset_mocks (void) {
   memset(&test_proc, 0, sizeof(test_proc));
-  proc_current      = &test_proc;
-  fake_sig          = 0;
-  proc_running_list = NULL;
-  needs_resched     = false;
-  sleep_init();
+  memset(&test_wq, 0, sizeof(test_wq));
+  memset(sleepers, 0, sizeof(sleepers));
+  test_proc.state = PROC_RUNNING;
+  proc_current    = &test_proc;
+  fake_sig        = 0;
+  fake_sig_proc   = NULL;
+  num_sleepers    = 0;
+  next_sleeper    = 0;
+  while_asleep    = NULL;
+  armed_timer     = NULL;
+  armed_ticks     = 0;
+  timer_removed   = false;
+  needs_resched   = false;
 }
 
+/**
+ * Puts `n` processes to sleep on `test_wq` in order, and runs `fn` once they're all asleep
+ */
 static void
-assert_sleeping (proc_t *p, void *addr) {
-  eq_num(p->state, PROC_SLEEPING, "process is sleeping");
-  eq_num(p->sleep_addr, addr, "process sleep addr is expected value");
+sleep_many (int n, const bool *exclusive, void (*fn)(void)) {
+  for (int i = 0; i < n; i++) {
+    sleepers[i].proc.state    = PROC_RUNNING;
+    sleepers[i].proc.priority = 10 + i;
+    sleepers[i].exclusive     = exclusive[i];
+  }
+  num_sleepers = n;
+  while_asleep = fn;
+
+  sched_run();
 }
 
 static void
-assert_running (proc_t *p) {
-  eq_num(p->state, PROC_RUNNING, "process is running");
-  eq_num(p->remaining_cpu_time, p->priority, "process quantum refilled");
-  eq_null(p->sleep_addr, "sleep address is NULL");
+assert_sleeping (proc_t *p, const char *name) {
+  eq_num(p->state, PROC_SLEEPING, "%s is sleeping", name);
+  ok(p->wait_queue == &test_wq, "%s is on the wait queue", name);
 }
 
 static void
-uninterruptible_sleep_test (void) {
-  void *addr = (void *)0x1234;
-
-  int ret    = sleep(addr, PROC_UNINTERRUPTIBLE);
+assert_running (proc_t *p, const char *name) {
+  eq_num(p->state, PROC_RUNNING, "%s is running", name);
+  eq_num(p->remaining_cpu_time, p->priority, "%s quantum refilled", name);
+  eq_null(p->wait_queue, "%s is off the wait queue", name);
+}
 
-  eq_num(ret, 0, "Uninterruptible sleep returns 0");
-  assert_sleeping(&test_proc, addr);
+static void
+check_uninterruptible_sleep (void) {
+  assert_sleeping(&test_proc, "process");
   ok(test_proc.flags & PROC_FLAG_NOTINTERRUPT, "PROC_FLAG_NOTINTERRUPT is set");
+  ok(wait_queue_active(&test_wq), "queue is active while somebody sleeps on it");
 }
 
 static void
-interruptible_sleep_no_signal_test (void) {
-  void *addr = (void *)0x1234;
+uninterruptible_sleep_test (void) {
+  while_asleep = check_uninterruptible_sleep;
 
-  int ret    = sleep(addr, PROC_INTERRUPTIBLE);
+  int ret      = sleep_on(&test_wq, PROC_UNINTERRUPTIBLE);
 
-  eq_num(ret, 0, "Interruptible sleep without signal returns 0");
-  assert_sleeping(&test_proc, addr);
-  ok(!(test_proc.flags & PROC_FLAG_NOTINTERRUPT), "PROC_FLAG_NOTINTERRUPT not set");
+  eq_num(ret, 0, "Uninterruptible sleep returns 0");
+  ok(!wait_queue_active(&test_wq), "process left the queue after being resumed");
+  eq_null(test_proc.wait_queue, "process wait queue cleared");
 }
 
 static void
 interruptible_sleep_with_signal_test (void) {
-  void *addr      = (void *)0x5678;
-  fake_sig        = 9;
-  test_proc.state = PROC_RUNNING;
+  fake_sig = 9;
 
-  int ret         = sleep(addr, PROC_INTERRUPTIBLE);
+  int ret  = sleep_on(&test_wq, PROC_INTERRUPTIBLE);
 
   eq_num(ret, 9, "Interruptible sleep with signal returns signal");
-  assert_running(&test_proc);
+  eq_num(test_proc.state, PROC_RUNNING, "process never went to sleep");
+  ok(!wait_queue_active(&test_wq), "process was never queued");
 }
 
 static void
-wakeup_test (void) {
-  void *addr                       = (void *)0xDEADBEEF;
+do_wakeup (void) {
+  wakeup(&test_wq);
+}
 
+static void
+wakeup_test (void) {
   proc_current->priority           = 42;
   proc_current->remaining_cpu_time = 0;
+  while_asleep                     = do_wakeup;
 
-  sleep(addr, PROC_INTERRUPTIBLE);
-  wakeup(addr);
+  int ret                          = sleep_on(&test_wq, PROC_UNINTERRUPTIBLE);
 
-  assert_running(&test_proc);
+  eq_num(ret, 0, "Woken sleep returns 0");
+  assert_running(&test_proc, "process");
   ok(!(test_proc.flags & PROC_FLAG_NOTINTERRUPT), "PROC_FLAG_NOTINTERRUPT cleared");
   ok(needs_resched, "Needs resched set on wakeup");
+  ok(!wait_queue_active(&test_wq), "queue is empty after wakeup");
 }
 
 static void
 sleep_reentry_test (void) {
-  void *addr = (void *)0x1337;
-
-  proc_t proc1;
-  memset(&proc1, 0, sizeof(proc1));
-  proc1.priority           = 10;
-  proc1.remaining_cpu_time = 0;
-  proc1.state              = PROC_SLEEPING;
-  proc1.sleep_addr         = addr;
+  test_proc.state = PROC_SLEEPING;
 
-  int ret                  = sleep(addr, PROC_INTERRUPTIBLE);
+  int ret         = sleep_on(&test_wq, PROC_INTERRUPTIBLE);
 
   eq_num(ret, 0, "Sleep returns 0 when already sleeping");
-  assert_sleeping(&proc1, addr);
+  ok(!wait_queue_active(&test_wq), "process was not queued twice");
 }
 
 static void
-multiple_sleepers_same_addr_test (void) {
-  void *addr = (void *)0xCAFEBABE;
+check_exclusive_wakeup (void) {
+  proc_t *a = &sleepers[0].proc, *b = &sleepers[1].proc, *c = &sleepers[2].proc,
+         *d = &sleepers[3].proc;
+
+  // Non-exclusive waiters are queued at the front and exclusive ones at the back, in order
+  list_head_t *curr = test_wq.waiters.next;
+  ok(list_entry(curr, proc_t, wait_list) == d, "last non-exclusive waiter is first");
+  curr = curr->next;
+  ok(list_entry(curr, proc_t, wait_list) == a, "first non-exclusive waiter is second");
+  curr = curr->next;
+  ok(list_entry(curr, proc_t, wait_list) == b, "first exclusive waiter is third");
+  curr = curr->next;
+  ok(list_entry(curr, proc_t, wait_list) == c, "second exclusive waiter is last");
+
+  wakeup(&test_wq);
+
+  assert_running(a, "non-exclusive waiter a");
+  assert_running(d, "non-exclusive waiter d");
+  assert_running(b, "first exclusive waiter");
+  assert_sleeping(c, "second exclusive waiter");
+
+  wakeup(&test_wq);
+
+  assert_running(c, "second exclusive waiter");
+  ok(!wait_queue_active(&test_wq), "queue is empty");
+}
 
-  proc_t proc1;
-  memset(&proc1, 0, sizeof(proc1));
-  proc1.priority           = 10;
-  proc1.remaining_cpu_time = 0;
+static void
+exclusive_wakeup_test (void) {
+  bool exclusive[] = {false, true, true, false};
 
-  proc_t proc2;
-  memset(&proc2, 0, sizeof(proc2));
-  proc2.priority           = 40;
-  proc2.remaining_cpu_time = 0;
+  sleep_many(4, exclusive, check_exclusive_wakeup);
 
-  proc_current             = &proc1;
-  sleep(addr, PROC_INTERRUPTIBLE);
+  for (int i = 0; i < 4; i++) {
+    eq_num(sleepers[i].ret, 0, "waiter %d returns 0", i);
+  }
+}
 
-  eq_null(proc_current->next_sleeping, "no next sleeping pointer yet on proc1");
-  eq_null(proc_current->prev_sleeping, "no prev sleeping pointer on proc1");
+static void
+check_wakeup_all (void) {
+  wakeup_all(&test_wq);
 
-  proc_current = &proc2;
-  sleep(addr, PROC_INTERRUPTIBLE);
+  for (int i = 0; i < 3; i++) {
+    assert_running(&sleepers[i].proc, "waiter");
+  }
+  ok(!wait_queue_active(&test_wq), "queue is empty after wakeup_all");
+}
 
-  ok(proc_current->next_sleeping == &proc1, "proc2 next sleeping points to proc1");
-  ok(proc1.prev_sleeping == proc_current, "proc1 prev sleeping points to proc2");
+static void
+wakeup_all_test (void) {
+  bool exclusive[] = {true, true, false};
 
-  assert_sleeping(&proc1, addr);
-  assert_sleeping(&proc2, addr);
+  sleep_many(3, exclusive, check_wakeup_all);
+}
 
-  wakeup(addr);
+static void
+check_signal_handoff (void) {
+  // A second exclusive waiter, queued by hand so that it's still asleep when the first one returns
+  proc_t *second     = &sleepers[1].proc;
+  second->state      = PROC_SLEEPING;
+  second->priority   = 20;
+  second->wait_queue = &test_wq;
+  second->wait_flags = WAIT_EXCLUSIVE;
+  list_append(&second->wait_list, test_wq.waiters.prev);
+
+  // The first exclusive waiter is woken up, but has a signal to handle
+  fake_sig_proc = &sleepers[0].proc;
+  fake_sig      = 9;
+
+  wakeup(&test_wq);
+
+  assert_running(&sleepers[0].proc, "signalled waiter");
+  assert_sleeping(second, "second exclusive waiter");
+}
+
+static void
+signal_handoff_test (void) {
+  bool exclusive[] = {true};
 
-  assert_running(&proc1);
-  assert_running(&proc2);
+  sleep_many(1, exclusive, check_signal_handoff);
+
+  eq_num(sleepers[0].ret, 9, "signalled waiter returns the signal");
+  assert_running(&sleepers[1].proc, "second exclusive waiter");
+  ok(!wait_queue_active(&test_wq), "queue is empty after the handoff");
+}
+
+static void
+expire_timer (void) {
+  ok(armed_timer != NULL, "timeout armed");
+  eq_num(armed_ticks, 5, "timeout armed for the requested ticks");
+
+  armed_timer->fn(armed_timer->arg);
+}
+
+static void
+timeout_test (void) {
+  while_asleep = expire_timer;
+
+  int ret      = sleep_on_timeout(&test_wq, PROC_INTERRUPTIBLE, 5);
+
+  eq_num(ret, -ETIMEDOUT, "Timed out sleep returns -ETIMEDOUT");
+  assert_running(&test_proc, "process");
+  ok(timer_removed, "timeout removed after waking up");
+  eq_num(test_proc.wait_flags, 0, "wait flags cleared");
+}
+
+static void
+timeout_wakeup_test (void) {
+  while_asleep = do_wakeup;
+
+  int ret      = sleep_on_timeout(&test_wq, PROC_INTERRUPTIBLE, 5);
+
+  eq_num(ret, 0, "Sleep woken before its timeout returns 0");
+  ok(timer_removed, "pending timeout removed");
 }
 
 static void
 no_sleeper_wakeup_test (void) {
-  void *addr = (void *)0xABCD;
-  wakeup(addr);
+  wakeup(&test_wq);
+  wakeup_all(&test_wq);
 
-  ok(1, "Waking up on unused addr does not crash");
+  ok(1, "Waking up an unused, zeroed queue does not crash");
 }
 
 int
 main () {
-  plan(35);
+  plan(73);
 
   reset_mocks();
   uninterruptible_sleep_test();
 
-  reset_mocks();
-  interruptible_sleep_no_signal_test();
-
   reset_mocks();
   interruptible_sleep_with_signal_test();
 
@@ -205,7 +347,19 @@ main () {
   sleep_reentry_test();
 
   reset_mocks();
-  multiple_sleepers_same_addr_test();
+  exclusive_wakeup_test();
+
+  reset_mocks();
+  wakeup_all_test();
+
+  reset_mocks();
+  signal_handoff_test();
+
+  reset_mocks();
+  timeout_test();
+
+  reset_mocks();
+  timeout_wakeup_test();
 
   reset_mocks();
   no_sleeper_wakeup_test();
@@ -5,7 +5,10 @@
 
 volatile char image_start[] = {0};
 volatile char image_end[]   = {0};
+volatile char setup_end[]   = {0};
 volatile char text_end[]    = {0};
+volatile char init_start[]  = {0};
+volatile char init_end[]    = {0};
 volatile char data_end[]    = {0};
 
 #endif /* STUBS_H */
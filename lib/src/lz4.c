@@ -0,0 +1,230 @@
+#include "lib/lz4.h"
+
+#include "lib/string.h"
+
+/**
+ * Shortest match the format can express
+ */
+#define MIN_MATCH     4
+
+/**
+ * The last match must start at least this many bytes before the end of the block...
+ */
+#define MFLIMIT       12
+
+/**
+ * ...and the last this many bytes are always literals
+ */
+#define LAST_LITERALS 5
+
+/**
+ * Largest distance a match can reach back
+ */
+#define MAX_DISTANCE  0xFFFF
+
+static inline uint32_t
+read32 (const uint8_t* p) {
+  uint32_t v;
+  kmemcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t
+hash_seq (uint32_t seq) {
+  return (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+/**
+ * Writes the remainder of a literal or match length that didn't fit in its token nibble.
+ */
+static inline uint8_t*
+write_length (uint8_t* op, size_t len) {
+  for (; len >= 255; len -= 255) {
+    *op++ = 255;
+  }
+  *op++ = (uint8_t)len;
+
+  return op;
+}
+
+/**
+ * Writes a sequence's token and literals, leaving the match for the caller.
+ *
+ * @return uint8_t* The end of the literals, or NULL if the sequence (with a match of `match_len`
+ * bytes) wouldn't fit before `oend`. The position of the token is stored in `token`.
+ */
+static uint8_t*
+write_literals (
+  uint8_t*       op,
+  uint8_t*       oend,
+  const uint8_t* anchor,
+  size_t         lit_len,
+  size_t         match_len,
+  uint8_t**      token
+) {
+  // Token, literals with their length bytes, offset and match length bytes
+  size_t worst = 1 + lit_len + (lit_len / 255) + 1 + 2 + (match_len / 255) + 1;
+  if (worst > (size_t)(oend - op)) {
+    return NULL;
+  }
+
+  *token = op++;
+  if (lit_len >= 15) {
+    **token = 15 << 4;
+    op      = write_length(op, lit_len - 15);
+  } else {
+    **token = (uint8_t)(lit_len << 4);
+  }
+
+  kmemcpy(op, anchor, lit_len);
+
+  return op + lit_len;
+}
+
+size_t
+lz4_compress (const void* src, size_t src_len, void* dst, size_t dst_cap, void* wrkmem) {
+  const uint8_t* base   = src;
+  const uint8_t* ip     = base;
+  const uint8_t* anchor = base;
+  const uint8_t* end    = base + src_len;
+  uint8_t*       op     = dst;
+  uint8_t*       oend   = op + dst_cap;
+  uint16_t*      table  = wrkmem;
+
+  if (src_len > LZ4_MAX_INPUT) {
+    return 0;
+  }
+
+  kmemset(table, 0, LZ4_WORKMEM_SIZE);
+
+  if (src_len > MFLIMIT) {
+    const uint8_t* mflimit    = end - MFLIMIT;
+    const uint8_t* matchlimit = end - LAST_LITERALS;
+
+    // Position 0 is where every hash table entry points to initially, so it can't be a candidate for
+    // itself
+    table[hash_seq(read32(ip))] = 0;
+    ip++;
+
+    while (ip <= mflimit) {
+      uint32_t       seq = read32(ip);
+      uint32_t       h   = hash_seq(seq);
+      const uint8_t* ref = base + table[h];
+      table[h]           = (uint16_t)(ip - base);
+
+      if (ip - ref > MAX_DISTANCE || read32(ref) != seq) {
+        ip++;
+        continue;
+      }
+
+      const uint8_t* mp = ip + MIN_MATCH;
+      const uint8_t* rp = ref + MIN_MATCH;
+      while (mp < matchlimit && *mp == *rp) {
+        mp++;
+        rp++;
+      }
+
+      uint8_t* token;
+      size_t   match_len = (size_t)(mp - ip) - MIN_MATCH;
+      if (!(op = write_literals(op, oend, anchor, (size_t)(ip - anchor), match_len, &token))) {
+        return 0;
+      }
+
+      unsigned int offset = (unsigned int)(ip - ref);
+      *op++               = offset & 0xFF;
+      *op++ = offset >> 8;
+
+      if (match_len >= 15) {
+        *token |= 15;
+        op      = write_length(op, match_len - 15);
+      } else {
+        *token |= (uint8_t)match_len;
+      }
+
+      ip     = mp;
+      anchor = ip;
+    }
+  }
+
+  // The rest of the input goes out as literals
+  uint8_t* token;
+  if (!(op = write_literals(op, oend, anchor, (size_t)(end - anchor), 0, &token))) {
+    return 0;
+  }
+
+  return (size_t)(op - (uint8_t*)dst);
+}
+
+/**
+ * Reads the remainder of a literal or match length that didn't fit in its token nibble.
+ *
+ * @return const uint8_t* The position after the length bytes, or NULL if they run off the end.
+ */
+static const uint8_t*
+read_length (const uint8_t* ip, const uint8_t* iend, size_t* len) {
+  uint8_t b;
+  do {
+    if (ip >= iend) {
+      return NULL;
+    }
+    b     = *ip++;
+    *len += b;
+  } while (b == 255);
+
+  return ip;
+}
+
+int
+lz4_decompress (const void* src, size_t src_len, void* dst, size_t dst_cap) {
+  const uint8_t* ip   = src;
+  const uint8_t* iend = ip + src_len;
+  uint8_t*       op   = dst;
+  uint8_t*       oend = op + dst_cap;
+
+  while (ip < iend) {
+    uint8_t token   = *ip++;
+
+    size_t  lit_len = token >> 4;
+    if (lit_len == 15 && !(ip = read_length(ip, iend, &lit_len))) {
+      return -1;
+    }
+    if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op)) {
+      return -1;
+    }
+
+    kmemcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+
+    // The last sequence has no match
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      return -1;
+    }
+    size_t offset  = ip[0] | (ip[1] << 8);
+    ip            += 2;
+    if (!offset || offset > (size_t)(op - (uint8_t*)dst)) {
+      return -1;
+    }
+
+    size_t match_len = token & 15;
+    if (match_len == 15 && !(ip = read_length(ip, iend, &match_len))) {
+      return -1;
+    }
+    match_len += MIN_MATCH;
+    if (match_len > (size_t)(oend - op)) {
+      return -1;
+    }
+
+    // Matches may overlap their own output, so copy byte by byte
+    const uint8_t* match = op - offset;
+    while (match_len--) {
+      *op++ = *match++;
+    }
+  }
+
+  return (int)(op - (uint8_t*)dst);
+}
@@ -0,0 +1,97 @@
+#include "lib/lz4.h"
+
+#include "lib/string.h"
+#include "tests.h"
+
+#define BUF_SIZE 4096
+
+static char          wrkmem[LZ4_WORKMEM_SIZE];
+static unsigned char input[BUF_SIZE];
+static unsigned char compressed[BUF_SIZE * 2];
+static unsigned char output[BUF_SIZE];
+
+/**
+ * Fills the input with bytes that don't repeat within any window a match could reach.
+ */
+static void
+fill_incompressible (void) {
+  unsigned int seed = 0x12345678;
+  for (unsigned int n = 0; n < BUF_SIZE; n++) {
+    seed     = seed * 1103515245 + 12345;
+    input[n] = (unsigned char)(seed >> 16);
+  }
+}
+
+static void
+compress_round_trips_repetitive_data_test (void) {
+  for (unsigned int n = 0; n < BUF_SIZE; n++) {
+    input[n] = "lorem ipsum dolor "[n % 18];
+  }
+
+  size_t len = lz4_compress(input, BUF_SIZE, compressed, sizeof(compressed), wrkmem);
+  ok(len > 0 && len < BUF_SIZE / 10, "repetitive data compresses well");
+
+  eq_num(
+    lz4_decompress(compressed, len, output, BUF_SIZE),
+    BUF_SIZE,
+    "decompresses to the original size"
+  );
+  ok(!kmemcmp(input, output, BUF_SIZE), "decompresses to the original data");
+}
+
+static void
+compress_round_trips_incompressible_data_test (void) {
+  fill_incompressible();
+
+  size_t len = lz4_compress(input, BUF_SIZE, compressed, sizeof(compressed), wrkmem);
+  ok(len > BUF_SIZE, "incompressible data grows by the literal length overhead");
+
+  lz4_decompress(compressed, len, output, BUF_SIZE);
+  ok(!kmemcmp(input, output, BUF_SIZE), "incompressible data survives the round trip");
+}
+
+static void
+compress_fails_if_output_does_not_fit_test (void) {
+  fill_incompressible();
+
+  eq_num(
+    lz4_compress(input, BUF_SIZE, compressed, BUF_SIZE / 2, wrkmem),
+    0,
+    "returns 0 if the output buffer is too small"
+  );
+}
+
+static void
+compress_handles_short_inputs_test (void) {
+  kmemset(input, 'a', 8);
+
+  size_t len = lz4_compress(input, 8, compressed, sizeof(compressed), wrkmem);
+  eq_num(len, 9, "inputs too short for a match are emitted as a single literal run");
+  eq_num(lz4_decompress(compressed, len, output, 8), 8, "short inputs round trip");
+}
+
+static void
+decompress_rejects_malformed_blocks_test (void) {
+  kmemset(input, 0, BUF_SIZE);
+  size_t len = lz4_compress(input, BUF_SIZE, compressed, sizeof(compressed), wrkmem);
+
+  eq_num(
+    lz4_decompress(compressed, len, output, BUF_SIZE - 1),
+    -1,
+    "rejects blocks that decompress past the end of the output"
+  );
+  eq_num(lz4_decompress(compressed, len - 1, output, BUF_SIZE), -1, "rejects truncated blocks");
+
+  // A single literal followed by a match that reaches back before the start of the output
+  unsigned char bad[] = {0x10, 'x', 0x02, 0x00};
+  eq_num(lz4_decompress(bad, sizeof(bad), output, BUF_SIZE), -1, "rejects out of range offsets");
+}
+
+void
+run_lz4_tests (void) {
+  compress_round_trips_repetitive_data_test();
+  compress_round_trips_incompressible_data_test();
+  compress_fails_if_output_does_not_fit_test();
+  compress_handles_short_inputs_test();
+  decompress_rejects_malformed_blocks_test();
+}
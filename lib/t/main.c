@@ -2,12 +2,13 @@
 
 int
 main () {
-  plan(148);
+  plan(159);
 
   run_string_tests();
   run_flist_tests();
   run_list_tests();
   run_ctype_tests();
+  run_lz4_tests();
 
   done_testing();
 }
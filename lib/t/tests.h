@@ -7,5 +7,6 @@ void run_string_tests(void);
 void run_flist_tests(void);
 void run_list_tests(void);
 void run_ctype_tests(void);
+void run_lz4_tests(void);
 
 #endif /* TESTS_H */